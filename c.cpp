@@ -48,7 +48,7 @@ int main (int argc, char** argv)
 			fraction->add_child (std::move (bottom), true);
 		}
 
-		std::cout << "(" << N << " " << K << ") = "; fraction->accept (printer); std::cout << std::endl;
+		std::cout << "(" << N << " " << K << ") = "; printer.print (*fraction); std::cout << std::endl;
 
 		boost::any value = fraction->accept (calculate);
 
@@ -0,0 +1,429 @@
+#include "batch.h"
+#include "budget.h"
+#include "util-tree.h"
+#include "parser.h"
+#include "program.h"
+#include "visitor-calculate.h"
+#include "visitor-print.h"
+
+#include <util/thread-pool.h>
+
+namespace {
+
+/* jobs are handed to workers in chunks of up to this many lines */
+const size_t chunk_size = 64;
+
+/* chunks in flight per worker before the output is waited for */
+const size_t chunks_per_worker = 4;
+
+std::vector<std::string> split (const std::string& line, char separator)
+{
+	std::vector<std::string> result;
+	std::istringstream ss (line);
+	std::string field;
+
+	while (std::getline (ss, field, separator)) {
+		result.push_back (std::move (field));
+	}
+
+	return result;
+}
+
+data_t fp_or_nan (const boost::any& value)
+{
+	return value.empty() ? NAN : any_to_fp (value);
+}
+
+void write_value (std::ostream& out, const boost::any& value)
+{
+	out << " " << fp_or_nan (value);
+}
+
+/* returns null if the tree cannot be compiled (it is then evaluated with Visitor::Calculate) */
+std::unique_ptr<Program> try_compile (const Node::Base& tree, const std::vector<std::string>& slots, const std::vector<std::string>& error_slots)
+{
+	try {
+		return std::unique_ptr<Program> (new Program (tree, slots, error_slots));
+	} catch (std::runtime_error&) {
+		return nullptr;
+	}
+}
+
+} // anonymous namespace
+
+struct Batch::Job
+{
+	char mode;
+	std::string variable;
+	unsigned order = 1;
+	rational_t point = rational_t (0);
+	std::string expression;
+	Variable::Map variables;
+
+	/* whether the symbolic result depends on the values of variables rather than just on their names */
+	bool depends_on_values() const
+	{
+		return (mode == 'T') || ((mode == 'S') && !variable.empty());
+	}
+
+	std::string cache_key() const
+	{
+		std::ostringstream key;
+		key << mode << " " << variable << " " << order << " " << point << ";" << expression;
+
+		for (const Variable::Map::value_type& var: variables) {
+			key << ";" << var.first << " " << var.second.value.empty() << var.second.no_error();
+
+			if (depends_on_values() && !var.second.value.empty()) {
+				any_to_ostream (key, var.second.value);
+			}
+		}
+
+		return key.str();
+	}
+};
+
+struct Batch::Entry
+{
+	/* the variables the trees are bound to (a copy of those of the job which has built the entry) */
+	Variable::Map variables;
+
+	Node::Base::Ptr expression;
+	Node::Base::Ptr result;
+
+	/*
+	 * The trees compiled over the values of all variables (and over the errors of the variables in error_slots,
+	 * for 'E'), so that a job hitting the cache does not walk the trees; null if a tree could not be compiled.
+	 */
+	std::vector<std::string> slots, error_slots;
+	std::unique_ptr<Program> expression_program, result_program;
+
+	/* returns the value of the expression (result == false) or of the result for the variables of a job */
+	boost::any evaluate (bool result, const Variable::Map& values) const;
+};
+
+boost::any Batch::Entry::evaluate (bool result, const Variable::Map& values) const
+{
+	const std::unique_ptr<Program>& program = result ? result_program : expression_program;
+
+	if (!program) {
+		Visitor::Calculate calculate (&values);
+		return (result ? this->result : expression)->accept (calculate);
+	}
+
+	/* the names of the variables of a job are a part of the cache key, so all slots are defined */
+	std::vector<data_t> slot_values, stack (program->stack_size());
+
+	for (const std::string& name: slots) {
+		slot_values.push_back (fp_or_nan (values.at (name).value));
+	}
+
+	for (const std::string& name: error_slots) {
+		slot_values.push_back (fp_or_nan (values.at (name).error));
+	}
+
+	return program->evaluate (slot_values.data(), stack.data());
+}
+
+Batch::Batch (const Variable::Map& constants, Options options)
+: constants_ (constants)
+, options_ (std::move (options))
+{
+}
+
+Batch::~Batch() = default;
+
+std::shared_ptr<const Batch::Entry> Batch::build (const Job& job) const
+{
+	/* the budget is accounted per job, whatever runs concurrently */
+	Budget::Scope budget;
+
+	std::shared_ptr<Entry> entry (new Entry);
+	entry->variables = job.variables;
+
+	Node::Base::Ptr raw = Parser (job.expression, entry->variables).parse();
+
+	if ((job.mode == 'S') && !job.variable.empty()) {
+		entry->expression = simplify_tree (raw.get(), job.variable);
+	} else {
+		entry->expression = simplify_tree (raw.get());
+	}
+
+	switch (job.mode) {
+	case 'S':
+		break;
+
+	case 'D':
+		entry->result = differentiate (entry->expression.get(), job.variable, job.order);
+		break;
+
+	case 'E': {
+		std::set<std::string> partial_variables;
+
+		for (const Variable::Map::value_type& var: entry->variables) {
+			if (!var.second.no_error()) {
+				partial_variables.insert (var.first);
+			}
+		}
+
+		std::map<std::string, Node::Base::Ptr> partials = gradient (entry->expression.get(), partial_variables);
+		std::map<std::string, const Node::Base*> partial_trees;
+
+		for (const auto& partial: partials) {
+			partial_trees.emplace (partial.first, partial.second.get());
+		}
+
+		Node::Base::Ptr error = error_tree (partial_trees, entry->variables);
+		entry->result = simplify_tree (error.get());
+		entry->error_slots.assign (partial_variables.begin(), partial_variables.end());
+		break;
+	}
+
+	case 'T': {
+		auto var = entry->variables.find (job.variable);
+		VERIFY (var != entry->variables.end(), std::runtime_error, "Cannot find variable '" << job.variable << "' while computing Taylor series");
+
+		/* the variable takes the value of the point, which must be 0 as on the command line */
+		if (job.point != 0) {
+			ERROR (std::runtime_error, "Sorry, unimplemented: building the Taylor series for non-zero point " << job.point);
+		}
+
+		var->second.value = job.point;
+		std::vector<boost::any> coefficients = taylor_coefficients (entry->expression.get(), job.variable, job.order);
+
+		Node::AdditionSubtraction::Ptr sum (new Node::AdditionSubtraction);
+
+		for (unsigned k = 0; k < coefficients.size(); ++k) {
+			VERIFY (any_isa<rational_t> (coefficients[k]), std::runtime_error, "Cannot build the Taylor series: coefficient of order " << k << " is not rational");
+
+			Node::MultiplicationDivision::Ptr term (new Node::MultiplicationDivision);
+			term->add_child (Node::Base::Ptr (new Node::Value (any_to_rational (coefficients[k]))), false);
+
+			Node::Power::Ptr power (new Node::Power);
+			power->set_base (Node::Base::Ptr (new Node::Variable (var->first, var->second, false)));
+			power->set_exponent (Node::Base::Ptr (new Node::Value (k)));
+			term->add_child (std::move (power), false);
+
+			sum->add_child (std::move (term), false);
+		}
+
+		entry->result = simplify_tree (sum.get());
+		break;
+	}
+
+	HANDLE_DEFAULT_CASE
+	}
+
+	/* the series is printed, not evaluated */
+	if (job.mode != 'T') {
+		for (const Variable::Map::value_type& var: entry->variables) {
+			entry->slots.push_back (var.first);
+		}
+
+		entry->expression_program = try_compile (*entry->expression, entry->slots, entry->error_slots);
+		if (entry->result) {
+			entry->result_program = try_compile (*entry->result, entry->slots, entry->error_slots);
+		}
+	}
+
+	return entry;
+}
+
+std::shared_ptr<const Batch::Entry> Batch::lookup (const Job& job)
+{
+	std::string key = job.cache_key();
+
+	{
+		std::lock_guard<std::mutex> lock (cache_mutex_);
+
+		auto it = cache_.find (key);
+		if (it != cache_.end()) {
+			entries_.splice (entries_.begin(), entries_, it->second);
+			return it->second->second;
+		}
+	}
+
+	/* built outside of the lock; if two workers race for the same entry, the first one wins */
+	std::shared_ptr<const Entry> entry = build (job);
+
+	std::lock_guard<std::mutex> lock (cache_mutex_);
+
+	auto it = cache_.find (key);
+	if (it != cache_.end()) {
+		entries_.splice (entries_.begin(), entries_, it->second);
+		return it->second->second;
+	}
+
+	while (!entries_.empty() && (entries_.size() >= options_.cache_size)) {
+		cache_.erase (entries_.back().first);
+		entries_.pop_back();
+	}
+
+	entries_.emplace_front (key, std::move (entry));
+	cache_.emplace (std::move (key), entries_.begin());
+	return entries_.front().second;
+}
+
+std::string Batch::process (const std::string& line)
+{
+	std::ostringstream out;
+
+	try {
+		std::vector<std::string> fields = split (line, ';');
+		VERIFY (fields.size() >= 2, std::runtime_error, "Expected a mode and an expression");
+
+		Job job;
+		job.variables = constants_;
+		job.expression = fields[1];
+
+		std::istringstream mode (fields[0]);
+		VERIFY (mode >> job.mode, std::runtime_error, "Expected a mode");
+
+		switch (job.mode) {
+		case 'S':
+			if (!(mode >> std::ws).eof()) {
+				mode >> job.variable;
+			}
+			break;
+
+		case 'D':
+		case 'T':
+			VERIFY (mode >> job.variable, std::runtime_error, "Expected a variable for mode '" << job.mode << "'");
+			/* the variable may have been read up to the end, and skipping whitespace past it would fail */
+			if (!mode.eof() && !(mode >> std::ws).eof()) {
+				mode >> job.order;
+			}
+			if ((job.mode == 'T') && mode && !mode.eof() && !(mode >> std::ws).eof()) {
+				mode >> job.point;
+			}
+			break;
+
+		case 'E':
+			break;
+
+		default:
+			ERROR (std::runtime_error, "Unknown mode: '" << job.mode << "'");
+		}
+
+		VERIFY (consumed_entirely (mode), std::runtime_error, "Wrong mode specifier: '" << fields[0] << "'");
+
+		for (size_t i = 2; i < fields.size(); ++i) {
+			std::istringstream ss (fields[i]);
+			char kind;
+
+			if (!(ss >> kind)) {
+				continue;
+			}
+
+			Variable::Map defined;
+
+			switch (kind) {
+			case 'v': parse_variable<data_t> (defined, ss); break;
+			case 'r': parse_variable<rational_t> (defined, ss); break;
+			case 'b': parse_variable<void> (defined, ss); break;
+			default: ERROR (std::runtime_error, "Unknown variable kind: '" << kind << "'");
+			}
+
+			/* unlike on the command line, a definition in the job overrides the one given earlier */
+			for (Variable::Map::value_type& var: defined) {
+				job.variables[var.first] = std::move (var.second);
+			}
+
+			VERIFY (consumed_entirely (ss), std::runtime_error, "Wrong variable specifier: '" << fields[i] << "'");
+		}
+
+		std::shared_ptr<const Entry> entry = lookup (job);
+
+		out << options_.name;
+
+		switch (job.mode) {
+		case 'S':
+			write_value (out, entry->evaluate (false, job.variables));
+			break;
+
+		case 'D':
+		case 'E':
+			write_value (out, entry->evaluate (false, job.variables));
+			write_value (out, entry->evaluate (true, job.variables));
+			break;
+
+		case 'T': {
+			Visitor::Print print (out, false);
+			out << " ";
+			print.print (*entry->result);
+			break;
+		}
+		}
+	} catch (std::exception& e) {
+		/* a failed job is reported in its place, it does not stop the batch */
+		out.str ("");
+		out << "! " << e.what();
+	}
+
+	return out.str();
+}
+
+void Batch::run (std::istream& in, std::ostream& out)
+{
+	ThreadPool pool (options_.jobs);
+	std::deque<std::future<std::vector<std::string>>> pending;
+	std::vector<std::string> chunk;
+	std::string line;
+
+	auto write_front = [&out, &pending] {
+		for (const std::string& result: pending.front().get()) {
+			out << result << '\n';
+		}
+		pending.pop_front();
+	};
+
+	auto submit = [this, &pool, &pending, &chunk] {
+		std::shared_ptr<std::vector<std::string>> lines (new std::vector<std::string> (std::move (chunk)));
+		chunk.clear();
+
+		pending.push_back (pool.submit ([this, lines] {
+			std::vector<std::string> results;
+			results.reserve (lines->size());
+
+			for (const std::string& job: *lines) {
+				results.push_back (process (job));
+			}
+
+			return results;
+		}));
+	};
+
+	while (std::getline (in, line)) {
+		if (!line.empty() && (line[0] != '#')) {
+			chunk.push_back (std::move (line));
+		}
+
+		/* submit a partial chunk as well if no more input is at hand, so that interactive use does not stall */
+		bool input_waiting = in.rdbuf()->in_avail() > 0;
+
+		if ((chunk.size() >= chunk_size) || (!input_waiting && !chunk.empty())) {
+			submit();
+		}
+
+		while (pending.size() > chunks_per_worker * pool.size()) {
+			write_front();
+		}
+
+		if (!input_waiting) {
+			while (!pending.empty()) {
+				write_front();
+			}
+			out << std::flush;
+		}
+	}
+
+	if (!chunk.empty()) {
+		submit();
+	}
+
+	while (!pending.empty()) {
+		write_front();
+	}
+
+	out << std::flush;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <util/util.h>
+#include <util/variable.h>
+
+#include <list>
+#include <mutex>
+
+/*
+ * Batch mode: processes a stream of jobs, one per line, on a pool of worker threads,
+ * writing one line of machine-readable results per job in the order of the input.
+ *
+ * A job is a list of fields separated by ';':
+ *
+ *     MODE ; EXPRESSION [; VARIABLE]...
+ *
+ * where MODE is one of
+ *
+ *     S [VARIABLE]          simplify (for the variable, if given) and compute
+ *     D VARIABLE [ORDER]    differentiate and compute the derivative
+ *     E                     compute the error
+ *     T VARIABLE [LENGTH [POINT]]
+ *                           build the Taylor series (only at the point 0, as on the command line)
+ *
+ * and each VARIABLE is defined as on the command line, prefixed with the kind of its value:
+ * `v NAME VALUE ERROR` (floating-point), `r NAME VALUE ERROR` (rational) or `b NAME` (bare).
+ * Empty lines and lines starting with '#' are skipped.
+ *
+ * The symbolic results (simplified expressions, derivatives, error expressions) are cached by the
+ * expression and the mode, together with programs compiled from them (see program.h), so repeated
+ * expressions are only evaluated for the new values. The least recently used entries are evicted.
+ */
+
+class Batch
+{
+public:
+	struct Options
+	{
+		unsigned jobs = 1;
+		size_t cache_size = 1024;
+		std::string name = "F";
+	};
+
+	Batch (const Variable::Map& constants, Options options);
+	~Batch();
+
+	/* reads jobs until the end of input */
+	void run (std::istream& in, std::ostream& out);
+
+	/* processes a single job and returns its result line (without the newline); may be called concurrently */
+	std::string process (const std::string& line);
+
+private:
+	struct Job;
+	struct Entry;
+
+	const Variable::Map& constants_;
+	Options options_;
+
+	/* the cached entries, the most recently used first, and an index of them by their keys */
+	typedef std::list<std::pair<std::string, std::shared_ptr<const Entry>>> Entries;
+
+	std::mutex cache_mutex_;
+	Entries entries_;
+	std::unordered_map<std::string, Entries::iterator> cache_;
+
+	std::shared_ptr<const Entry> lookup (const Job& job);
+	std::shared_ptr<const Entry> build (const Job& job) const;
+};
@@ -0,0 +1,433 @@
+#include "util-tree.h"
+#include "derivative-tower.h"
+#include "parser.h"
+#include "visitor-print.h"
+#include "visitor-latex.h"
+#include "visitor-calculate.h"
+#include "stats.h"
+
+#include <chrono>
+
+#include <getopt.h>
+
+/*
+ * Benchmarks the phases of the expression library over a fixed corpus of expressions.
+ *
+ * Every phase is run several times and the best sample is reported, one line per phase:
+ *     EXPRESSION PHASE TIME_US ALLOCATIONS ALLOCATED_BYTES PEAK_NODES NODES_IN NODES_OUT
+ * (tab-separated; lines starting with '#' are comments). The same output, saved from an earlier run,
+ * may be given as a baseline; then the changes are reported to stderr, and the exit code is non-zero
+ * if any phase got slower or allocates more than the tolerance allows.
+ *
+ * The allocations are counted by the statistics engine; they are reported as zero if it has not been built.
+ */
+
+namespace {
+
+enum {
+	ARG_DERIVATIVE_ORDER = 'o',
+	ARG_SERIES_LENGTH    = 's',
+	ARG_REPEAT           = 'r',
+	ARG_FILTER           = 'e',
+	ARG_BASELINE         = 'b',
+	ARG_TOLERANCE        = 't',
+};
+
+const option option_array[] = {
+	{ "deriv-order",   required_argument, nullptr, ARG_DERIVATIVE_ORDER },
+	{ "series-length", required_argument, nullptr, ARG_SERIES_LENGTH },
+	{ "repeat",        required_argument, nullptr, ARG_REPEAT },
+	{ "expression",    required_argument, nullptr, ARG_FILTER },
+	{ "baseline",      required_argument, nullptr, ARG_BASELINE },
+	{ "tolerance",     required_argument, nullptr, ARG_TOLERANCE },
+	{ }
+};
+
+void usage (const char* name)
+{
+	std::cerr << "Usage: " << name << " [-o|--deriv-order ORDER] [-s|--series-length LENGTH] [-r|--repeat COUNT]" << std::endl
+	          << "       [-e|--expression NAME ...] [-b|--baseline FILE] [-t|--tolerance PERCENT]" << std::endl;
+	exit (EXIT_FAILURE);
+}
+
+/* changes smaller than this are never reported as regressions (the timer noise on short phases is larger) */
+const double time_noise_us = 50;
+
+struct CorpusEntry
+{
+	std::string name;
+	std::string text;
+	std::string variable;
+};
+
+std::vector<CorpusEntry> corpus()
+{
+	std::vector<CorpusEntry> result {
+		{ "rational",     "1 / (1 + x + x^2)",                               "x" },
+		{ "power-log",    "(1 + x^2)^(3/2) * ln(1 + x) - x / (1 + x)^(1/2)", "x" },
+		{ "polynomial",   "(x + 2y + 1)^5 - (x - y)^4 * (3x + y)",           "x" },
+		{ "log",          "ln(x^2 + 1) / x - x * ln(x)",                     "x" },
+		{ "error",        "x^2 * y / (x + y) - y / (1 + x * y)",              "y" },
+	};
+
+	/* a long sum, as produced by high-order differentiation */
+	std::ostringstream long_sum;
+	for (unsigned i = 1; i <= 200; ++i) {
+		long_sum << ((i > 1) ? " + " : "") << i << " x^" << i << " - ln(" << i << " x)";
+	}
+	result.push_back ({ "long-sum", long_sum.str(), "x" });
+
+	/* a sum whose derivatives have distinct denominators, to be brought to a common one */
+	std::ostringstream fractions;
+	for (unsigned i = 1; i <= 10; ++i) {
+		fractions << ((i > 1) ? " + " : "") << "ln(x + " << i << ")";
+	}
+	result.push_back ({ "fractions", fractions.str(), "x" });
+
+	return result;
+}
+
+struct Sample
+{
+	double time_us;
+	size_t allocations, allocated_bytes, peak_nodes;
+
+	void merge (const Sample& rhs)
+	{
+		time_us = std::min (time_us, rhs.time_us);
+		allocations = std::min (allocations, rhs.allocations);
+		allocated_bytes = std::min (allocated_bytes, rhs.allocated_bytes);
+		peak_nodes = std::min (peak_nodes, rhs.peak_nodes);
+	}
+};
+
+/* takes the counters at construction and reports their change since then */
+class Probe
+{
+	std::chrono::steady_clock::time_point start_;
+	size_t allocations_, allocated_bytes_, live_nodes_;
+
+public:
+	Probe()
+	{
+		Node::Base::reset_peak_count();
+		live_nodes_ = Node::Base::live_count();
+		allocations_ = Stats::allocation_count();
+		allocated_bytes_ = Stats::allocation_bytes();
+		start_ = std::chrono::steady_clock::now();
+	}
+
+	Sample finish() const
+	{
+		Sample result;
+		result.time_us = std::chrono::duration<double, std::micro> (std::chrono::steady_clock::now() - start_).count();
+		result.allocations = Stats::allocation_count() - allocations_;
+		result.allocated_bytes = Stats::allocation_bytes() - allocated_bytes_;
+		result.peak_nodes = Node::Base::peak_count() - live_nodes_;
+		return result;
+	}
+};
+
+struct Measurement
+{
+	std::string expression, phase;
+	Sample sample;
+	size_t nodes_in, nodes_out;
+};
+
+typedef std::map<std::pair<std::string, std::string>, Measurement> MeasurementMap;
+
+class Bench
+{
+	unsigned repeat_;
+	std::vector<Measurement> results_;
+
+	void report (const std::string& expression, const std::string& phase, const Sample& sample, size_t nodes_in, size_t nodes_out)
+	{
+		Measurement m { expression, phase, sample, nodes_in, nodes_out };
+
+		std::cout << m.expression << "\t" << m.phase << "\t" << std::fixed << std::setprecision (1) << m.sample.time_us << "\t"
+		          << m.sample.allocations << "\t" << m.sample.allocated_bytes << "\t" << m.sample.peak_nodes << "\t"
+		          << m.nodes_in << "\t" << m.nodes_out << std::endl;
+
+		results_.push_back (std::move (m));
+	}
+
+public:
+	explicit Bench (unsigned repeat) : repeat_ (repeat) { }
+
+	const std::vector<Measurement>& results() const { return results_; }
+
+	/*
+	 * Runs the phase repeat_ times, reporting the best sample. The phase returns its result,
+	 * which is destroyed outside of the measurement (a null pointer if the result is not a tree).
+	 */
+	template <typename Phase>
+	Node::Base::Ptr measure (const std::string& expression, const std::string& phase, size_t nodes_in, Phase&& run)
+	{
+		Node::Base::Ptr result;
+		Sample best = Sample();
+
+		for (unsigned i = 0; i < repeat_; ++i) {
+			Probe probe;
+			Node::Base::Ptr next = run();
+			Sample sample = probe.finish();
+
+			if (i == 0) {
+				best = sample;
+			} else {
+				best.merge (sample);
+			}
+
+			result = std::move (next);
+		}
+
+		report (expression, phase, best, nodes_in, result ? count_nodes (*result) : 0);
+		return result;
+	}
+
+	/* the orders are built incrementally, so every repetition starts a new tower and each order is measured separately */
+	Node::Base::Ptr measure_tower (const std::string& expression, const Node::Base& function, const std::string& variable, unsigned order)
+	{
+		std::vector<Sample> best (order + 1);
+		std::vector<size_t> nodes (order + 1);
+		Node::Base::Ptr result;
+
+		nodes[0] = count_nodes (function);
+
+		for (unsigned i = 0; i < repeat_; ++i) {
+			DerivativeTower tower (function, variable);
+
+			for (unsigned k = 1; k <= order; ++k) {
+				Probe probe;
+				const Node::Base::Ptr& derivative = tower.get (k);
+				Sample sample = probe.finish();
+
+				if (i == 0) {
+					best[k] = sample;
+				} else {
+					best[k].merge (sample);
+				}
+
+				nodes[k] = count_nodes (*derivative);
+			}
+
+			result = tower.get (order)->clone();
+		}
+
+		for (unsigned k = 1; k <= order; ++k) {
+			report (expression, BUILD_STRING ("differentiate/" << k), best[k], nodes[k - 1], nodes[k]);
+		}
+
+		return result;
+	}
+};
+
+void run_entry (Bench& bench, const CorpusEntry& entry, unsigned order, unsigned series_length)
+{
+	const std::string& name = entry.name;
+
+	Node::Base::Ptr raw = bench.measure (name, "parse", 0, [&] {
+		return Parser (entry.text, variables).parse();
+	});
+
+	Node::Base::Ptr simplified = bench.measure (name, "simplify", count_nodes (*raw), [&] {
+		return simplify_tree (raw.get());
+	});
+
+	Node::Base::Ptr derivative = simplified->clone();
+	if (order > 0) {
+		derivative = bench.measure_tower (name, *simplified, entry.variable, order);
+	}
+
+	Visitor::Calculate calculate;
+
+	bench.measure (name, "calculate", count_nodes (*simplified), [&] {
+		simplified->accept (calculate);
+		return Node::Base::Ptr();
+	});
+
+	bench.measure (name, BUILD_STRING ("calculate/" << order), count_nodes (*derivative), [&] {
+		derivative->accept (calculate);
+		return Node::Base::Ptr();
+	});
+
+	bench.measure (name, "taylor", count_nodes (*simplified), [&] {
+		taylor_coefficients (simplified.get(), entry.variable, series_length);
+		return Node::Base::Ptr();
+	});
+
+	bench.measure (name, BUILD_STRING ("print/" << order), count_nodes (*derivative), [&] {
+		std::ostringstream out;
+		Visitor::Print (out, false).print (*derivative);
+		return Node::Base::Ptr();
+	});
+
+	bench.measure (name, BUILD_STRING ("latex/" << order), count_nodes (*derivative), [&] {
+		std::ostringstream out;
+		Visitor::LaTeX (out, false).print (*derivative);
+		return Node::Base::Ptr();
+	});
+}
+
+MeasurementMap read_baseline (const char* file)
+{
+	std::ifstream input;
+	open (input, file);
+	input.exceptions (std::ifstream::badbit);
+
+	MeasurementMap result;
+	std::string line;
+
+	while (std::getline (input, line)) {
+		if (line.empty() || (line[0] == '#')) {
+			continue;
+		}
+
+		std::istringstream ss (line);
+		Measurement m;
+
+		std::getline (ss, m.expression, '\t');
+		std::getline (ss, m.phase, '\t');
+		ss >> m.sample.time_us >> m.sample.allocations >> m.sample.allocated_bytes >> m.sample.peak_nodes >> m.nodes_in >> m.nodes_out;
+
+		VERIFY (consumed_entirely (ss), std::runtime_error, "Malformed baseline line: '" << line << "'");
+
+		result.emplace (std::make_pair (m.expression, m.phase), std::move (m));
+	}
+
+	return result;
+}
+
+/* prints the changes against the baseline, returns the count of regressions */
+unsigned compare (const std::vector<Measurement>& results, const MeasurementMap& baseline, double tolerance)
+{
+	unsigned regressions = 0;
+
+	auto change = [] (double base, double current) {
+		return (base > 0) ? BUILD_STRING (std::showpos << std::fixed << std::setprecision (1) << (current / base - 1) * 100 << "%")
+		                  : std::string ("n/a");
+	};
+
+	std::cerr << "Comparison with the baseline (time, allocations):" << std::endl;
+
+	for (const Measurement& m: results) {
+		auto it = baseline.find (std::make_pair (m.expression, m.phase));
+		if (it == baseline.end()) {
+			std::cerr << m.expression << " " << m.phase << ": not in the baseline" << std::endl;
+			continue;
+		}
+
+		const Sample &base = it->second.sample,
+		             &current = m.sample;
+
+		bool slower = (current.time_us > base.time_us * (1 + tolerance)) && (current.time_us - base.time_us > time_noise_us),
+		     larger = (current.allocations > base.allocations * (1 + tolerance));
+
+		std::cerr << m.expression << " " << m.phase << ": "
+		          << change (base.time_us, current.time_us) << ", "
+		          << change (base.allocations, current.allocations)
+		          << ((slower || larger) ? "  REGRESSION" : "") << std::endl;
+
+		if (slower || larger) {
+			++regressions;
+		}
+	}
+
+	return regressions;
+}
+
+} // anonymous namespace
+
+int main (int argc, char** argv)
+{
+	unsigned order = 4,
+	         series_length = 10,
+	         repeat = 3;
+	double tolerance = 10;
+	std::set<std::string> filter;
+	std::string baseline_file;
+
+	int option;
+	while ((option = getopt_long (argc, argv, "o:s:r:e:b:t:", option_array, nullptr)) != -1) {
+		std::istringstream ss (optarg ? optarg : "");
+
+		switch (option) {
+		case ARG_DERIVATIVE_ORDER:
+			ss >> order;
+			break;
+
+		case ARG_SERIES_LENGTH:
+			ss >> series_length;
+			break;
+
+		case ARG_REPEAT:
+			ss >> repeat;
+			break;
+
+		case ARG_TOLERANCE:
+			ss >> tolerance;
+			break;
+
+		case ARG_FILTER:
+			filter.insert (optarg);
+			continue;
+
+		case ARG_BASELINE:
+			baseline_file = optarg;
+			continue;
+
+		default:
+			usage (argv[0]);
+		}
+
+		if (!consumed_entirely (ss)) {
+			ERROR (std::runtime_error, "Could not parse the argument: '" << optarg << "'");
+		}
+	}
+
+	if ((optind < argc) || (repeat == 0)) {
+		usage (argv[0]);
+	}
+
+	Stats::enable();
+
+	/* the values are needed for numeric phases; the variables stay symbolic while simplifying */
+	insert_constants();
+	variables.insert (Variable::make<rational_t> ("x", rational_t (1, 2), rational_t (0), true));
+	variables.insert (Variable::make<rational_t> ("y", rational_t (3, 4), rational_t (0), true));
+
+	MeasurementMap baseline;
+	if (!baseline_file.empty()) {
+		baseline = read_baseline (baseline_file.c_str());
+	}
+
+	Bench bench (repeat);
+
+	std::cout << "# order " << order << ", series length " << series_length << ", best of " << repeat << std::endl
+	          << "# expression\tphase\ttime_us\tallocations\tallocated_bytes\tpeak_nodes\tnodes_in\tnodes_out" << std::endl;
+
+	for (const CorpusEntry& entry: corpus()) {
+		if (!filter.empty() && !filter.count (entry.name)) {
+			continue;
+		}
+
+		/* a failing expression does not stop the suite (it will show up in the comparison as missing) */
+		try {
+			run_entry (bench, entry, order, series_length);
+		} catch (std::exception& e) {
+			std::cerr << "Benchmark of '" << entry.name << "' failed: " << e.what() << std::endl;
+		}
+	}
+
+	if (!baseline.empty()) {
+		unsigned regressions = compare (bench.results(), baseline, tolerance / 100);
+
+		if (regressions) {
+			std::cerr << regressions << " regression(s) over " << tolerance << "%" << std::endl;
+			return 1;
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,102 @@
+#include "budget.h"
+
+#include <chrono>
+
+#include <unistd.h>
+
+namespace {
+
+/* how often (in nodes) the clock and the memory usage are looked at */
+const unsigned check_period = 1024;
+
+int64_t now_ms()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds> (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* returns the resident set size in megabytes, or 0 if it cannot be determined */
+size_t resident_memory_mb()
+{
+	std::ifstream statm ("/proc/self/statm");
+	size_t total_pages, resident_pages;
+
+	if (!(statm >> total_pages >> resident_pages)) {
+		return 0;
+	}
+
+	return resident_pages * sysconf (_SC_PAGESIZE) / (1024 * 1024);
+}
+
+} // anonymous namespace
+
+Budget::Limits Budget::limits;
+
+struct Budget::Operation
+{
+	int64_t deadline_ms;
+	std::atomic<int64_t> nodes { 0 };
+
+	Operation()
+	: deadline_ms (limits.time_s ? now_ms() + int64_t (limits.time_s) * 1000 : 0)
+	{
+	}
+};
+
+thread_local Budget::Handle Budget::current_;
+
+Budget::Scope::Scope()
+: previous_ (current_)
+{
+	if (!current_) {
+		current_ = std::make_shared<Operation>();
+	}
+}
+
+Budget::Scope::Scope (const Handle& operation)
+: previous_ (current_)
+{
+	current_ = operation;
+}
+
+Budget::Scope::~Scope()
+{
+	current_ = std::move (previous_);
+}
+
+void Budget::account_nodes (int64_t delta)
+{
+	if (Operation* operation = current_.get()) {
+		operation->nodes.fetch_add (delta, std::memory_order_relaxed);
+	}
+}
+
+void Budget::check_slow (const char* pass)
+{
+	static thread_local unsigned counter = 0;
+
+	Operation* operation = current_.get();
+
+	if (limits.nodes && operation) {
+		int64_t nodes = operation->nodes.load (std::memory_order_relaxed);
+		if (nodes > int64_t (limits.nodes)) {
+			throw BudgetExceeded (pass, BUILD_STRING ("the operation holds " << nodes << " nodes, the limit is " << limits.nodes));
+		}
+	}
+
+	if (++counter % check_period) {
+		return;
+	}
+
+	if (limits.time_s && operation) {
+		if (operation->deadline_ms && (now_ms() > operation->deadline_ms)) {
+			throw BudgetExceeded (pass, BUILD_STRING ("the operation runs longer than " << limits.time_s << " s"));
+		}
+	}
+
+	if (limits.memory_mb) {
+		size_t memory = resident_memory_mb();
+		if (memory > limits.memory_mb) {
+			throw BudgetExceeded (pass, BUILD_STRING (memory << " MiB are in use, the limit is " << limits.memory_mb << " MiB"));
+		}
+	}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <util/util.h>
+
+#include <atomic>
+#include <memory>
+
+/*
+ * Resource budgets for the symbolic passes (simplification and differentiation).
+ *
+ * The passes call Budget::check() for every node they visit. Once the count of nodes held by the current
+ * top-level operation, the resident memory or the wall time spent in the operation exceeds its limit,
+ * BudgetExceeded is thrown, naming the pass which blew up; callers may then resort to numeric methods.
+ *
+ * The node count and the time are accounted per operation, so that concurrent operations (such as the jobs
+ * of the batch mode) do not share them; the resident memory is that of the whole process.
+ *
+ * A zero limit means "unlimited". All limits are unlimited by default.
+ */
+
+class BudgetExceeded : public std::runtime_error
+{
+	std::string pass_;
+
+public:
+	BudgetExceeded (const std::string& pass, const std::string& what)
+	: std::runtime_error ("Budget exceeded in " + pass + ": " + what)
+	, pass_ (pass)
+	{
+	}
+
+	const std::string& pass() const { return pass_; }
+};
+
+class Budget
+{
+public:
+	struct Limits
+	{
+		size_t nodes = 0;
+		size_t memory_mb = 0;
+		unsigned time_s = 0;
+	};
+
+	static Limits limits;
+
+	/*
+	 * Marks a top-level operation: the time limit is counted from the construction of the outermost scope
+	 * of the thread, and the node limit applies to the nodes created (and not yet destroyed) while it is current.
+	 * Nested scopes belong to the same operation. Tasks working for the operation on other threads join it
+	 * by constructing a scope from the handle of the submitting thread.
+	 */
+	struct Operation;
+	typedef std::shared_ptr<Operation> Handle;
+
+	class Scope
+	{
+		Handle previous_;
+
+	public:
+		Scope();
+		explicit Scope (const Handle& operation);
+		~Scope();
+
+		Scope (const Scope&) = delete;
+		Scope& operator= (const Scope&) = delete;
+	};
+
+	/* the operation of the calling thread, or null if there is none */
+	static Handle current() { return current_; }
+
+	/* account nodes to the operation of the calling thread (only if they are limited) */
+	static void node_created() { if (limits.nodes) account_nodes (1); }
+	static void node_destroyed() { if (limits.nodes) account_nodes (-1); }
+
+	/* throws BudgetExceeded if any of the limits is exceeded */
+	static void check (const char* pass)
+	{
+		/* nothing to do unless a limit is set */
+		if (limits.nodes || limits.memory_mb || limits.time_s) {
+			check_slow (pass);
+		}
+	}
+
+private:
+	static void check_slow (const char* pass);
+	static void account_nodes (int64_t delta);
+
+	static thread_local Handle current_;
+};
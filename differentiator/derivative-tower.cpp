@@ -0,0 +1,199 @@
+#include "derivative-tower.h"
+#include "visitor-simplify.h"
+#include "visitor-differentiate.h"
+#include "util-tree.h"
+
+#include <mutex>
+
+namespace {
+
+/* orders subtrees structurally without owning them, so that a cache can be queried without cloning */
+struct SubtreeKey
+{
+	const Node::Base* node;
+
+	bool operator< (const SubtreeKey& rhs) const { return node->less (*rhs.node); }
+};
+
+/*
+ * Holds results of a transformation applied to distinct subtrees. The sources are either owned copies or,
+ * if they outlive the cache (such as the orders of the tower), the subtrees themselves.
+ *
+ * Every entry repeats its subtrees, which nest into each other, so the entries could take much more memory
+ * than the tower itself. Instead, the cache is limited to a count of nodes, and once it is full further
+ * results are computed again when needed rather than stored.
+ *
+ * May be shared between threads (the simplifier splits large sums between tasks); entries are never removed,
+ * so the returned results stay valid.
+ */
+class SubtreeCache
+{
+	struct Entry
+	{
+		Node::Base::Ptr source, result;
+	};
+
+	mutable std::mutex mutex_;
+	std::map<SubtreeKey, Entry> entries_;
+	bool copy_sources_;
+	size_t nodes_ = 0, capacity_ = 0;
+
+public:
+	explicit SubtreeCache (bool copy_sources)
+	: copy_sources_ (copy_sources)
+	{
+	}
+
+	void set_capacity (size_t nodes)
+	{
+		std::lock_guard<std::mutex> lock (mutex_);
+		capacity_ = nodes;
+	}
+
+	const Node::Base* find (const Node::Base& node) const
+	{
+		std::lock_guard<std::mutex> lock (mutex_);
+		auto it = entries_.find (SubtreeKey { &node });
+		return (it != entries_.end()) ? it->second.result.get() : nullptr;
+	}
+
+	void insert (const Node::Base& node, const Node::Base& result)
+	{
+		size_t available;
+
+		{
+			std::lock_guard<std::mutex> lock (mutex_);
+			if (nodes_ >= capacity_) {
+				return;
+			}
+			available = capacity_ - nodes_;
+		}
+
+		size_t nodes = count_nodes (result, available + 1);
+		if (copy_sources_ && (nodes <= available)) {
+			nodes += count_nodes (node, available - nodes + 1);
+		}
+		if (nodes > available) {
+			return;
+		}
+
+		Entry entry { copy_sources_ ? node.clone() : nullptr, result.clone() };
+		SubtreeKey key { copy_sources_ ? entry.source.get() : &node };
+
+		std::lock_guard<std::mutex> lock (mutex_);
+		if ((nodes_ + nodes <= capacity_) && entries_.emplace (key, std::move (entry)).second) {
+			nodes_ += nodes;
+		}
+	}
+
+	size_t size() const
+	{
+		std::lock_guard<std::mutex> lock (mutex_);
+		return entries_.size();
+	}
+};
+
+template <typename Compute>
+boost::any cached_visit (SubtreeCache& cache, const Node::Base& node, Compute compute)
+{
+	if (const Node::Base* result = cache.find (node)) {
+		return static_cast<Node::Base*> (result->clone().release());
+	}
+
+	Node::Base::Ptr result (boost::any_cast<Node::Base*> (compute()));
+	cache.insert (node, *result);
+	return static_cast<Node::Base*> (result.release());
+}
+
+/* leaf nodes are not memoized: looking them up costs more than recomputing */
+
+class CachingDifferentiate : public Visitor::Differentiate
+{
+	SubtreeCache& cache_;
+
+public:
+	CachingDifferentiate (const std::string& variable, SubtreeCache& cache)
+	: Differentiate (variable)
+	, cache_ (cache)
+	{
+	}
+
+	using Differentiate::visit;
+
+	virtual boost::any visit (const Node::Function& node)               { return cached_visit (cache_, node, [&] { return Differentiate::visit (node); }); }
+	virtual boost::any visit (const Node::Power& node)                  { return cached_visit (cache_, node, [&] { return Differentiate::visit (node); }); }
+	virtual boost::any visit (const Node::AdditionSubtraction& node)    { return cached_visit (cache_, node, [&] { return Differentiate::visit (node); }); }
+	virtual boost::any visit (const Node::MultiplicationDivision& node) { return cached_visit (cache_, node, [&] { return Differentiate::visit (node); }); }
+};
+
+class CachingSimplify : public Visitor::Simplify
+{
+	SubtreeCache& cache_;
+
+public:
+	CachingSimplify (SubtreeCache& cache)
+	: cache_ (cache)
+	{
+	}
+
+	using Simplify::visit;
+
+	/* the forks share the cache */
+	virtual std::unique_ptr<Simplify> fork() const { return std::unique_ptr<Simplify> (new CachingSimplify (*this)); }
+
+	virtual boost::any visit (const Node::Function& node)               { return cached_visit (cache_, node, [&] { return Simplify::visit (node); }); }
+	virtual boost::any visit (const Node::Power& node)                  { return cached_visit (cache_, node, [&] { return Simplify::visit (node); }); }
+	virtual boost::any visit (const Node::AdditionSubtraction& node)    { return cached_visit (cache_, node, [&] { return Simplify::visit (node); }); }
+	virtual boost::any visit (const Node::MultiplicationDivision& node) { return cached_visit (cache_, node, [&] { return Simplify::visit (node); }); }
+};
+
+} // anonymous namespace
+
+struct DerivativeTower::Cache
+{
+	SubtreeCache differentiated, simplified;
+	CachingDifferentiate differentiator;
+	CachingSimplify simplifier;
+
+	/* the differentiator only visits the orders of the tower, while the simplifier visits temporary trees */
+	Cache (const std::string& variable)
+	: differentiated (false)
+	, simplified (true)
+	, differentiator (variable, differentiated)
+	, simplifier (simplified)
+	{
+	}
+};
+
+DerivativeTower::DerivativeTower (const Node::Base& function, const std::string& variable)
+: cache_ (new Cache (variable))
+{
+	orders_.push_back (function.clone());
+	add_order_nodes (*orders_.back());
+}
+
+DerivativeTower::~DerivativeTower() = default;
+
+const Node::Base::Ptr& DerivativeTower::get (unsigned order)
+{
+	while (orders_.size() <= order) {
+		Node::Base::Ptr next = orders_.back()->accept_ptr (cache_->differentiator)
+		                                     ->accept_ptr (cache_->simplifier);
+		orders_.push_back (std::move (next));
+		add_order_nodes (*orders_.back());
+	}
+
+	return orders_[order];
+}
+
+void DerivativeTower::add_order_nodes (const Node::Base& order)
+{
+	nodes_ += count_nodes (order);
+	cache_->differentiated.set_capacity (cache_capacity_factor * nodes_);
+	cache_->simplified.set_capacity (cache_capacity_factor * nodes_);
+}
+
+size_t DerivativeTower::shared_subtrees() const
+{
+	return cache_->differentiated.size() + cache_->simplified.size();
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "node.h"
+
+/*
+ * Computes the tower of derivatives f, f', f'', ... of an expression for a single variable.
+ *
+ * All orders are built by one differentiator and one simplifier which memoize their results
+ * per subtree. Each new order is built from the previous one, and only the structure that has
+ * not been seen in any of the earlier orders is actually differentiated and simplified;
+ * subterms shared between the orders are stored (and processed) once.
+ *
+ * The memoized results are copies, so each of the two caches is limited to cache_capacity_factor times
+ * the count of nodes in the orders built so far; past that, the remaining subtrees are processed anew.
+ */
+
+class DerivativeTower
+{
+	struct Cache;
+
+	std::unique_ptr<Cache> cache_;
+	std::vector<Node::Base::Ptr> orders_;
+	size_t nodes_ = 0;
+
+	void add_order_nodes (const Node::Base& order);
+
+public:
+	static const size_t cache_capacity_factor = 2;
+
+	DerivativeTower (const Node::Base& function, const std::string& variable);
+	~DerivativeTower();
+
+	/* returns the derivative of given order (0 is the function itself), computing all missing orders */
+	const Node::Base::Ptr& get (unsigned order);
+
+	/* returns the highest order computed so far */
+	unsigned order() const { return orders_.size() - 1; }
+
+	/* returns the count of distinct subtrees memoized by the differentiator and the simplifier */
+	size_t shared_subtrees() const;
+};
@@ -0,0 +1,1166 @@
+#include "egraph.h"
+#include "visitor.h"
+
+#include <chrono>
+#include <limits>
+
+namespace {
+
+typedef uint32_t ClassId;
+
+/* larger constant powers are kept symbolic, so that folding cannot blow up */
+const int max_folded_exponent = 64;
+
+/*
+ * Additions and multiplications are n-ary with their children kept sorted,
+ * so commutativity and associativity need no rewrite rules of their own.
+ * Subtraction is represented as multiplication by -1 and division as raising to the power of -1.
+ */
+
+enum class Op : uint8_t
+{
+	Constant,
+	Leaf,
+	Function,
+	Add,
+	Mul,
+	Pow
+};
+
+struct ENode
+{
+	Op op;
+	uint32_t payload; /* index of the constant, leaf or function name */
+	std::vector<ClassId> children;
+
+	bool operator== (const ENode& rhs) const
+	{
+		return (op == rhs.op) && (payload == rhs.payload) && (children == rhs.children);
+	}
+
+	bool operator< (const ENode& rhs) const
+	{
+		return (op < rhs.op) ||
+		       ((op == rhs.op) && ((payload < rhs.payload) ||
+		                           ((payload == rhs.payload) && (children < rhs.children))));
+	}
+};
+
+struct ENodeHash
+{
+	size_t operator() (const ENode& node) const
+	{
+		size_t hash = (static_cast<size_t> (node.op) << 24) ^ node.payload;
+		for (ClassId child: node.children) {
+			hash = (hash * 1000003) ^ child;
+		}
+		return hash;
+	}
+};
+
+struct EClass
+{
+	std::vector<ENode> nodes;
+	bool has_constant = false;
+	rational_t constant;
+};
+
+class Graph
+{
+	std::vector<ClassId> parents_;
+	std::vector<EClass> classes_;
+	std::unordered_map<ENode, ClassId, ENodeHash> memo_;
+
+	std::vector<rational_t> constants_;
+	std::map<rational_t, uint32_t> constant_ids_;
+	std::vector<Node::Base::Ptr> leaves_;
+	std::map<std::pair<std::string, bool>, uint32_t> leaf_ids_;
+	std::vector<std::string> functions_;
+	std::map<std::string, uint32_t> function_ids_;
+
+	size_t node_count_ = 0;
+	bool dirty_ = false;
+
+	void canonicalize (ENode& node);
+	bool fold (const ENode& node, rational_t& value);
+
+	bool is_cyclic (ClassId id, const ENode& node);
+	bool find_node (ClassId id, Op op, ENode& result);
+	bool constant_of (ClassId id, rational_t& value);
+	bool is_integer (ClassId id);
+	bool known_positive (ClassId id, unsigned depth = 4);
+	bool all_but_one_positive (const std::vector<ClassId>& children);
+	void split_coefficient (ClassId id, ClassId& term, rational_t& coefficient);
+	void split_exponent (ClassId id, ClassId& base, ClassId& exponent);
+	std::vector<ClassId> factors_of (ClassId id);
+
+	void rules_add (ClassId id, const ENode& node);
+	void rules_mul (ClassId id, const ENode& node);
+	void rules_pow (ClassId id, const ENode& node);
+	void rules_function (ClassId id, const ENode& node);
+	void expand_mul (ClassId id, const ENode& node);
+	void expand_pow (ClassId id, const ENode& node);
+	void expand_function (ClassId id, const ENode& node);
+
+	std::vector<std::pair<ClassId, ENode>> snapshot();
+
+	double node_cost (const ENode& node, const std::vector<double>& costs, EGraphSimplifier::CostModel model);
+	Node::Base::Ptr build (ClassId id, const std::vector<ENode>& best);
+	Node::Base::Ptr build_product (const ENode& node, const std::vector<ENode>& best, bool negate);
+
+public:
+	ClassId find (ClassId id);
+	ClassId add (ENode node);
+	bool merge (ClassId a, ClassId b);
+	void rebuild();
+
+	ClassId add_constant (const rational_t& value);
+	ClassId add_leaf (const Node::Variable& node);
+	ClassId add_function (const std::string& name, std::vector<ClassId> arguments);
+	ClassId make_add (std::vector<ClassId> children);
+	ClassId make_mul (std::vector<ClassId> children);
+	ClassId make_pow (ClassId base, ClassId exponent);
+
+	size_t node_count() const { return node_count_; }
+
+	void saturate (const EGraphSimplifier::Options& options);
+	Node::Base::Ptr extract (ClassId root, EGraphSimplifier::CostModel model);
+};
+
+/*
+ * Loads a tree into the e-graph.
+ */
+
+class Loader : public Visitor::Base
+{
+	Graph& graph_;
+
+	ClassId accept_class (const Node::Base& node) { return boost::any_cast<ClassId> (node.accept (*this)); }
+
+public:
+	Loader (Graph& graph) : graph_ (graph) { }
+
+	ClassId load (const Node::Base& node) { return accept_class (node); }
+
+	virtual boost::any visit (const Node::Value& node)
+	{
+		return graph_.add_constant (node.value());
+	}
+
+	virtual boost::any visit (const Node::Variable& node)
+	{
+		return graph_.add_leaf (node);
+	}
+
+	virtual boost::any visit (const Node::Function& node)
+	{
+		std::vector<ClassId> arguments;
+		for (const auto& child: node.children()) {
+			arguments.push_back (accept_class (*child.node));
+		}
+		return graph_.add_function (node.name(), std::move (arguments));
+	}
+
+	virtual boost::any visit (const Node::Power& node)
+	{
+		ClassId base = accept_class (*node.get_base()),
+		        exponent = accept_class (*node.get_exponent());
+		return graph_.make_pow (base, exponent);
+	}
+
+	virtual boost::any visit (const Node::AdditionSubtraction& node)
+	{
+		std::vector<ClassId> children;
+		for (const auto& child: node.children()) {
+			ClassId term = accept_class (*child.node);
+			children.push_back (child.tag.negated ? graph_.make_mul ({ graph_.add_constant (-1), term }) : term);
+		}
+		return graph_.make_add (std::move (children));
+	}
+
+	virtual boost::any visit (const Node::MultiplicationDivision& node)
+	{
+		std::vector<ClassId> children;
+		for (const auto& child: node.children()) {
+			ClassId factor = accept_class (*child.node);
+			children.push_back (child.tag.reciprocated ? graph_.make_pow (factor, graph_.add_constant (-1)) : factor);
+		}
+		return graph_.make_mul (std::move (children));
+	}
+};
+
+/*
+ * Core operations
+ */
+
+ClassId Graph::find (ClassId id)
+{
+	while (parents_[id] != id) {
+		parents_[id] = parents_[parents_[id]];
+		id = parents_[id];
+	}
+	return id;
+}
+
+void Graph::canonicalize (ENode& node)
+{
+	for (ClassId& child: node.children) {
+		child = find (child);
+	}
+
+	if ((node.op == Op::Add) || (node.op == Op::Mul)) {
+		std::sort (node.children.begin(), node.children.end());
+	}
+}
+
+bool Graph::fold (const ENode& node, rational_t& value)
+{
+	rational_t child_value;
+
+	switch (node.op) {
+	case Op::Add:
+		value = 0;
+		for (ClassId child: node.children) {
+			if (!constant_of (child, child_value)) {
+				return false;
+			}
+			value += child_value;
+		}
+		return true;
+
+	case Op::Mul: {
+		bool all_constant = true;
+		value = 1;
+		for (ClassId child: node.children) {
+			if (!constant_of (child, child_value)) {
+				all_constant = false;
+			} else if (child_value == 0) {
+				value = 0;
+				return true;
+			} else {
+				value *= child_value;
+			}
+		}
+		return all_constant;
+	}
+
+	case Op::Pow: {
+		rational_t base, exponent;
+		if (constant_of (node.children[0], base) &&
+		    constant_of (node.children[1], exponent) &&
+		    (boost::multiprecision::abs (exponent.numerator()) <= max_folded_exponent)) {
+			return pow_frac_exact (base, exponent, value);
+		}
+		return false;
+	}
+
+	default:
+		return false;
+	}
+}
+
+ClassId Graph::add (ENode node)
+{
+	canonicalize (node);
+
+	auto it = memo_.find (node);
+	if (it != memo_.end()) {
+		return find (it->second);
+	}
+
+	ClassId id = classes_.size();
+	parents_.push_back (id);
+	classes_.emplace_back();
+
+	if (node.op == Op::Constant) {
+		classes_[id].has_constant = true;
+		classes_[id].constant = constants_[node.payload];
+	}
+
+	rational_t value;
+	bool folded = (node.op != Op::Constant) && fold (node, value);
+
+	memo_.emplace (node, id);
+	classes_[id].nodes.push_back (std::move (node));
+	++node_count_;
+
+	if (folded) {
+		merge (id, add_constant (value));
+		id = find (id);
+	}
+
+	return id;
+}
+
+bool Graph::merge (ClassId a, ClassId b)
+{
+	a = find (a);
+	b = find (b);
+
+	if (a == b) {
+		return false;
+	}
+
+	if (classes_[a].nodes.size() < classes_[b].nodes.size()) {
+		std::swap (a, b);
+	}
+
+	EClass& target = classes_[a];
+	EClass& source = classes_[b];
+
+	ASSERT (!(target.has_constant && source.has_constant) || (target.constant == source.constant),
+	        "E-graph merges classes with different constants: " << target.constant << " and " << source.constant);
+
+	if (source.has_constant && !target.has_constant) {
+		target.has_constant = true;
+		target.constant = source.constant;
+	}
+
+	std::move (source.nodes.begin(), source.nodes.end(), std::back_inserter (target.nodes));
+	source.nodes.clear();
+	source.nodes.shrink_to_fit();
+
+	parents_[b] = a;
+	dirty_ = true;
+	return true;
+}
+
+/*
+ * Restores the invariants after merges: every node refers to canonical classes,
+ * equal nodes live in the same class (congruence) and classes with a known value hold a constant node.
+ */
+
+void Graph::rebuild()
+{
+	for (;;) {
+		std::vector<std::pair<ClassId, ClassId>> unions;
+		std::vector<std::pair<ClassId, rational_t>> folds;
+
+		memo_.clear();
+		node_count_ = 0;
+
+		for (ClassId id = 0; id < classes_.size(); ++id) {
+			if (find (id) != id) {
+				continue;
+			}
+
+			std::vector<ENode>& nodes = classes_[id].nodes;
+
+			for (ENode& node: nodes) {
+				canonicalize (node);
+			}
+			std::sort (nodes.begin(), nodes.end());
+			nodes.erase (std::unique (nodes.begin(), nodes.end()), nodes.end());
+			node_count_ += nodes.size();
+
+			for (const ENode& node: nodes) {
+				auto r = memo_.emplace (node, id);
+				if (!r.second && (r.first->second != id)) {
+					unions.emplace_back (r.first->second, id);
+				}
+
+				rational_t value;
+				if (!classes_[id].has_constant && fold (node, value)) {
+					folds.emplace_back (id, value);
+				}
+			}
+		}
+
+		for (auto& u: unions) {
+			merge (u.first, u.second);
+		}
+
+		for (auto& f: folds) {
+			merge (f.first, add_constant (f.second));
+		}
+
+		if (unions.empty() && folds.empty()) {
+			break;
+		}
+	}
+
+	dirty_ = false;
+}
+
+ClassId Graph::add_constant (const rational_t& value)
+{
+	auto r = constant_ids_.emplace (value, constants_.size());
+	if (r.second) {
+		constants_.push_back (value);
+	}
+	return add (ENode { Op::Constant, r.first->second, { } });
+}
+
+ClassId Graph::add_leaf (const Node::Variable& node)
+{
+	auto r = leaf_ids_.emplace (std::make_pair (node.name(), node.is_error()), leaves_.size());
+	if (r.second) {
+		leaves_.push_back (node.clone());
+	}
+	return add (ENode { Op::Leaf, r.first->second, { } });
+}
+
+ClassId Graph::add_function (const std::string& name, std::vector<ClassId> arguments)
+{
+	auto r = function_ids_.emplace (name, functions_.size());
+	if (r.second) {
+		functions_.push_back (name);
+	}
+	return add (ENode { Op::Function, r.first->second, std::move (arguments) });
+}
+
+ClassId Graph::make_add (std::vector<ClassId> children)
+{
+	if (children.empty()) {
+		return add_constant (0);
+	} else if (children.size() == 1) {
+		return find (children.front());
+	}
+	return add (ENode { Op::Add, 0, std::move (children) });
+}
+
+ClassId Graph::make_mul (std::vector<ClassId> children)
+{
+	if (children.empty()) {
+		return add_constant (1);
+	} else if (children.size() == 1) {
+		return find (children.front());
+	}
+	return add (ENode { Op::Mul, 0, std::move (children) });
+}
+
+ClassId Graph::make_pow (ClassId base, ClassId exponent)
+{
+	return add (ENode { Op::Pow, 0, { base, exponent } });
+}
+
+/*
+ * Helpers for matching
+ */
+
+/*
+ * Nodes referring to their own class (such as "x * 1" in the class of "x") are never matched:
+ * rewriting them only produces more such nodes (x * 1 * 1, ...) and the e-graph would never saturate.
+ */
+
+bool Graph::is_cyclic (ClassId id, const ENode& node)
+{
+	return std::any_of (node.children.begin(), node.children.end(), [&] (ClassId c) { return find (c) == id; });
+}
+
+bool Graph::find_node (ClassId id, Op op, ENode& result)
+{
+	id = find (id);
+
+	for (const ENode& node: classes_[id].nodes) {
+		if ((node.op == op) && !is_cyclic (id, node)) {
+			result = node;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Graph::constant_of (ClassId id, rational_t& value)
+{
+	const EClass& cls = classes_[find (id)];
+	if (cls.has_constant) {
+		value = cls.constant;
+	}
+	return cls.has_constant;
+}
+
+bool Graph::is_integer (ClassId id)
+{
+	rational_t value;
+	return constant_of (id, value) && (value.denominator() == 1);
+}
+
+/*
+ * Whether the value of a class is positive whatever the values of the variables are:
+ * a positive constant, or a power or a product of such. The depth limits walking cycles of classes.
+ */
+
+bool Graph::known_positive (ClassId id, unsigned depth)
+{
+	rational_t value;
+	if (constant_of (id, value)) {
+		return value > 0;
+	}
+
+	if (!depth) {
+		return false;
+	}
+
+	id = find (id);
+
+	for (const ENode& node: classes_[id].nodes) {
+		if (is_cyclic (id, node)) {
+			continue;
+		}
+
+		if ((node.op == Op::Pow) && known_positive (node.children[0], depth - 1)) {
+			return true;
+		}
+
+		if ((node.op == Op::Mul) &&
+		    std::all_of (node.children.begin(), node.children.end(), [&] (ClassId c) { return known_positive (c, depth - 1); })) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* the identities splitting powers and logarithms of products hold if at most one factor may be non-positive */
+bool Graph::all_but_one_positive (const std::vector<ClassId>& children)
+{
+	return std::count_if (children.begin(), children.end(), [&] (ClassId c) { return !known_positive (c); }) <= 1;
+}
+
+/* k * x -> (x, k) */
+void Graph::split_coefficient (ClassId id, ClassId& term, rational_t& coefficient)
+{
+	ENode mul;
+
+	if (constant_of (id, coefficient)) {
+		term = add_constant (1);
+		return;
+	}
+
+	if (find_node (id, Op::Mul, mul)) {
+		for (auto it = mul.children.begin(); it != mul.children.end(); ++it) {
+			if (constant_of (*it, coefficient)) {
+				mul.children.erase (it);
+				term = make_mul (std::move (mul.children));
+				return;
+			}
+		}
+	}
+
+	term = find (id);
+	coefficient = 1;
+}
+
+/* x ^ e -> (x, e) */
+void Graph::split_exponent (ClassId id, ClassId& base, ClassId& exponent)
+{
+	ENode pow;
+
+	if (find_node (id, Op::Pow, pow)) {
+		base = pow.children[0];
+		exponent = pow.children[1];
+	} else {
+		base = find (id);
+		exponent = add_constant (1);
+	}
+}
+
+std::vector<ClassId> Graph::factors_of (ClassId id)
+{
+	ENode mul;
+	rational_t value;
+	std::vector<ClassId> result;
+
+	if (find_node (id, Op::Mul, mul)) {
+		for (ClassId child: mul.children) {
+			if (!constant_of (child, value)) {
+				result.push_back (find (child));
+			}
+		}
+	} else if (!constant_of (id, value)) {
+		result.push_back (find (id));
+	}
+
+	std::sort (result.begin(), result.end());
+	result.erase (std::unique (result.begin(), result.end()), result.end());
+	return result;
+}
+
+/*
+ * Rewrite rules.
+ * The rules_*() ones mostly shrink the expression and are always applied to the whole e-graph,
+ * the expand_*() ones grow it and are applied only while the e-graph is within limits.
+ */
+
+void Graph::rules_add (ClassId id, const ENode& node)
+{
+	const std::vector<ClassId>& children = node.children;
+
+	/* a + (b + c) -> a + b + c */
+	for (size_t i = 0; i < children.size(); ++i) {
+		ENode nested;
+		if (find_node (children[i], Op::Add, nested)) {
+			std::vector<ClassId> flattened (children);
+			flattened.erase (flattened.begin() + i);
+			flattened.insert (flattened.end(), nested.children.begin(), nested.children.end());
+			merge (id, make_add (std::move (flattened)));
+			break;
+		}
+	}
+
+	/* k1 * x + k2 * x -> (k1 + k2) * x; also folds constants and drops zeros */
+	{
+		std::map<ClassId, rational_t> coefficients;
+		std::vector<ClassId> terms_order;
+		bool combined = false;
+
+		for (ClassId child: children) {
+			ClassId term;
+			rational_t coefficient;
+			split_coefficient (child, term, coefficient);
+
+			auto r = coefficients.emplace (term, coefficient);
+			if (r.second) {
+				terms_order.push_back (term);
+			} else {
+				r.first->second += coefficient;
+				combined = true;
+			}
+
+			if (coefficient == 0) {
+				combined = true;
+			}
+		}
+
+		if (combined) {
+			std::vector<ClassId> terms;
+			for (ClassId term: terms_order) {
+				const rational_t& coefficient = coefficients[term];
+				if (coefficient == 0) {
+					continue;
+				}
+				terms.push_back ((coefficient == 1) ? term : make_mul ({ add_constant (coefficient), term }));
+			}
+			merge (id, make_add (std::move (terms)));
+		}
+	}
+
+	/* a * f + b * f -> (a + b) * f */
+	{
+		std::map<ClassId, size_t> occurrences;
+		ClassId common = 0;
+		size_t common_count = 1;
+
+		for (ClassId child: children) {
+			for (ClassId factor: factors_of (child)) {
+				size_t count = ++occurrences[factor];
+				if (count > common_count) {
+					common = factor;
+					common_count = count;
+				}
+			}
+		}
+
+		if (common_count > 1) {
+			std::vector<ClassId> rest, cofactors;
+
+			for (ClassId child: children) {
+				ENode mul;
+				if (find (child) == common) {
+					cofactors.push_back (add_constant (1));
+				} else if (find_node (child, Op::Mul, mul) &&
+				           std::find_if (mul.children.begin(), mul.children.end(), [&] (ClassId c) { return find (c) == common; }) != mul.children.end()) {
+					mul.children.erase (std::find_if (mul.children.begin(), mul.children.end(), [&] (ClassId c) { return find (c) == common; }));
+					cofactors.push_back (make_mul (std::move (mul.children)));
+				} else {
+					rest.push_back (child);
+				}
+			}
+
+			rest.push_back (make_mul ({ common, make_add (std::move (cofactors)) }));
+			merge (id, make_add (std::move (rest)));
+		}
+	}
+
+	/* ln(a) + ln(b) -> ln(a * b) */
+	auto ln = function_ids_.find ("ln");
+	if (ln != function_ids_.end()) {
+		std::vector<ClassId> rest, arguments;
+
+		for (ClassId child: children) {
+			ENode function;
+			if (find_node (child, Op::Function, function) &&
+			    (function.payload == ln->second) &&
+			    (function.children.size() == 1)) {
+				arguments.push_back (function.children.front());
+			} else {
+				rest.push_back (child);
+			}
+		}
+
+		if (arguments.size() > 1) {
+			rest.push_back (add_function ("ln", { make_mul (std::move (arguments)) }));
+			merge (id, make_add (std::move (rest)));
+		}
+	}
+}
+
+void Graph::rules_mul (ClassId id, const ENode& node)
+{
+	const std::vector<ClassId>& children = node.children;
+
+	/* a * (b * c) -> a * b * c */
+	for (size_t i = 0; i < children.size(); ++i) {
+		ENode nested;
+		if (find_node (children[i], Op::Mul, nested)) {
+			std::vector<ClassId> flattened (children);
+			flattened.erase (flattened.begin() + i);
+			flattened.insert (flattened.end(), nested.children.begin(), nested.children.end());
+			merge (id, make_mul (std::move (flattened)));
+			break;
+		}
+	}
+
+	/* k1 * k2 * x -> k * x; also drops ones */
+	{
+		rational_t product (1), value;
+		size_t constants_count = 0;
+		std::vector<ClassId> rest;
+
+		for (ClassId child: children) {
+			if (constant_of (child, value)) {
+				product *= value;
+				++constants_count;
+			} else {
+				rest.push_back (child);
+			}
+		}
+
+		if ((constants_count > 1) || ((constants_count == 1) && (product == 1))) {
+			if (product != 1) {
+				rest.push_back (add_constant (product));
+			}
+			merge (id, make_mul (std::move (rest)));
+		}
+	}
+
+	/* x^a * x^b -> x^(a + b) */
+	{
+		std::map<ClassId, std::vector<ClassId>> exponents;
+		std::vector<ClassId> bases_order;
+		bool combined = false;
+
+		for (ClassId child: children) {
+			ClassId base, exponent;
+			split_exponent (child, base, exponent);
+			base = find (base);
+
+			std::vector<ClassId>& base_exponents = exponents[base];
+			if (base_exponents.empty()) {
+				bases_order.push_back (base);
+			} else {
+				combined = true;
+			}
+			base_exponents.push_back (exponent);
+		}
+
+		if (combined) {
+			std::vector<ClassId> factors;
+			for (ClassId base: bases_order) {
+				std::vector<ClassId>& base_exponents = exponents[base];
+				factors.push_back ((base_exponents.size() == 1) ? make_pow (base, base_exponents.front())
+				                                                : make_pow (base, make_add (std::move (base_exponents))));
+			}
+			merge (id, make_mul (std::move (factors)));
+		}
+	}
+}
+
+void Graph::expand_mul (ClassId id, const ENode& node)
+{
+	const std::vector<ClassId>& children = node.children;
+
+	/* a * (b + c) -> a * b + a * c (only for small sums, expansion grows quickly) */
+	for (size_t i = 0; i < children.size(); ++i) {
+		ENode sum;
+		if (find_node (children[i], Op::Add, sum) &&
+		    (sum.children.size() * (children.size() - 1) <= 16)) {
+			std::vector<ClassId> others (children);
+			others.erase (others.begin() + i);
+
+			std::vector<ClassId> terms;
+			for (ClassId term: sum.children) {
+				std::vector<ClassId> factors (others);
+				factors.push_back (term);
+				terms.push_back (make_mul (std::move (factors)));
+			}
+			merge (id, make_add (std::move (terms)));
+			break;
+		}
+	}
+}
+
+void Graph::rules_pow (ClassId id, const ENode& node)
+{
+	ClassId base = node.children[0],
+	        exponent = node.children[1];
+	rational_t value;
+	ENode nested;
+
+	/* x^0 -> 1, x^1 -> x */
+	if (constant_of (exponent, value)) {
+		if (value == 0) {
+			merge (id, add_constant (1));
+		} else if (value == 1) {
+			merge (id, base);
+		}
+	}
+
+	/* 1^x -> 1 */
+	if (constant_of (base, value) && (value == 1)) {
+		merge (id, add_constant (1));
+	}
+
+	/* (x^a)^b -> x^(a * b), for an integer b or a positive x (otherwise ((-1)^2)^(1/2) would become -1) */
+	if (find_node (base, Op::Pow, nested) &&
+	    (is_integer (exponent) || known_positive (nested.children[0]))) {
+		merge (id, make_pow (nested.children[0], make_mul ({ nested.children[1], exponent })));
+	}
+}
+
+void Graph::expand_pow (ClassId id, const ENode& node)
+{
+	ClassId base = node.children[0],
+	        exponent = node.children[1];
+	rational_t value;
+	ENode nested;
+
+	/* (a + b)^n -> (a + b) * (a + b)^(n - 1) for small n, to be expanded further */
+	if (find_node (base, Op::Add, nested) &&
+	    constant_of (exponent, value) &&
+	    (value.denominator() == 1) && (value > 1) && (value <= 4)) {
+		merge (id, make_mul ({ base, make_pow (base, add_constant (value - 1)) }));
+	}
+
+	/* (a * b)^c -> a^c * b^c, for an integer c or if at most one factor may be negative */
+	if (find_node (base, Op::Mul, nested) &&
+	    (is_integer (exponent) || all_but_one_positive (nested.children))) {
+		std::vector<ClassId> factors;
+		for (ClassId factor: nested.children) {
+			factors.push_back (make_pow (factor, exponent));
+		}
+		merge (id, make_mul (std::move (factors)));
+	}
+}
+
+void Graph::rules_function (ClassId id, const ENode& node)
+{
+	if ((functions_[node.payload] != "ln") || (node.children.size() != 1)) {
+		return;
+	}
+
+	ClassId argument = node.children.front();
+	rational_t value;
+	ENode nested;
+
+	/* ln(1) -> 0 */
+	if (constant_of (argument, value) && (value == 1)) {
+		merge (id, add_constant (0));
+	}
+
+	/* ln(a^b) -> b * ln(a), for a positive a (otherwise ln(x^2) would lose the negative x) */
+	if (find_node (argument, Op::Pow, nested) && known_positive (nested.children[0])) {
+		merge (id, make_mul ({ nested.children[1], add_function ("ln", { nested.children[0] }) }));
+	}
+}
+
+void Graph::expand_function (ClassId id, const ENode& node)
+{
+	if ((functions_[node.payload] != "ln") || (node.children.size() != 1)) {
+		return;
+	}
+
+	ENode nested;
+
+	/* ln(a * b) -> ln(a) + ln(b), if at most one factor may be non-positive */
+	if (find_node (node.children.front(), Op::Mul, nested) && all_but_one_positive (nested.children)) {
+		std::vector<ClassId> terms;
+		for (ClassId factor: nested.children) {
+			terms.push_back (add_function ("ln", { factor }));
+		}
+		merge (id, make_add (std::move (terms)));
+	}
+}
+
+std::vector<std::pair<ClassId, ENode>> Graph::snapshot()
+{
+	std::vector<std::pair<ClassId, ENode>> result;
+
+	for (ClassId id = 0; id < classes_.size(); ++id) {
+		if (find (id) == id) {
+			for (const ENode& node: classes_[id].nodes) {
+				if (!is_cyclic (id, node)) {
+					result.emplace_back (id, node);
+				}
+			}
+		}
+	}
+
+	return result;
+}
+
+void Graph::saturate (const EGraphSimplifier::Options& options)
+{
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point deadline = Clock::now() + std::chrono::milliseconds (options.time_limit_ms);
+
+	rebuild();
+
+	for (unsigned iteration = 0; iteration < options.iteration_limit; ++iteration) {
+		size_t classes_before = classes_.size();
+		bool limit_hit = false;
+
+		for (const auto& entry: snapshot()) {
+			if (Clock::now() >= deadline) {
+				limit_hit = true;
+				break;
+			}
+
+			ClassId id = find (entry.first);
+
+			switch (entry.second.op) {
+			case Op::Add:      rules_add (id, entry.second); break;
+			case Op::Mul:      rules_mul (id, entry.second); break;
+			case Op::Pow:      rules_pow (id, entry.second); break;
+			case Op::Function: rules_function (id, entry.second); break;
+			default:           break;
+			}
+		}
+
+		rebuild();
+
+		for (const auto& entry: snapshot()) {
+			if (limit_hit || (node_count_ >= options.node_limit) || (Clock::now() >= deadline)) {
+				limit_hit = true;
+				break;
+			}
+
+			ClassId id = find (entry.first);
+
+			switch (entry.second.op) {
+			case Op::Mul:      expand_mul (id, entry.second); break;
+			case Op::Pow:      expand_pow (id, entry.second); break;
+			case Op::Function: expand_function (id, entry.second); break;
+			default:           break;
+			}
+		}
+
+		bool changed = dirty_ || (classes_.size() != classes_before);
+		rebuild();
+
+		if (!changed || limit_hit) {
+			break;
+		}
+	}
+}
+
+/*
+ * Extraction
+ */
+
+double Graph::node_cost (const ENode& node, const std::vector<double>& costs, EGraphSimplifier::CostModel model)
+{
+	double result = 0;
+
+	for (ClassId child: node.children) {
+		result += costs[find (child)];
+	}
+
+	switch (model) {
+	case EGraphSimplifier::CostModel::NodeCount:
+		/* repeated operands are penalized, so that "x + x" and "x x" are written as "2 x" and "x^2" */
+		for (size_t i = 1; i < node.children.size(); ++i) {
+			if (find (node.children[i]) == find (node.children[i - 1])) {
+				result += 2;
+			}
+		}
+		return result + 1;
+
+	case EGraphSimplifier::CostModel::Evaluation: {
+		rational_t exponent;
+		switch (node.op) {
+		case Op::Constant:
+		case Op::Leaf:
+			return result;
+
+		case Op::Add:
+			return result + (node.children.size() - 1);
+
+		case Op::Mul:
+			return result + 2 * (node.children.size() - 1);
+
+		case Op::Pow:
+			if (constant_of (node.children[1], exponent) && (exponent.denominator() == 1)) {
+				/* repeated squaring, plus a division for negative exponents */
+				integer_t n = boost::multiprecision::abs (exponent.numerator());
+				double steps = 1;
+				while (n > 1) {
+					n >>= 1;
+					steps += 2;
+				}
+				return result + steps + ((exponent < 0) ? 8 : 0);
+			}
+			return result + 40;
+
+		case Op::Function:
+			return result + 40;
+		}
+		break;
+	}
+	}
+
+	return std::numeric_limits<double>::infinity();
+}
+
+Node::Base::Ptr Graph::build_product (const ENode& node, const std::vector<ENode>& best, bool negate)
+{
+	Node::MultiplicationDivision::Ptr result (new Node::MultiplicationDivision);
+	rational_t coefficient (negate ? -1 : 1), value;
+
+	for (ClassId child: node.children) {
+		child = find (child);
+		const ENode& child_best = best[child];
+
+		if (child_best.op == Op::Constant) {
+			coefficient *= constants_[child_best.payload];
+		} else if ((child_best.op == Op::Pow) &&
+		           constant_of (child_best.children[1], value) &&
+		           (value < 0)) {
+			/* x^(-a) -> 1 / x^a */
+			Node::Base::Ptr base = build (child_best.children[0], best);
+			if (value == -1) {
+				result->add_child (std::move (base), true);
+			} else {
+				Node::Power::Ptr power (new Node::Power);
+				power->set_base (std::move (base));
+				power->set_exponent (Node::Base::Ptr (new Node::Value (-value)));
+				result->add_child (std::move (power), true);
+			}
+		} else {
+			result->add_child (build (child, best), false);
+		}
+	}
+
+	if (coefficient != 1) {
+		result->add_child (Node::Base::Ptr (new Node::Value (coefficient)), false);
+	}
+
+	Node::MultiplicationDivision* result_node = result.get();
+	return result_node->decay_move (Node::Base::Ptr (result.release()));
+}
+
+Node::Base::Ptr Graph::build (ClassId id, const std::vector<ENode>& best)
+{
+	/* extraction recurses as deep as the tree it builds */
+	if (DeepStack::near_limit()) {
+		return DeepStack::call ([&] { return build (id, best); });
+	}
+
+	const ENode& node = best[find (id)];
+
+	switch (node.op) {
+	case Op::Constant:
+		return Node::Base::Ptr (new Node::Value (constants_[node.payload]));
+
+	case Op::Leaf:
+		return leaves_[node.payload]->clone();
+
+	case Op::Function: {
+		Node::Function::Ptr result (new Node::Function (functions_[node.payload]));
+		for (ClassId child: node.children) {
+			result->add_child (build (child, best));
+		}
+		return result;
+	}
+
+	case Op::Pow: {
+		Node::Power::Ptr result (new Node::Power);
+		result->set_base (build (node.children[0], best));
+		result->set_exponent (build (node.children[1], best));
+		return result;
+	}
+
+	case Op::Mul:
+		return build_product (node, best, false);
+
+	case Op::Add: {
+		Node::AdditionSubtraction::Ptr result (new Node::AdditionSubtraction);
+
+		for (ClassId child: node.children) {
+			const ENode& child_best = best[find (child)];
+			rational_t value;
+			bool negative = false;
+
+			/* -k * x -> - (k * x) */
+			if (child_best.op == Op::Constant) {
+				negative = (constants_[child_best.payload] < 0);
+			} else if (child_best.op == Op::Mul) {
+				negative = std::any_of (child_best.children.begin(), child_best.children.end(),
+				                        [&] (ClassId c) { return (best[find (c)].op == Op::Constant) && (constants_[best[find (c)].payload] < 0); });
+			}
+
+			if (!negative) {
+				result->add_child (build (child, best), false);
+			} else if (child_best.op == Op::Constant) {
+				result->add_child (Node::Base::Ptr (new Node::Value (-constants_[child_best.payload])), true);
+			} else {
+				result->add_child (build_product (child_best, best, true), true);
+			}
+		}
+
+		return result;
+	}
+	}
+
+	ERROR (std::logic_error, "E-graph extraction error: unknown node kind");
+}
+
+Node::Base::Ptr Graph::extract (ClassId root, EGraphSimplifier::CostModel model)
+{
+	std::vector<double> costs (classes_.size(), std::numeric_limits<double>::infinity());
+	std::vector<ENode> best (classes_.size());
+
+	/* relax node costs until a fixed point (cycles can never be cheaper, since all operations have positive costs) */
+	for (bool changed = true; changed; ) {
+		changed = false;
+
+		for (ClassId id = 0; id < classes_.size(); ++id) {
+			if (find (id) != id) {
+				continue;
+			}
+
+			for (const ENode& node: classes_[id].nodes) {
+				double cost = node_cost (node, costs, model);
+				if (cost < costs[id]) {
+					costs[id] = cost;
+					best[id] = node;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	return build (root, best);
+}
+
+} // anonymous namespace
+
+EGraphSimplifier::Options EGraphSimplifier::options;
+
+Node::Base::Ptr EGraphSimplifier::simplify (const Node::Base& tree, const Node::Base* hint)
+{
+	Graph graph;
+	Loader loader (graph);
+
+	ClassId root = loader.load (tree);
+
+	if (hint) {
+		graph.merge (root, loader.load (*hint));
+		root = graph.find (root);
+	}
+
+	graph.saturate (options);
+
+	return graph.extract (graph.find (root), options.cost_model);
+}
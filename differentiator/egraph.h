@@ -0,0 +1,42 @@
+#pragma once
+
+#include "node.h"
+
+/*
+ * An alternative simplifier based on equality saturation.
+ *
+ * The expression is loaded into an e-graph (a set of equivalence classes of expressions sharing
+ * their subterms), a fixed set of rewrite rules (power, product, sum and logarithm identities plus
+ * constant folding) is applied until nothing changes or a limit is hit, and then the cheapest
+ * expression under the selected cost model is extracted.
+ *
+ * Unlike Visitor::Simplify, the result does not depend on the order in which rewrites are attempted.
+ */
+
+class EGraphSimplifier
+{
+public:
+	enum class CostModel
+	{
+		NodeCount,  /* count of nodes in the resulting tree */
+		Evaluation  /* rough cost of evaluating the tree numerically */
+	};
+
+	struct Options
+	{
+		bool enabled = false;
+		CostModel cost_model = CostModel::NodeCount;
+		size_t node_limit = 20000;
+		unsigned time_limit_ms = 1000;
+		unsigned iteration_limit = 12;
+	};
+
+	static Options options;
+
+	/*
+	 * Returns the cheapest form of the tree found.
+	 * If given, the hint (an equivalent tree, e. g. the result of Visitor::Simplify) is added to the
+	 * e-graph as well, so the result is never worse than the hint under the cost model.
+	 */
+	static Node::Base::Ptr simplify (const Node::Base& tree, const Node::Base* hint = nullptr);
+};
@@ -1,206 +1,219 @@
 #include "lexer.h"
 
-#include <cctype>
-
 namespace {
 
-LexerIterator::CachedLexem implicit_multiplication[] = {
-	LexerIterator::CachedLexem ("*", LexerIterator::Classification::OpArithmetic),
-	LexerIterator::CachedLexem()
+typedef LexerIterator::Classification Classification;
+typedef LexerIterator::Operator Operator;
+
+/*
+ * Character classification table.
+ */
+
+enum CharacterClass : uint8_t
+{
+	CC_SPACE      = 1 << 0,
+	CC_LETTER     = 1 << 1, /* starts a symbol: letters, '_', '\' */
+	CC_DIGIT      = 1 << 2,
+	CC_HEX_DIGIT  = 1 << 3,
+	CC_SYMBOL     = 1 << 4, /* continues a symbol: letters, digits, '_', '\', '{', '}' */
+	CC_OPERATOR   = 1 << 5
 };
 
-bool check_implicit_multiplication (LexerIterator::Classification _1, LexerIterator::Classification _2)
+struct CharacterTable
 {
-	// '2x', '2(' (not vice versa!)
-	if ((_1 == LexerIterator::Classification::Numeric) &&
-	    ((_2 == LexerIterator::Classification::Alphabetical) ||
-	     (_2 == LexerIterator::Classification::OpParenthesisOpening))) {
-		return true;
-	}
+	uint8_t classes[256];
+	Operator operators[256];
 
-	return false;
-}
+	CharacterTable()
+	{
+		std::fill (std::begin (classes), std::end (classes), 0);
+		std::fill (std::begin (operators), std::end (operators), Operator::None);
 
-} // anonymous namespace
+		for (unsigned char c: std::string (" \t\n\v\f\r")) {
+			classes[c] |= CC_SPACE;
+		}
 
-bool LexerIterator::classify_check_next (string::const_iterator it, const char* pattern)
-{
-	while (*pattern) {
-		if ((it == end_) || (*it != *pattern)) {
-			return false;
+		for (unsigned c = 0; c < 26; ++c) {
+			classes['a' + c] |= CC_LETTER | CC_SYMBOL;
+			classes['A' + c] |= CC_LETTER | CC_SYMBOL;
 		}
-		++it;
-		++pattern;
-	}
-	return true;
-}
 
-LexerIterator::Classification LexerIterator::classify (string::const_iterator it)
-{
-	if (it == end_) {
-		return Classification::Nothing;
-	}
+		for (unsigned char c: std::string ("_\\")) {
+			classes[c] |= CC_LETTER | CC_SYMBOL;
+		}
 
-	if (isspace (*it)) {
-		return Classification::Whitespace;
-	}
+		for (unsigned char c: std::string ("{}")) {
+			classes[c] |= CC_SYMBOL;
+		}
 
-	if (isalpha (*it) || *it == '_' || *it == '\\') {
-		return Classification::Alphabetical;
-	}
+		for (unsigned c = 0; c < 10; ++c) {
+			classes['0' + c] |= CC_DIGIT | CC_HEX_DIGIT | CC_SYMBOL;
+		}
 
-	if (isdigit (*it)) {
-		return Classification::Numeric;
+		for (unsigned c = 0; c < 6; ++c) {
+			classes['a' + c] |= CC_HEX_DIGIT;
+			classes['A' + c] |= CC_HEX_DIGIT;
+		}
+
+		const std::pair<char, Operator> single_operators[] = {
+			{ '+', Operator::Plus },
+			{ '-', Operator::Minus },
+			{ '*', Operator::Multiply },
+			{ '/', Operator::Divide },
+			{ '^', Operator::Power },
+			{ '(', Operator::ParenthesisOpening },
+			{ ')', Operator::ParenthesisClosing },
+			{ ',', Operator::Comma }
+		};
+
+		for (const auto& op: single_operators) {
+			classes[(unsigned char) op.first] |= CC_OPERATOR;
+			operators[(unsigned char) op.first] = op.second;
+		}
 	}
 
-	if (ispunct (*it)) {
-		switch (*it) {
-		case '*':
-			if (classify_check_next (it + 1, "*")) {
-				return Classification::OpPowerOperator;
-			}
-			return Classification::OpArithmetic;
+	bool is (LexerIterator::character c, uint8_t mask) const
+	{
+		return classes[(unsigned char) c] & mask;
+	}
+};
 
-		case '+':
-		case '-':
-		case '/':
-		case '^':
-			return Classification::OpArithmetic;
+const CharacterTable table;
 
-		case '(':
-			return Classification::OpParenthesisOpening;
+bool check_implicit_multiplication (const LexerIterator::Token& _1, const LexerIterator::Token& _2)
+{
+	// '2x', '2(' (not vice versa!)
+	return (_1.classification == Classification::Numeric) &&
+	       ((_2.classification == Classification::Alphabetical) ||
+	        ((_2.classification == Classification::Operator) && (_2.op == Operator::ParenthesisOpening)));
+}
 
-		case ')':
-			return Classification::OpParenthesisClosing;
-		}
+/* returns the radix of a numeric literal (following strtol() with base 0) and skips its prefix */
+unsigned numeric_radix (const LexerIterator::character*& it, const LexerIterator::character* end)
+{
+	if ((end - it >= 3) && (it[0] == '0') && ((it[1] == 'x') || (it[1] == 'X')) && table.is (it[2], CC_HEX_DIGIT)) {
+		it += 2;
+		return 16;
 	}
 
+	if ((end - it >= 2) && (it[0] == '0') && (it[1] >= '0') && (it[1] <= '7')) {
+		it += 1;
+		return 8;
+	}
 
-	ERROR (std::runtime_error, "Parse error: unknown character: '" << *it << "'");
+	return 10;
 }
 
-void LexerIterator::next()
+unsigned digit_value (LexerIterator::character c)
 {
-	// first, try to advance the fake sequence
-	if (fake_sequence_) {
-		++fake_sequence_;
-
-		// check if the sequence has ended; then the actual value (cache_) comes into effect
-		if (fake_sequence_->classification == Classification::Nothing) {
-			fake_sequence_ = nullptr;
-		}
+	if (c <= '9') {
+		return c - '0';
+	} else if (c >= 'a') {
+		return c - 'a' + 10;
+	} else {
+		return c - 'A' + 10;
+	}
+}
 
-		return;
+bool is_digit (LexerIterator::character c, unsigned radix)
+{
+	switch (radix) {
+	case 8:  return (c >= '0') && (c <= '7');
+	case 16: return table.is (c, CC_HEX_DIGIT);
+	default: return table.is (c, CC_DIGIT);
 	}
+}
 
-	Classification cl;
+} // anonymous namespace
 
-	cache_.text.clear();
-	cache_.is_valid = false;
+void LexerIterator::scan()
+{
+	token_ = Token();
 
 	// seek to end of whitespace (or end of input)
-	while ((cl = classify (current_end_)) == Classification::Whitespace) {
-		++current_end_;
+	while ((current_ != end_) && table.is (*current_, CC_SPACE)) {
+		++current_;
 	}
-	current_ = current_end_;
-
-	// determine length of current lexem and also optionally fill the cache
-	switch (cl) {
-	case Classification::OpParenthesisOpening:
-	case Classification::OpParenthesisClosing:
-	case Classification::OpArithmetic:
-		current_end_ += 1;
-		break;
 
-	case Classification::OpPowerOperator:
-		current_end_ += 2;
-		break;
+	token_.begin = current_;
+
+	if (current_ == end_) {
+		return;
+	}
 
-	case Classification::Alphabetical: {
+	const character* it = current_;
+
+	if (table.is (*it, CC_OPERATOR)) {
+		token_.classification = Classification::Operator;
+		token_.op = table.operators[(unsigned char) *it];
+		++it;
+
+		// '**' is the power operator
+		if ((token_.op == Operator::Multiply) && (it != end_) && (*it == '*')) {
+			token_.op = Operator::Power;
+			++it;
+		}
+	} else if (table.is (*it, CC_LETTER)) {
 		int depth = 0;
 
+		token_.classification = Classification::Alphabetical;
+
 		// first character is already classified
 		do {
-			++current_end_;
-			switch (*current_end_) {
+			++it;
+			if (it == end_) {
+				break;
+			}
+			switch (*it) {
 			case '{': ++depth; break;
 			case '}': --depth; break;
 			}
 		} while ((depth > 0) ||
-		         (depth == 0 && (isalpha (*current_end_) ||
-		                         isdigit (*current_end_) ||
-		                         (*current_end_ == '_') ||
-		                         (*current_end_ == '\\') ||
-		                         (*current_end_ == '{') ||
-		                         (*current_end_ == '}'))));
-		break;
-	}
-
-	case Classification::Numeric: {
-		/*
-		 * FIXME: this assumes string elements are stored contiguously, i. e.
-		 * *(iter + n) == *(&*iter + n), and that the string is NULL-terminated.
-		 */
-		const character* current_char = &*current_;
-		character* end_char;
-		cache_.numeric = std::strtol (current_char, &end_char, 0);
-
-		VERIFY (end_char > current_char, std::logic_error, "Lexer error: could not parse a number at '" << *current_char << "' (classification error)");
-
-		current_end_ += (end_char - current_char);
-		cache_.is_valid = true;
-		break;
-	}
-
-	default:
-	case Classification::Nothing:
-		cache_.is_valid = true;
-		break;
-	}
+		         ((depth == 0) && table.is (*it, CC_SYMBOL)));
+	} else if (table.is (*it, CC_DIGIT)) {
+		token_.classification = Classification::Numeric;
 
-	// try to match one of the fake sequences (before we overwrite the previous lexem's class)
-	if (check_implicit_multiplication (cache_.classification, cl)) {
-		fake_sequence_ = implicit_multiplication;
+		unsigned radix = numeric_radix (it, end_);
+		while ((it != end_) && is_digit (*it, radix)) {
+			++it;
+		}
+	} else {
+		ERROR (std::runtime_error, "Parse error: unknown character: '" << *it << "'");
 	}
 
-	// set class
-	cache_.classification = cl;
+	token_.length = it - current_;
+	current_ = it;
 }
 
-const LexerIterator::CachedLexem* LexerIterator::get_cache()
+void LexerIterator::next()
 {
-	if (fake_sequence_) {
-		if (!fake_sequence_->is_valid) {
-			throw std::logic_error ("Fake sequence lexem has invalid cached value");
-		}
-		return fake_sequence_;
+	if (has_deferred_) {
+		token_ = deferred_;
+		has_deferred_ = false;
+		return;
 	}
 
-	if (!cache_.is_valid) {
-		cache_.text = std::string (current_, current_end_);
-		cache_.is_valid = true;
-	}
-	return &cache_;
-}
+	Token previous = token_;
+	scan();
 
-const LexerIterator::CachedLexem* LexerIterator::get_cache_no_fill() const
-{
-	if (fake_sequence_) {
-		return fake_sequence_;
-	}
+	// insert the implicit multiplication sign (before we overwrite the previous token)
+	if (check_implicit_multiplication (previous, token_)) {
+		deferred_ = token_;
+		has_deferred_ = true;
 
-	return &cache_;
+		token_.classification = Classification::Operator;
+		token_.op = Operator::Multiply;
+		token_.length = 0;
+	}
 }
 
 bool LexerIterator::is_end() const
 {
-	return current_ == end_; // also true for default-constructed Lexer
+	return token_.classification == Classification::Nothing; // also true for default-constructed Lexer
 }
 
-LexerIterator::LexerIterator (string::const_iterator b, string::const_iterator e)
-: begin_ (b)
-, current_ (b)
-, current_end_ (b)
+LexerIterator::LexerIterator (const character* b, const character* e)
+: current_ (b)
 , end_ (e)
 {
 	next();
@@ -219,14 +232,14 @@ LexerIterator LexerIterator::operator++(int)
 	return l;
 }
 
-const LexerIterator::string& LexerIterator::operator*()
+const LexerIterator::Token& LexerIterator::operator*() const
 {
-	return get_cache()->text;
+	return token_;
 }
 
-const LexerIterator::string* LexerIterator::operator->()
+const LexerIterator::Token* LexerIterator::operator->() const
 {
-	return &operator*();
+	return &token_;
 }
 
 LexerIterator::operator bool() const
@@ -236,28 +249,48 @@ LexerIterator::operator bool() const
 
 LexerIterator::Classification LexerIterator::get_class() const
 {
-	return get_cache_no_fill()->classification;
+	return token_.classification;
 }
 
 integer_t LexerIterator::get_numeric() const
 {
-	const CachedLexem* lexem = get_cache_no_fill();
-
-	if (lexem->classification != Classification::Numeric) {
+	if (token_.classification != Classification::Numeric) {
 		throw std::runtime_error ("Requested numeric value of a non-numeric lexem");
 	}
-	if (!lexem->is_valid) {
-		throw std::runtime_error ("Numerlc lexem has invalid cached value");
+
+	const character *it = token_.begin, *end = token_.begin + token_.length;
+	unsigned radix = numeric_radix (it, end);
+
+	/* accumulate the digits in machine words, folding them into the result once a word is full */
+	const uint64_t word_limit = std::numeric_limits<uint64_t>::max() / 16;
+
+	integer_t result = 0;
+	uint64_t word = 0, word_scale = 1;
+
+	for (; it != end; ++it) {
+		word = word * radix + digit_value (*it);
+		word_scale *= radix;
+
+		if (word_scale > word_limit) {
+			result = result * word_scale + word;
+			word = 0;
+			word_scale = 1;
+		}
 	}
-	return lexem->numeric;
+
+	return result * word_scale + word;
 }
 
-bool LexerIterator::check (std::initializer_list<string> list, size_t* idx)
+bool LexerIterator::check (std::initializer_list<Operator> list, size_t* idx) const
 {
+	if (token_.classification != Classification::Operator) {
+		return false;
+	}
+
 	size_t matched = 0;
 
-	for (const string& s: list) {
-		if (operator*() == s) {
+	for (Operator op: list) {
+		if (token_.op == op) {
 			if (idx) {
 				*idx = matched;
 			}
@@ -270,12 +303,12 @@ bool LexerIterator::check (std::initializer_list<string> list, size_t* idx)
 	return false;
 }
 
-bool LexerIterator::check (const LexerIterator::string& s)
+bool LexerIterator::check (Operator op) const
 {
-	return (operator*() == s);
+	return (token_.classification == Classification::Operator) && (token_.op == op);
 }
 
-bool LexerIterator::check_and_advance (std::initializer_list<string> list, size_t* idx)
+bool LexerIterator::check_and_advance (std::initializer_list<Operator> list, size_t* idx)
 {
 	if (check (list, idx)) {
 		operator++();
@@ -285,9 +318,9 @@ bool LexerIterator::check_and_advance (std::initializer_list<string> list, size_
 	return false;
 }
 
-bool LexerIterator::check_and_advance (const LexerIterator::string& s)
+bool LexerIterator::check_and_advance (Operator op)
 {
-	if (check (s)) {
+	if (check (op)) {
 		operator++();
 		return true;
 	}
@@ -295,7 +328,7 @@ bool LexerIterator::check_and_advance (const LexerIterator::string& s)
 	return false;
 }
 
-std::ostream& operator<< (std::ostream& out, LexerIterator& lexem)
+std::ostream& operator<< (std::ostream& out, const LexerIterator& lexem)
 {
 	switch (lexem.get_class()) {
 	case LexerIterator::Classification::Numeric:
@@ -307,7 +340,8 @@ std::ostream& operator<< (std::ostream& out, LexerIterator& lexem)
 		break;
 
 	default:
-		out << "'" << *lexem << "'";
+		/* the implicit multiplication sign has no text */
+		out << "'" << (lexem->length ? lexem->text() : "*") << "'";
 		break;
 	}
 
@@ -321,7 +355,7 @@ Lexer::Lexer (const string& s)
 
 LexerIterator Lexer::begin() const
 {
-	return LexerIterator (s_.begin(), s_.end());
+	return LexerIterator (s_);
 }
 
 LexerIterator Lexer::end() const
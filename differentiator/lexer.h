@@ -2,10 +2,16 @@
 
 #include <util/util.h>
 
-class LexerIterator : public std::iterator<std::forward_iterator_tag, std::string>
+/*
+ * The lexer does not copy the source: each token refers to its characters in the source buffer,
+ * which must outlive the lexer. Characters are classified by a table, and operators are reported
+ * as enumerated values rather than as text.
+ */
+
+class LexerIterator
 {
 public:
-	typedef value_type string;
+	typedef std::string string;
 	typedef string::value_type character;
 
 	enum class Classification
@@ -14,71 +20,76 @@ public:
 		Whitespace,
 		Numeric,
 		Alphabetical,
-		OpParenthesisOpening,
-		OpParenthesisClosing,
-		OpArithmetic,
-		OpPowerOperator
+		Operator
 	};
 
-	struct CachedLexem {
-		string text;
-		integer_t numeric;
-		Classification classification = Classification::Nothing;
-		bool is_valid = false;
-
-		CachedLexem() = default;
+	enum class Operator
+	{
+		None,
+		Plus,
+		Minus,
+		Multiply,
+		Divide,
+		Power,
+		ParenthesisOpening,
+		ParenthesisClosing,
+		Comma
+	};
 
-		CachedLexem (integer_t value)
-		: numeric (value)
-		, classification (Classification::Numeric)
-		, is_valid (true)
-		{ }
+	struct Token
+	{
+		Classification classification = Classification::Nothing;
+		Operator op = Operator::None;
+		const character* begin = nullptr;
+		size_t length = 0;
 
-		CachedLexem (const char* value, Classification c)
-		: text (value)
-		, classification (c)
-		, is_valid (true)
-		{ }
+		string text() const { return string (begin, length); }
 	};
 
+	typedef std::forward_iterator_tag iterator_category;
+	typedef Token value_type;
+	typedef ptrdiff_t difference_type;
+	typedef const Token* pointer;
+	typedef const Token& reference;
+
 private:
-	string::const_iterator begin_, current_, current_end_, end_;
+	const character *current_ = nullptr, *end_ = nullptr;
+
+	Token token_;
 
-	const CachedLexem* fake_sequence_ = nullptr;
-	CachedLexem cache_;
+	/* a real token deferred by an implicit multiplication sign ('2x' is '2 * x') */
+	Token deferred_;
+	bool has_deferred_ = false;
 
-	bool classify_check_next (string::const_iterator it, const char* pattern);
-	Classification classify (string::const_iterator it);
+	void scan();
 	void next();
-	const CachedLexem* get_cache();
-	const CachedLexem* get_cache_no_fill() const;
 	bool is_end() const;
 
 public:
 	LexerIterator() = default;
 	~LexerIterator() = default;
-	LexerIterator (string::const_iterator b, string::const_iterator e);
+	LexerIterator (const character* b, const character* e);
 
 	LexerIterator (const string& s)
-	: LexerIterator (s.begin(), s.end())
+	: LexerIterator (s.data(), s.data() + s.size())
 	{
 	}
 
 	LexerIterator& operator++();
 	LexerIterator operator++(int);
-	const string& operator*();
-	const string* operator->();
+	const Token& operator*() const;
+	const Token* operator->() const;
 	operator bool() const;
 
 	Classification get_class() const;
 	integer_t get_numeric() const;
 
-	bool check (std::initializer_list<string> list, size_t* idx = nullptr);
-	bool check (const string& s);
-	bool check_and_advance (std::initializer_list<string> list, size_t* idx = nullptr);
-	bool check_and_advance (const string& s);
+	bool check (std::initializer_list<Operator> list, size_t* idx = nullptr) const;
+	bool check (Operator op) const;
+	bool check_and_advance (std::initializer_list<Operator> list, size_t* idx = nullptr);
+	bool check_and_advance (Operator op);
 
-	friend std::ostream& operator<< (std::ostream& out, LexerIterator& lexem);
+	friend std::ostream& operator<< (std::ostream& out, const LexerIterator& lexem);
 };
 
 class Lexer
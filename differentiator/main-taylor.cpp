@@ -1,7 +1,11 @@
 #include "util-tree.h"
+#include "derivative-tower.h"
 #include "parser.h"
 #include "visitor-print.h"
 #include "visitor-calculate.h"
+#include "stats.h"
+
+#include <getopt.h>
 
 struct Expression
 {
@@ -21,8 +25,45 @@ struct Expression
 	}
 };
 
-int main()
+enum
 {
+	ARG_STATS = 1000,
+};
+
+const option option_array[] = {
+	{ "stats", optional_argument, nullptr, ARG_STATS },
+	{ }
+};
+
+int main (int argc, char** argv)
+{
+	bool stats_enabled = false;
+	std::string stats_file;
+	int option;
+
+	while ((option = getopt_long (argc, argv, "", option_array, nullptr)) != -1) {
+		switch (option) {
+		case ARG_STATS:
+			stats_enabled = true;
+			if (optarg && optarg[0]) {
+				stats_file = optarg;
+			}
+			break;
+
+		default:
+			std::cerr << "Usage: " << argv[0] << " [--stats[=FILE]] < INPUT" << std::endl;
+			return 1;
+		}
+	}
+
+	if (stats_enabled) {
+#ifdef ENABLE_STATS
+		Stats::enable();
+#else // ENABLE_STATS
+		ERROR (std::runtime_error, "Statistics are not available: the program has been built without ENABLE_STATS");
+#endif // ENABLE_STATS
+	}
+
 	unsigned N;
 	std::string expression_text;
 	std::cin >> N >> std::ws;
@@ -31,25 +72,42 @@ int main()
 
 	variables.insert (Variable::make<rational_t> ("x", rational_t (0), rational_t (0), false));
 
-	Node::Base::Ptr expression = Parser (expression_text, variables).parse();
-	expression = simplify_tree (expression.get());
+	Node::Base::Ptr expression;
+
+	{
+		STATS_PHASE (stats, "parse");
+		expression = Parser (expression_text, variables).parse();
+		STATS_OUTPUT (stats, *expression);
+	}
+
+	{
+		STATS_PHASE (stats, "simplify");
+		STATS_INPUT (stats, *expression);
+		expression = simplify_tree (expression.get());
+		STATS_OUTPUT (stats, *expression);
+	}
 
 	std::unique_ptr<rational_t[]> series_coefficients (new rational_t[N+1]);
 
 	Visitor::Calculate calculator;
-	Node::Base::Ptr derivative;
+	DerivativeTower tower (*expression, "x");
 	integer_t denominator = 1;
 	unsigned current_order = 0;
 
-	derivative = expression->clone();
-
 	for (;;) {
 
 		/*
 		 * Add the next term to the Taylor series, if it is non-zero.
 		 */
 
-		boost::any derivative_value = derivative->accept (calculator);
+		boost::any derivative_value;
+
+		{
+			STATS_PHASE (stats, BUILD_STRING ("order " << current_order));
+			const Node::Base* derivative = tower.get (current_order).get();
+			STATS_OUTPUT (stats, *derivative);
+			derivative_value = derivative->accept (calculator);
+		}
 
 		if (!any_isa<rational_t> (derivative_value)) {
 			ERROR (std::runtime_error, "Cannot build the Taylor series: derivative of order " << current_order << " is not rational or cannot be computed");
@@ -89,16 +147,24 @@ int main()
 		}
 
 		/*
-		 * Build the next derivative.
+		 * Advance to the next derivative (the tower builds it incrementally from the previous one).
 		 */
 
-		derivative = differentiate (derivative.get(), "x");
-
 		++current_order;
 		denominator *= current_order;
 	}
 
 	std::cout << std::endl;
 
+	if (stats_enabled) {
+		if (stats_file.empty()) {
+			Stats::write_text (std::cerr);
+		} else {
+			std::ofstream out;
+			open (out, stats_file.c_str());
+			Stats::write_json (out);
+		}
+	}
+
 	return 0;
 }
@@ -1,9 +1,19 @@
 #include "util-tree.h"
+#include "budget.h"
+#include "stats.h"
+#include "batch.h"
+#include "server.h"
+#include "sweep.h"
+#include "derivative-tower.h"
+#include "egraph.h"
+#include "visitor-simplify.h"
 #include "parser.h"
 #include "visitor-print.h"
 #include "visitor-calculate.h"
 #include "visitor-latex.h"
 
+#include <util/thread-pool.h>
+
 #include <getopt.h>
 
 enum {
@@ -16,15 +26,34 @@ enum {
 	ARG_ADD_VARIABLE_FRAC       = 'r',
 	ARG_ADD_VARIABLE_NO_VALUE   = 'b',
 	ARG_ADD_VARIABLE_FROM_FILE  = 'f',
+	ARG_INPUT_FILE              = 'i',
 	ARG_DERIVATIVE_ORDER        = 'o',
 	ARG_SERIES_LENGTH           = 's',
 	ARG_SERIES_POINT            = 'p',
+	ARG_JOBS                    = 'j',
 	ARG_MODE_DIFFERENTIATE      = 'D',
 	ARG_MODE_FIND_ERROR         = 'E',
 	ARG_MODE_SIMPLIFY           = 'S',
 	ARG_MODE_TAYLOR_SERIES      = 'T',
+	ARG_MODE_BATCH              = 'B',
 	ARG_MACHINE_OUTPUT_VAR_NAME = 0x100,
 	ARG_LATEX_OUTPUT_VAR_NAME,
+	ARG_SIMPLIFIER,
+	ARG_EGRAPH_COST,
+	ARG_EGRAPH_NODE_LIMIT,
+	ARG_EGRAPH_TIME_LIMIT,
+	ARG_EGRAPH_ITERATIONS,
+	ARG_POLYNOMIAL_TERMS,
+	ARG_BUDGET_NODES,
+	ARG_BUDGET_MEMORY,
+	ARG_BUDGET_TIME,
+	ARG_MODE_SERVER,
+	ARG_SWEEP,
+	ARG_SWEEP_FORMAT,
+	ARG_ELIDE_TERMS,
+	ARG_ELIDE_CHARS,
+	ARG_STATS,
+	ARG_PROFILE_RULES,
 };
 
 namespace {
@@ -37,41 +66,77 @@ const option option_array[] = {
 	{ "name-latex",    required_argument, nullptr, ARG_LATEX_OUTPUT_VAR_NAME },
 	{ "terse",         no_argument,       nullptr, ARG_TERSE_OUTPUT },
 	{ "really-quiet",  no_argument,       nullptr, ARG_NO_OUTPUT },
+	{ "elide-terms",   required_argument, nullptr, ARG_ELIDE_TERMS },
+	{ "elide-chars",   required_argument, nullptr, ARG_ELIDE_CHARS },
+	{ "stats",         optional_argument, nullptr, ARG_STATS },
+	{ "profile-rules", optional_argument, nullptr, ARG_PROFILE_RULES },
 	{ "var",           required_argument, nullptr, ARG_ADD_VARIABLE },
 	{ "var-frac",      required_argument, nullptr, ARG_ADD_VARIABLE_FRAC },
 	{ "var-bare",      required_argument, nullptr, ARG_ADD_VARIABLE_NO_VALUE },
 	{ "var-file",      required_argument, nullptr, ARG_ADD_VARIABLE_FROM_FILE },
+	{ "input",         required_argument, nullptr, ARG_INPUT_FILE },
 	{ "deriv-order",   required_argument, nullptr, ARG_DERIVATIVE_ORDER },
 	{ "series-length", required_argument, nullptr, ARG_SERIES_LENGTH },
 	{ "series-point",  required_argument, nullptr, ARG_SERIES_POINT },
+	{ "jobs",          required_argument, nullptr, ARG_JOBS },
+	{ "simplifier",    required_argument, nullptr, ARG_SIMPLIFIER },
+	{ "egraph-cost",   required_argument, nullptr, ARG_EGRAPH_COST },
+	{ "egraph-node-limit", required_argument, nullptr, ARG_EGRAPH_NODE_LIMIT },
+	{ "egraph-time-limit", required_argument, nullptr, ARG_EGRAPH_TIME_LIMIT },
+	{ "egraph-iterations", required_argument, nullptr, ARG_EGRAPH_ITERATIONS },
+	{ "polynomial-terms", required_argument, nullptr, ARG_POLYNOMIAL_TERMS },
+	{ "budget-nodes",  required_argument, nullptr, ARG_BUDGET_NODES },
+	{ "budget-memory", required_argument, nullptr, ARG_BUDGET_MEMORY },
+	{ "budget-time",   required_argument, nullptr, ARG_BUDGET_TIME },
+	{ "sweep",         required_argument, nullptr, ARG_SWEEP },
+	{ "sweep-format",  required_argument, nullptr, ARG_SWEEP_FORMAT },
 	{ "differentiate", required_argument, nullptr, ARG_MODE_DIFFERENTIATE },
 	{ "error",         no_argument,       nullptr, ARG_MODE_FIND_ERROR },
 	{ "simplify",      optional_argument, nullptr, ARG_MODE_SIMPLIFY },
 	{ "taylor-series", required_argument, nullptr, ARG_MODE_TAYLOR_SERIES },
+	{ "batch",         no_argument,       nullptr, ARG_MODE_BATCH },
+	{ "server",        required_argument, nullptr, ARG_MODE_SERVER },
 	{ }
 };
 
 void usage (const char* name) {
 	std::cerr << "Usage: " << name << " [-m|--machine] [-l|--latex FILE] [-q|--terse] [-Q|--really-quiet]" << std::endl
+	          << "       [--elide-terms TERMS] [--elide-chars CHARACTERS] [--stats[=FILE]] [--profile-rules[=FILE]]" << std::endl
 	          << "       [-n|--name NAME] [--name-machine NAME] [--name-latex NAME]" << std::endl
 	          << "       [-v|--var VARIABLE ...] [-r|--var-frac VARIABLE ...] [-b|--var-bare VARIABLE ...] [-f|--var-file FILE ...]" << std::endl
-	          << "       [-o|--deriv-order ORDER] [-s|--series-length LENGTH] [-p|--series-point VALUE]" << std::endl
-	          << "       [-D|--differentiate VARIABLE] [-E|--error] [-S|--simplify[=VARIABLE]] [-T|--taylor-series VARIABLE] <EXPRESSION>" << std::endl;
+	          << "       [-o|--deriv-order ORDER] [-s|--series-length LENGTH] [-p|--series-point VALUE] [-j|--jobs JOBS]" << std::endl
+	          << "       [--simplifier classic|egraph] [--egraph-cost size|evaluation] [--egraph-node-limit NODES] [--egraph-time-limit MS]" << std::endl
+	          << "       [--egraph-iterations ITERATIONS]" << std::endl
+	          << "       [--polynomial-terms TERMS] [--budget-nodes NODES] [--budget-memory MB] [--budget-time SECONDS]" << std::endl
+	          << "       [--sweep 'VARIABLE START:STEP:STOP' ...] [--sweep 'VARIABLE VALUE,VALUE,...' ...] [--sweep-format csv|binary]" << std::endl
+	          << "       [-D|--differentiate VARIABLE] [-E|--error] [-S|--simplify[=VARIABLE]] [-T|--taylor-series VARIABLE]" << std::endl
+	          << "       <EXPRESSION | -i|--input FILE>" << std::endl
+	          << "       " << name << " -B|--batch [-i|--input FILE] [options...]" << std::endl
+	          << "       " << name << " --server SOCKET [options...]" << std::endl;
 	exit (EXIT_FAILURE);
 }
 
-void print_expression_aligned (std::ostream& out, const std::string& name, Node::Base* tree, Node::Base* simplified, const boost::any& value)
+void print_expression_aligned (std::ostream& out, const std::string& name, Node::Base* tree, Node::Base* simplified, const boost::any& value,
+                               const Visitor::Print::Elision& elision)
 {
 	static Visitor::Print print_symbolic (out, false),
 	                      print_substitute (out, true);
 
+	print_symbolic.elide (elision);
+	print_substitute.elide (elision);
+
 	auto align = std::setw (name.length());
 
-	out << name << " = "; tree->accept (print_symbolic); out << " =" << std::endl;
-	if (simplified) {
-		out << align << "" << " = "; simplified->accept (print_symbolic); out << " =" << std::endl;
+	/* no tree means that only the value has been computed, numerically */
+	if (!tree) {
+		out << name << " = (not built symbolically) =" << std::endl;
+	} else {
+		out << name << " = "; print_symbolic.print (*tree); out << " =" << std::endl;
+		if (simplified) {
+			out << align << "" << " = "; print_symbolic.print (*simplified); out << " =" << std::endl;
+		}
+		out << align << "" << " = "; print_substitute.print (simplified ? *simplified : *tree); out << " =" << std::endl;
 	}
-	out << align << "" << " = "; (simplified ? simplified : tree)->accept (print_substitute); out << " =" << std::endl;
 
 	out << align << "" << " = ";
 	if (!value.empty()) {
@@ -82,11 +147,13 @@ void print_expression_aligned (std::ostream& out, const std::string& name, Node:
 	out << std::endl;
 }
 
-void print_expression_terse (std::ostream& out, Node::Base* tree)
+void print_expression_terse (std::ostream& out, Node::Base* tree, const Visitor::Print::Elision& elision = Visitor::Print::Elision())
 {
-	static Visitor::Print print_symbolic (out, false);
+	/* not shared between calls: this is used for both human-readable and machine output */
+	Visitor::Print print_symbolic (out, false);
 
-	tree->accept (print_symbolic);
+	print_symbolic.elide (elision);
+	print_symbolic.print (*tree);
 }
 
 void print_value_terse (std::ostream& out, const boost::any& value)
@@ -98,6 +165,66 @@ void print_value_terse (std::ostream& out, const boost::any& value)
 	}
 }
 
+/* writes the phase statistics to stderr, or as JSON to the file if given */
+void write_stats (const std::string& file)
+{
+	if (file.empty()) {
+		Stats::write_text (std::cerr);
+	} else {
+		std::ofstream out;
+		open (out, file.c_str());
+		Stats::write_json (out);
+	}
+}
+
+/* same for the profile of the simplifier rules */
+void write_rule_profile (const std::string& file)
+{
+	if (file.empty()) {
+		Visitor::Simplify::write_profile_text (std::cerr);
+	} else {
+		std::ofstream out;
+		open (out, file.c_str());
+		Visitor::Simplify::write_profile_json (out);
+	}
+}
+
+void warn_budget_exceeded (const BudgetExceeded& e, const char* fallback, bool quiet)
+{
+	if (!quiet) {
+		std::cerr << "Warning: " << e.what() << "; " << fallback << "." << std::endl
+		          << std::endl;
+	}
+}
+
+/*
+ * Computes the value of a derivative numerically, as k! times the k-th Taylor coefficient.
+ * Returns an empty value if it cannot be computed (e. g. some variables have no values).
+ */
+
+boost::any derivative_value (const Node::Base* tree, const std::string& variable, unsigned order)
+{
+	std::vector<boost::any> coefficients;
+
+	try {
+		coefficients = taylor_coefficients (tree, variable, order);
+	} catch (std::runtime_error&) {
+		return boost::any();
+	}
+
+	integer_t factorial = 1;
+	for (unsigned i = 2; i <= order; ++i) {
+		factorial *= i;
+	}
+
+	const boost::any& coefficient = coefficients[order];
+	if (any_isa<rational_t> (coefficient)) {
+		return rational_t (any_to_rational (coefficient) * factorial);
+	} else {
+		return boost::any_cast<data_t> (coefficient) * to_fp (rational_t (factorial));
+	}
+}
+
 struct Expression
 {
 	Node::Base::Ptr tree;
@@ -107,7 +234,12 @@ struct Expression
 	{
 		static Visitor::Calculate calculate;
 
-		value = tree->accept (calculate);
+		/* no tree means that the value has already been computed numerically */
+		if (tree) {
+			STATS_PHASE (stats, std::string ("evaluate ") + explanation);
+			STATS_INPUT (stats, *tree);
+			value = tree->accept (calculate);
+		}
 
 		if (value.empty() && !quiet) {
 			std::cerr << "Warning: could not compute " << explanation << std::endl
@@ -148,7 +280,9 @@ int main (int argc, char** argv)
 		Differentiate,
 		CalculateError,
 		Simplify,
-		Series
+		Series,
+		Batch,
+		Server
 	};
 
 	struct {
@@ -168,7 +302,13 @@ int main (int argc, char** argv)
 				bool terse;
 				bool quiet;
 				std::string name;
+				Visitor::Print::Elision elision;
 			} common;
+
+			struct {
+				bool enabled;
+				std::string file;
+			} stats, profile_rules;
 		} output;
 
 		struct {
@@ -188,8 +328,22 @@ int main (int argc, char** argv)
 				unsigned length = 1;
 				rational_t point = rational_t (0);
 			} series;
+
+			struct {
+				std::string socket;
+			} server;
 		} task;
 
+		struct {
+			unsigned jobs = 0;
+		} execution;
+
+		struct {
+			std::vector<std::string> axes;
+			Sweep::Format format = Sweep::Format::CSV;
+		} sweep;
+
+		std::string input_file;
 		std::string expression;
 	} parameters = { };
 
@@ -200,7 +354,7 @@ int main (int argc, char** argv)
 	 */
 
 	int option;
-	while ((option = getopt_long (argc, argv, "ml:n:qQv:r:b:f:o:s:p:D:ES::T:", option_array, nullptr)) != -1) {
+	while ((option = getopt_long (argc, argv, "ml:n:qQv:r:b:f:i:o:s:p:j:D:ES::T:B", option_array, nullptr)) != -1) {
 		switch (option) {
 		case ARG_MACHINE_OUTPUT:
 			parameters.output.machine.enabled = true;
@@ -231,12 +385,47 @@ int main (int argc, char** argv)
 			parameters.output.common.quiet = true;
 			break;
 
+		case ARG_STATS:
+			parameters.output.stats.enabled = true;
+			if (optarg && optarg[0]) {
+				parameters.output.stats.file = optarg;
+			}
+			break;
+
+		case ARG_PROFILE_RULES:
+			parameters.output.profile_rules.enabled = true;
+			if (optarg && optarg[0]) {
+				parameters.output.profile_rules.file = optarg;
+			}
+			break;
+
+		case ARG_ELIDE_TERMS: {
+			std::istringstream ss (optarg);
+			ss >> parameters.output.common.elision.terms;
+
+			if (!consumed_entirely (ss)) {
+				ERROR (std::runtime_error, "Could not parse the elided terms limit: '" << optarg << "'");
+			}
+
+			break;
+		}
+
+		case ARG_ELIDE_CHARS: {
+			std::istringstream ss (optarg);
+			ss >> parameters.output.common.elision.characters;
+
+			if (!consumed_entirely (ss)) {
+				ERROR (std::runtime_error, "Could not parse the elided characters limit: '" << optarg << "'");
+			}
+
+			break;
+		}
+
 		case ARG_ADD_VARIABLE: {
 			std::istringstream ss (optarg);
 			parse_variable<data_t> (variables, ss);
-			ss >> std::ws;
 
-			if (ss.fail() || !ss.eof()) {
+			if (!consumed_entirely (ss)) {
 				ERROR (std::runtime_error, "Wrong variable specifier: '" << optarg << "'");
 			}
 
@@ -246,9 +435,8 @@ int main (int argc, char** argv)
 		case ARG_ADD_VARIABLE_FRAC: {
 			std::istringstream ss (optarg);
 			parse_variable<rational_t> (variables, ss);
-			ss >> std::ws;
 
-			if (ss.fail() || !ss.eof()) {
+			if (!consumed_entirely (ss)) {
 				ERROR (std::runtime_error, "Wrong rational variable specifier: '" << optarg << "'");
 			}
 
@@ -258,9 +446,8 @@ int main (int argc, char** argv)
 		case ARG_ADD_VARIABLE_NO_VALUE: {
 			std::istringstream ss (optarg);
 			parse_variable<void> (variables, ss);
-			ss >> std::ws;
 
-			if (ss.fail() || !ss.eof()) {
+			if (!consumed_entirely (ss)) {
 				ERROR (std::runtime_error, "Wrong bare variable specifier: '" << optarg << "'");
 			}
 
@@ -271,11 +458,15 @@ int main (int argc, char** argv)
 			parse_variables_from_file<data_t> (variables, optarg);
 			break;
 
+		case ARG_INPUT_FILE:
+			parameters.input_file = optarg;
+			break;
+
 		case ARG_DERIVATIVE_ORDER: {
 			std::istringstream ss (optarg);
-			ss >> parameters.task.differentiate.order >> std::ws;
+			ss >> parameters.task.differentiate.order;
 
-			if (ss.fail() || !ss.eof()) {
+			if (!consumed_entirely (ss)) {
 				ERROR (std::runtime_error, "Could not parse the derivative order: '" << optarg << "'");
 			}
 
@@ -284,9 +475,9 @@ int main (int argc, char** argv)
 
 		case ARG_SERIES_LENGTH: {
 			std::istringstream ss (optarg);
-			ss >> parameters.task.series.length >> std::ws;
+			ss >> parameters.task.series.length;
 
-			if (ss.fail() || !ss.eof()) {
+			if (!consumed_entirely (ss)) {
 				ERROR (std::runtime_error, "Could not parse the series length: '" << optarg << "'");
 			}
 
@@ -295,15 +486,137 @@ int main (int argc, char** argv)
 
 		case ARG_SERIES_POINT: {
 			std::istringstream ss (optarg);
-			ss >> parameters.task.series.point >> std::ws;
+			ss >> parameters.task.series.point;
 
-			if (ss.fail() || !ss.eof()) {
+			if (!consumed_entirely (ss)) {
 				ERROR (std::runtime_error, "Could not parse the series point: '" << optarg << "'");
 			}
 
 			break;
 		}
 
+		case ARG_JOBS: {
+			std::istringstream ss (optarg);
+			ss >> parameters.execution.jobs;
+
+			if (!consumed_entirely (ss)) {
+				ERROR (std::runtime_error, "Could not parse the jobs count: '" << optarg << "'");
+			}
+
+			break;
+		}
+
+		case ARG_SWEEP:
+			parameters.sweep.axes.push_back (optarg);
+			break;
+
+		case ARG_SWEEP_FORMAT:
+			if (optarg == std::string ("csv")) {
+				parameters.sweep.format = Sweep::Format::CSV;
+			} else if (optarg == std::string ("binary")) {
+				parameters.sweep.format = Sweep::Format::Binary;
+			} else {
+				ERROR (std::runtime_error, "Unknown sweep format: '" << optarg << "'");
+			}
+			break;
+
+		case ARG_SIMPLIFIER:
+			if (optarg == std::string ("classic")) {
+				EGraphSimplifier::options.enabled = false;
+			} else if (optarg == std::string ("egraph")) {
+				EGraphSimplifier::options.enabled = true;
+			} else {
+				ERROR (std::runtime_error, "Unknown simplifier: '" << optarg << "'");
+			}
+			break;
+
+		case ARG_EGRAPH_COST:
+			if (optarg == std::string ("size")) {
+				EGraphSimplifier::options.cost_model = EGraphSimplifier::CostModel::NodeCount;
+			} else if (optarg == std::string ("evaluation")) {
+				EGraphSimplifier::options.cost_model = EGraphSimplifier::CostModel::Evaluation;
+			} else {
+				ERROR (std::runtime_error, "Unknown e-graph cost model: '" << optarg << "'");
+			}
+			break;
+
+		case ARG_EGRAPH_NODE_LIMIT: {
+			std::istringstream ss (optarg);
+			ss >> EGraphSimplifier::options.node_limit;
+
+			if (!consumed_entirely (ss)) {
+				ERROR (std::runtime_error, "Could not parse the e-graph node limit: '" << optarg << "'");
+			}
+
+			break;
+		}
+
+		case ARG_EGRAPH_TIME_LIMIT: {
+			std::istringstream ss (optarg);
+			ss >> EGraphSimplifier::options.time_limit_ms;
+
+			if (!consumed_entirely (ss)) {
+				ERROR (std::runtime_error, "Could not parse the e-graph time limit: '" << optarg << "'");
+			}
+
+			break;
+		}
+
+		case ARG_EGRAPH_ITERATIONS: {
+			std::istringstream ss (optarg);
+			ss >> EGraphSimplifier::options.iteration_limit;
+
+			if (!consumed_entirely (ss)) {
+				ERROR (std::runtime_error, "Could not parse the e-graph iteration limit: '" << optarg << "'");
+			}
+
+			break;
+		}
+
+		case ARG_POLYNOMIAL_TERMS: {
+			std::istringstream ss (optarg);
+			ss >> Visitor::Simplify::options.polynomial_term_limit;
+
+			if (!consumed_entirely (ss)) {
+				ERROR (std::runtime_error, "Could not parse the polynomial term limit: '" << optarg << "'");
+			}
+
+			break;
+		}
+
+		case ARG_BUDGET_NODES: {
+			std::istringstream ss (optarg);
+			ss >> Budget::limits.nodes;
+
+			if (!consumed_entirely (ss)) {
+				ERROR (std::runtime_error, "Could not parse the node budget: '" << optarg << "'");
+			}
+
+			break;
+		}
+
+		case ARG_BUDGET_MEMORY: {
+			std::istringstream ss (optarg);
+			ss >> Budget::limits.memory_mb;
+
+			if (!consumed_entirely (ss)) {
+				ERROR (std::runtime_error, "Could not parse the memory budget: '" << optarg << "'");
+			}
+
+			break;
+		}
+
+		case ARG_BUDGET_TIME: {
+			std::istringstream ss (optarg);
+			ss >> Budget::limits.time_s;
+
+			if (!consumed_entirely (ss)) {
+				ERROR (std::runtime_error, "Could not parse the time budget: '" << optarg << "'");
+			}
+
+			break;
+		}
+
 		case ARG_MODE_DIFFERENTIATE:
 			ASSERT (parameters.task.type == Task::None, "Mode set twice");
 			parameters.task.type = Task::Differentiate;
@@ -329,6 +642,17 @@ int main (int argc, char** argv)
 			parameters.task.series.variable = optarg;
 			break;
 
+		case ARG_MODE_BATCH:
+			ASSERT (parameters.task.type == Task::None, "Mode set twice");
+			parameters.task.type = Task::Batch;
+			break;
+
+		case ARG_MODE_SERVER:
+			ASSERT (parameters.task.type == Task::None, "Mode set twice");
+			parameters.task.type = Task::Server;
+			parameters.task.server.socket = optarg;
+			break;
+
 		default:
 			usage (argv[0]);
 		}
@@ -338,7 +662,17 @@ int main (int argc, char** argv)
 	 * Verify arguments' consistency.
 	 */
 
-	if (optind >= argc) {
+	if (parameters.task.type == Task::Server) {
+		if (optind < argc || !parameters.input_file.empty()) {
+			std::cerr << "No expression expected in server mode." << std::endl;
+			usage (argv[0]);
+		}
+	} else if (!parameters.input_file.empty() || (parameters.task.type == Task::Batch)) {
+		if (optind < argc) {
+			std::cerr << "No expression expected when reading it from a file or in batch mode." << std::endl;
+			usage (argv[0]);
+		}
+	} else if (optind >= argc) {
 		std::cerr << "Expression expected." << std::endl;
 		usage (argv[0]);
 	} else if (optind + 1 < argc) {
@@ -347,7 +681,7 @@ int main (int argc, char** argv)
 	}
 
 	if (parameters.task.type == Task::None) {
-		std::cerr << "One of operation modes ('-D', '-E', '-S' or '-T') is expected." << std::endl;
+		std::cerr << "One of operation modes ('-D', '-E', '-S', '-T', '-B' or '--server') is expected." << std::endl;
 		usage (argv[0]);
 	}
 
@@ -355,7 +689,17 @@ int main (int argc, char** argv)
 	 * Init remaining parameters and configure default values.
 	 */
 
-	parameters.expression = argv[optind];
+	if ((parameters.task.type == Task::Batch) || (parameters.task.type == Task::Server)) {
+		/* the jobs are read later */
+	} else if (parameters.input_file.empty()) {
+		parameters.expression = argv[optind];
+	} else if (parameters.input_file == "-") {
+		parameters.expression.assign (std::istreambuf_iterator<char> (std::cin), std::istreambuf_iterator<char>());
+	} else {
+		std::ifstream input;
+		open (input, parameters.input_file.c_str());
+		parameters.expression.assign (std::istreambuf_iterator<char> (input), std::istreambuf_iterator<char>());
+	}
 
 	if (parameters.output.common.name.empty()) {
 		parameters.output.common.name = "F";
@@ -373,6 +717,137 @@ int main (int argc, char** argv)
 		parameters.output.common.terse = true;
 	}
 
+	if (parameters.execution.jobs == 0) {
+		parameters.execution.jobs = ThreadPool::default_concurrency();
+	}
+
+	Visitor::Simplify::options.jobs = parameters.execution.jobs;
+
+	if (parameters.output.stats.enabled) {
+#ifdef ENABLE_STATS
+		Stats::enable();
+#else // ENABLE_STATS
+		ERROR (std::runtime_error, "Statistics are not available: the program has been built without ENABLE_STATS");
+#endif // ENABLE_STATS
+	}
+
+	if (parameters.output.profile_rules.enabled) {
+		Visitor::Simplify::enable_profile();
+	}
+
+	/*
+	 * In batch and server modes, process the jobs and that's it.
+	 */
+
+	if (parameters.task.type == Task::Server) {
+		Batch::Options options;
+		options.jobs = parameters.execution.jobs;
+		options.name = parameters.output.machine.name;
+
+		Batch batch (variables, options);
+		Server server (batch, parameters.task.server.socket, parameters.execution.jobs);
+		server.run();
+
+		return 0;
+	}
+
+	if (parameters.task.type == Task::Batch) {
+		Batch::Options options;
+		options.jobs = parameters.execution.jobs;
+		options.name = parameters.output.machine.name;
+
+		/* let the input buffer tell whether more jobs are at hand */
+		std::ios::sync_with_stdio (false);
+
+		Batch batch (variables, options);
+
+		if (parameters.input_file.empty() || (parameters.input_file == "-")) {
+			batch.run (std::cin, std::cout);
+		} else {
+			std::ifstream input;
+			open (input, parameters.input_file.c_str());
+			input.exceptions (std::ifstream::badbit);
+			batch.run (input, std::cout);
+		}
+
+		return 0;
+	}
+
+	/*
+	 * In sweep mode, compile the expression (and its derivative or error) and evaluate it over the grid.
+	 */
+
+	if (!parameters.sweep.axes.empty()) {
+		VERIFY ((parameters.task.type == Task::Simplify) ||
+		        (parameters.task.type == Task::Differentiate) ||
+		        (parameters.task.type == Task::CalculateError),
+		        std::runtime_error, "Sweep is only supported with '-S', '-D' or '-E'");
+
+		std::vector<Sweep::Axis> axes;
+
+		for (const std::string& spec: parameters.sweep.axes) {
+			axes.push_back (Sweep::Axis::parse (spec));
+
+			/* the swept variables are never substituted; they need not be defined */
+			variables[axes.back().name].do_not_substitute = true;
+		}
+
+		Sweep::Options options;
+		options.jobs = parameters.execution.jobs;
+		options.format = parameters.sweep.format;
+
+		Sweep sweep (std::move (axes), options);
+		const std::string& name = parameters.output.machine.name;
+
+		Node::Base::Ptr expression_raw = Parser (parameters.expression, variables).parse();
+		Node::Base::Ptr expression = parameters.task.simplify.variable.empty() ? simplify_tree (expression_raw.get())
+		                                                                       : simplify_tree (expression_raw.get(), parameters.task.simplify.variable);
+		sweep.add_column (name, *expression);
+
+		Node::Base::Ptr derivative;
+
+		if (parameters.task.type == Task::Differentiate) {
+			const std::string& variable = parameters.task.differentiate.variable;
+			unsigned order = parameters.task.differentiate.order;
+
+			derivative = differentiate (expression.get(), variable, order);
+			sweep.add_column ((order == 1) ? "d" + name + "/d" + variable
+			                               : BUILD_STRING ("d^" << order << name << "/d" << variable << "^" << order),
+			                  *derivative);
+		} else if (parameters.task.type == Task::CalculateError) {
+			std::set<std::string> partial_variables;
+
+			for (const Variable::Map::value_type& var: variables) {
+				if (!var.second.no_error()) {
+					partial_variables.insert (var.first);
+				}
+			}
+
+			std::map<std::string, Node::Base::Ptr> partials = gradient (expression.get(), partial_variables, parameters.execution.jobs);
+			std::map<std::string, const Node::Base*> partial_trees;
+
+			for (const auto& partial: partials) {
+				partial_trees.emplace (partial.first, partial.second.get());
+			}
+
+			Node::Base::Ptr error_sqrt = error_tree (partial_trees, variables);
+			derivative = simplify_tree (error_sqrt.get());
+			sweep.add_column ("Δ" + name, *derivative);
+		}
+
+		sweep.run (std::cout);
+
+		if (parameters.output.stats.enabled) {
+			write_stats (parameters.output.stats.file);
+		}
+
+		if (parameters.output.profile_rules.enabled) {
+			write_rule_profile (parameters.output.profile_rules.file);
+		}
+
+		return 0;
+	}
+
 	/*
 	 * Dump the input data to stderr (if not quiet).
 	 */
@@ -383,7 +858,13 @@ int main (int argc, char** argv)
 		std::string name = parameters.output.common.name + "(...)";
 		auto align = std::setw (name.length());
 
-		std::cerr << name << " = " << parameters.expression << std::endl;
+		size_t limit = parameters.output.common.elision.characters;
+
+		if (limit && (parameters.expression.size() > limit)) {
+			std::cerr << name << " = " << parameters.expression.substr (0, limit) << " …" << std::endl;
+		} else {
+			std::cerr << name << " = " << parameters.expression << std::endl;
+		}
 
 		for (Variable::Map::value_type& var: variables) {
 			std::cerr << align << var.first;
@@ -404,22 +885,38 @@ int main (int argc, char** argv)
 	 * We store original (parsed) and simplified trees separately and check if there was anything to simplify.
 	 */
 
-	Node::Base::Ptr expression_raw = Parser (parameters.expression, variables).parse();
+	Node::Base::Ptr expression_raw;
 	Expression expression;
 	bool expression_simplified;
 
-	if (parameters.task.simplify.variable.empty()) {
-		if (!parameters.output.common.terse) {
-			std::cerr << "Will simplify the expression generally." << std::endl
-			          << std::endl;
-		}
-		expression.tree = simplify_tree (expression_raw.get());
-	} else {
-		if (!parameters.output.common.terse) {
-			std::cerr << "Will simplify the expression for variable '" << parameters.task.simplify.variable << "'." << std::endl
-			          << std::endl;
+	{
+		STATS_PHASE (stats, "parse");
+		expression_raw = Parser (parameters.expression, variables).parse();
+		STATS_OUTPUT (stats, *expression_raw);
+	}
+
+	try {
+		STATS_PHASE (stats, "simplify");
+		STATS_INPUT (stats, *expression_raw);
+
+		if (parameters.task.simplify.variable.empty()) {
+			if (!parameters.output.common.terse) {
+				std::cerr << "Will simplify the expression generally." << std::endl
+				          << std::endl;
+			}
+			expression.tree = simplify_tree (expression_raw.get());
+		} else {
+			if (!parameters.output.common.terse) {
+				std::cerr << "Will simplify the expression for variable '" << parameters.task.simplify.variable << "'." << std::endl
+				          << std::endl;
+			}
+			expression.tree = simplify_tree (expression_raw.get(), parameters.task.simplify.variable);
 		}
-		expression.tree = simplify_tree (expression_raw.get(), parameters.task.simplify.variable);
+
+		STATS_OUTPUT (stats, *expression.tree);
+	} catch (BudgetExceeded& e) {
+		warn_budget_exceeded (e, "using the expression as is", parameters.output.common.quiet);
+		expression.tree = expression_raw->clone();
 	}
 
 	expression_simplified = !expression.tree->compare (expression_raw);
@@ -472,10 +969,59 @@ int main (int argc, char** argv)
 	 * (FIXME: really? it'd be better to collect usage flags for all variables during parsing.)
 	 */
 
+	/*
+	 * For the error, all first-order partial derivatives are built in a single traversal of the expression
+	 * (or a few concurrent traversals for disjoint groups of variables).
+	 */
+
+	/*
+	 * If the symbolic differentiation exceeds the budget, the values of the derivatives are computed
+	 * numerically (by Taylor-mode automatic differentiation) and the trees are left empty.
+	 */
+
+	std::map<std::string, Node::Base::Ptr> partials;
+	bool numeric_differentials = false;
+
+	if (parameters.task.type == Task::CalculateError) {
+		std::set<std::string> partial_variables;
+
+		for (const Differential& d: differentials) {
+			partial_variables.insert (d.variable);
+		}
+
+		try {
+			STATS_PHASE (stats, "gradient");
+			STATS_INPUT (stats, *expression.tree);
+
+			partials = gradient (expression.tree.get(), partial_variables, parameters.execution.jobs);
+
+			for (const auto& partial: partials) {
+				STATS_OUTPUT (stats, *partial.second);
+			}
+		} catch (BudgetExceeded& e) {
+			warn_budget_exceeded (e, "computing the partial derivatives numerically", parameters.output.common.quiet);
+			numeric_differentials = true;
+		}
+	}
+
 	for (auto it = differentials.begin(); it != differentials.end(); ) {
 		const Differential& d = *it;
 
-		d.expression.tree = differentiate (expression.tree.get(), d.variable, d.order);
+		if (numeric_differentials) {
+			d.expression.value = derivative_value (expression.tree.get(), d.variable, d.order);
+		} else if (parameters.task.type == Task::CalculateError) {
+			auto partial = partials.find (d.variable);
+			d.expression.tree = (partial != partials.end()) ? std::move (partial->second)
+			                                                : Node::Base::Ptr (new Node::Value (0));
+		} else {
+			try {
+				d.expression.tree = differentiate (expression.tree.get(), d.variable, d.order);
+			} catch (BudgetExceeded& e) {
+				warn_budget_exceeded (e, "computing the derivative numerically", parameters.output.common.quiet);
+				d.expression.value = derivative_value (expression.tree.get(), d.variable, d.order);
+			}
+		}
+
 		d.expression.compute (BUILD_STRING ("differential of order " << d.order << " for variable '" << d.variable << "'").c_str(), parameters.output.common.quiet);
 
 		Node::Value* differential_value = dynamic_cast<Node::Value*> (d.expression.tree.get());
@@ -492,39 +1038,49 @@ int main (int argc, char** argv)
 
 	Expression error;
 
-	if (parameters.task.type == Task::CalculateError) {
-		Node::AdditionSubtraction::Ptr error_sq_sum (new Node::AdditionSubtraction);
+	if ((parameters.task.type == Task::CalculateError) && numeric_differentials) {
+		data_t error_sq_sum = 0;
+		bool computable = true;
 
 		for (const Differential& d: differentials) {
-			ASSERT (d.order == 1, "Differential for variable '" << d.variable << "' has unexpected order (" << d.order << ") while computing error");
-
-			auto var = variables.find (d.variable);
-			ASSERT (var != variables.end(), "Cannot find variable '" << d.variable << "' while computing error, despite differential exists");
+			const Variable& var = variables.at (d.variable);
 
-			if (var->second.no_error()) {
-				continue;
+			if (d.expression.value.empty()) {
+				computable = false;
+				break;
 			}
 
-			Node::Variable::Ptr error (new Node::Variable (var->first, var->second, true));
+			data_t partial = any_to_fp (d.expression.value) * any_to_fp (var.error);
+			error_sq_sum += partial * partial;
+		}
 
-			// dF/dx * error(x)
-			Node::MultiplicationDivision::Ptr partial (new Node::MultiplicationDivision);
-			partial->add_child (d.expression.tree->clone(), false);
-			partial->add_child (std::move (error), false);
+		if (computable) {
+			error.value = data_t (sqrtl (error_sq_sum));
+		}
 
-			// (dF/dx * error(x))^2
-			Node::Power::Ptr partial_sq (new Node::Power);
-			partial_sq->set_base (std::move (partial));
-			partial_sq->set_exponent (Node::Base::Ptr (new Node::Value (2)));
+		error.compute ("expression error value", parameters.output.common.quiet);
+	} else if (parameters.task.type == Task::CalculateError) {
+		std::map<std::string, const Node::Base*> partial_trees;
 
-			error_sq_sum->add_child (std::move (partial_sq), false);
+		for (const Differential& d: differentials) {
+			ASSERT (d.order == 1, "Differential for variable '" << d.variable << "' has unexpected order (" << d.order << ") while computing error");
+			partial_trees.emplace (d.variable, d.expression.tree.get());
 		}
 
-		Node::Power::Ptr error_sqrt (new Node::Power);
-		error_sqrt->set_base (std::move (error_sq_sum));
-		error_sqrt->set_exponent (Node::Base::Ptr (new Node::Value (rational_t (1, 2))));
+		{
+			STATS_PHASE (stats, "error");
+			Node::Base::Ptr error_sqrt = error_tree (partial_trees, variables);
+			STATS_INPUT (stats, *error_sqrt);
 
-		error.tree = simplify_tree (error_sqrt.get());
+			try {
+				error.tree = simplify_tree (error_sqrt.get());
+			} catch (BudgetExceeded& e) {
+				warn_budget_exceeded (e, "leaving the error expression unsimplified", parameters.output.common.quiet);
+				error.tree = std::move (error_sqrt);
+			}
+
+			STATS_OUTPUT (stats, *error.tree);
+		}
 
 		error.compute ("expression error value", parameters.output.common.quiet);
 	}
@@ -537,21 +1093,21 @@ int main (int argc, char** argv)
 	Expression series;
 
 	if (parameters.task.type == Task::Series) {
+		/* includes the evaluation of the derivatives, which are recorded separately as well */
+		STATS_PHASE (stats, "series");
+		STATS_INPUT (stats, *expression.tree);
+
 		auto var = variables.find (parameters.task.series.variable);
 		VERIFY (var != variables.end(), std::runtime_error, "Cannot find variable '" << parameters.task.series.variable << "' while computing Taylor series");
 
 		Node::AdditionSubtraction::Ptr sum (new Node::AdditionSubtraction);
 		Visitor::Calculate calculator;
+		DerivativeTower tower (*expression.tree, parameters.task.series.variable);
 		Expression derivative;
+		std::vector<boost::any> coefficients;
 		integer_t denominator = 1;
 		unsigned current_order = 0;
 
-		/*
-		 * FIXME: allow Expression to operate on trees owned by someone else.
-		 */
-
-		derivative.tree = expression.tree->clone();
-
 		/*
 		 * Set the temporary value for the function variable while differentiating.
 		 */
@@ -569,13 +1125,35 @@ int main (int argc, char** argv)
 			 * Add the next term to the Taylor series, if it is non-zero.
 			 */
 
-			derivative.compute (BUILD_STRING ("differential of order " << current_order << " for variable '" << parameters.task.series.variable << "'").c_str(), parameters.output.common.quiet);
-
-			if (!any_isa<rational_t> (derivative.value)) {
-				ERROR (std::runtime_error, "Cannot build the Taylor series: derivative of order " << current_order << " is not rational or cannot be computed");
+			if (coefficients.empty()) {
+				try {
+					Budget::Scope budget;
+					/* FIXME: allow Expression to operate on trees owned by someone else. */
+					derivative.tree = tower.get (current_order)->clone();
+				} catch (BudgetExceeded& e) {
+					/* the coefficients are computed numerically, all at once */
+					warn_budget_exceeded (e, "computing the series coefficients numerically", parameters.output.common.quiet);
+					coefficients = taylor_coefficients (expression.tree.get(), parameters.task.series.variable, parameters.task.series.length);
+				}
 			}
 
-			rational_t multiplier = any_to_rational (derivative.value) / denominator;
+			rational_t multiplier;
+
+			if (!coefficients.empty()) {
+				if (!any_isa<rational_t> (coefficients[current_order])) {
+					ERROR (std::runtime_error, "Cannot build the Taylor series: coefficient of order " << current_order << " is not rational");
+				}
+
+				multiplier = any_to_rational (coefficients[current_order]);
+			} else {
+				derivative.compute (BUILD_STRING ("differential of order " << current_order << " for variable '" << parameters.task.series.variable << "'").c_str(), parameters.output.common.quiet);
+
+				if (!any_isa<rational_t> (derivative.value)) {
+					ERROR (std::runtime_error, "Cannot build the Taylor series: derivative of order " << current_order << " is not rational or cannot be computed");
+				}
+
+				multiplier = any_to_rational (derivative.value) / denominator;
+			}
 
 			if (multiplier.numerator() != 0) {
 				Node::Base::Ptr term (new Node::Value (multiplier));
@@ -613,11 +1191,9 @@ int main (int argc, char** argv)
 			}
 
 			/*
-			 * Build the next derivative.
+			 * Advance to the next derivative (the tower builds it incrementally from the previous one).
 			 */
 
-			derivative.tree = differentiate (derivative.tree.get(), parameters.task.series.variable);
-
 			++current_order;
 			denominator *= current_order;
 		}
@@ -632,7 +1208,14 @@ int main (int argc, char** argv)
 		 * Finally simplify, save and compute the Taylor series.
 		 */
 
-		series.tree = simplify_tree (sum.get());
+		try {
+			series.tree = simplify_tree (sum.get());
+		} catch (BudgetExceeded& e) {
+			warn_budget_exceeded (e, "leaving the series unsimplified", parameters.output.common.quiet);
+			series.tree = std::move (sum);
+		}
+
+		STATS_OUTPUT (stats, *series.tree);
 
 		series.compute ("expression Taylor series", parameters.output.common.quiet);
 	}
@@ -653,6 +1236,8 @@ int main (int argc, char** argv)
 	 */
 
 	if (!parameters.output.common.terse) {
+		STATS_PHASE (stats, "print");
+
 		std::cerr << "Calculation:" << std::endl;
 
 		print_expression_aligned (std::cerr,
@@ -660,7 +1245,8 @@ int main (int argc, char** argv)
 		                          expression_raw.get(),
 		                          expression_simplified ? expression.tree.get()
 		                                                : nullptr,
-		                          expression.value);
+		                          expression.value,
+		                          parameters.output.common.elision);
 
 		std::cerr << std::endl;
 
@@ -681,7 +1267,8 @@ int main (int argc, char** argv)
 			                          name,
 			                          d.expression.tree.get(),
 			                          nullptr,
-			                          d.expression.value);
+			                          d.expression.value,
+			                          parameters.output.common.elision);
 
 			std::cerr << std::endl;
 		}
@@ -694,7 +1281,8 @@ int main (int argc, char** argv)
 			                          name,
 			                          error.tree.get(),
 			                          nullptr,
-			                          error.value);
+			                          error.value,
+			                          parameters.output.common.elision);
 
 			std::cerr << std::endl;
 		}
@@ -707,15 +1295,19 @@ int main (int argc, char** argv)
 			                          name,
 			                          series.tree.get(),
 			                          nullptr,
-			                          series.value);
+			                          series.value,
+			                          parameters.output.common.elision);
 
 			std::cerr << std::endl;
 		}
 	} else if (!parameters.output.common.quiet) {
+		STATS_PHASE (stats, "print");
+
 		std::cerr << parameters.output.common.name << "(...) = ";
 
 		print_expression_terse (std::cerr,
-		                        expression_raw.get());
+		                        expression_raw.get(),
+		                        parameters.output.common.elision);
 
 		std::cerr << " = ";
 
@@ -737,6 +1329,8 @@ int main (int argc, char** argv)
 	 */
 
 	if (parameters.output.latex.enabled) {
+		STATS_PHASE (stats, "latex");
+
 		if (expression_simplified) {
 			latex_document->print (parameters.output.latex.name,
 			                       expression_raw.get(),
@@ -749,6 +1343,10 @@ int main (int argc, char** argv)
 		                       expression.value);
 
 		for (const Differential& d: differentials) {
+			if (!d.expression.tree) {
+				continue;
+			}
+
 			std::string name;
 
 			if (d.order == 1) {
@@ -765,7 +1363,7 @@ int main (int argc, char** argv)
 			                       d.expression.value);
 		}
 
-		if (parameters.task.type == Task::CalculateError) {
+		if ((parameters.task.type == Task::CalculateError) && error.tree) {
 			latex_document->print ("\\sigma " + parameters.output.latex.name,
 			                       error.tree.get(),
 			                       true,
@@ -778,6 +1376,9 @@ int main (int argc, char** argv)
 			                       true,
 			                       series.value);
 		}
+
+		/* finish the document and render it */
+		latex_document.reset();
 	}
 
 	/*
@@ -799,5 +1400,13 @@ int main (int argc, char** argv)
 		std::cout << std::endl;
 	}
 
+	if (parameters.output.stats.enabled) {
+		write_stats (parameters.output.stats.file);
+	}
+
+	if (parameters.output.profile_rules.enabled) {
+		write_rule_profile (parameters.output.profile_rules.file);
+	}
+
 	return 0;
 }
@@ -32,8 +32,8 @@ Base::Ptr Function::clone() const
 Base::Ptr Power::clone() const
 {
 	Node::Power::Ptr result (new Node::Power);
-	result->set_base (base_->clone());
-	result->set_exponent (exponent_->clone());
+	result->set_base (DeepStack::call ([this] { return base_->clone(); }));
+	result->set_exponent (DeepStack::call ([this] { return exponent_->clone(); }));
 	return std::move (result);
 }
 
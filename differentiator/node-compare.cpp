@@ -3,35 +3,35 @@
 namespace Node
 {
 
-bool Base::compare (const Base::Ptr& rhs) const
+bool Base::compare (const Base& rhs) const
 {
-	if (typeid (*this) == typeid (*rhs.get())) {
-		return compare_same_type (rhs);
+	if (typeid (*this) == typeid (rhs)) {
+		return DeepStack::call ([&] { return compare_same_type (rhs); });
 	} else {
 		return false;
 	}
 }
 
-bool Base::less (const Base::Ptr& rhs) const
+int Base::collate (const Base& rhs) const
 {
-	if (typeid (*this) == typeid (*rhs.get())) {
-		return less_same_type (rhs);
+	if (typeid (*this) == typeid (rhs)) {
+		return DeepStack::call ([&] { return collate_same_type (rhs); });
 	} else {
-		return get_type() < rhs->get_type();
+		return (get_type() < rhs.get_type()) ? -1 : 1;
 	}
 }
 
 #define COMPARE_CHECK_TYPE(Type)                             \
-	const Type* node = static_cast<const Type*> (rhs.get()); \
+	const Type* node = static_cast<const Type*> (&rhs);       \
 
-bool Value::compare_same_type (const Base::Ptr& rhs) const
+bool Value::compare_same_type (const Base& rhs) const
 {
 	COMPARE_CHECK_TYPE(Value);
 
 	return (value_ == node->value_);
 }
 
-bool Variable::compare_same_type (const Base::Ptr& rhs) const
+bool Variable::compare_same_type (const Base& rhs) const
 {
 	COMPARE_CHECK_TYPE(Variable);
 
@@ -39,7 +39,7 @@ bool Variable::compare_same_type (const Base::Ptr& rhs) const
 	       (is_error_ == node->is_error_);
 }
 
-bool Function::compare_same_type (const Base::Ptr& rhs) const
+bool Function::compare_same_type (const Base& rhs) const
 {
 	COMPARE_CHECK_TYPE(Function);
 
@@ -47,7 +47,7 @@ bool Function::compare_same_type (const Base::Ptr& rhs) const
 	       (children_ == node->children_);
 }
 
-bool Power::compare_same_type (const Base::Ptr& rhs) const
+bool Power::compare_same_type (const Base& rhs) const
 {
 	COMPARE_CHECK_TYPE(Power);
 
@@ -55,14 +55,14 @@ bool Power::compare_same_type (const Base::Ptr& rhs) const
 	       exponent_->compare (node->exponent_);
 }
 
-bool AdditionSubtraction::compare_same_type (const Base::Ptr& rhs) const
+bool AdditionSubtraction::compare_same_type (const Base& rhs) const
 {
 	COMPARE_CHECK_TYPE(AdditionSubtraction);
 
 	return children_ == node->children_;
 }
 
-bool MultiplicationDivision::compare_same_type (const Base::Ptr& rhs) const
+bool MultiplicationDivision::compare_same_type (const Base& rhs) const
 {
 	COMPARE_CHECK_TYPE(MultiplicationDivision);
 
@@ -70,56 +70,80 @@ bool MultiplicationDivision::compare_same_type (const Base::Ptr& rhs) const
 }
 
 
-#define LEXICOGRAPHICAL_COMPARE_CHAIN(less, equal) \
-	if (less) return true;                         \
-	else if (!(equal)) return false;
+/*
+ * Three-way comparisons: each subtree pair is traversed once, unlike a chain of less() and compare() calls
+ * which visits every nested level twice (and thus has exponential cost in the depth of the tree).
+ */
 
-#define LEXICOGRAPHICAL_COMPARE_LAST(less)         \
-	return (less);
+template <typename T>
+int collate_values (const T& lhs, const T& rhs)
+{
+	return (lhs < rhs) ? -1 : (rhs < lhs) ? 1 : 0;
+}
 
-bool Value::less_same_type (const Base::Ptr& rhs) const
+template <typename Container>
+int collate_children (const Container& lhs, const Container& rhs)
+{
+	auto l = lhs.begin(), r = rhs.begin();
+
+	for (; (l != lhs.end()) && (r != rhs.end()); ++l, ++r) {
+		if (int result = l->collate (*r)) {
+			return result;
+		}
+	}
+
+	return (l != lhs.end()) ? 1 : (r != rhs.end()) ? -1 : 0;
+}
+
+#define LEXICOGRAPHICAL_COLLATE_CHAIN(collate) \
+	if (int result = (collate)) return result;
+
+#define LEXICOGRAPHICAL_COLLATE_LAST(collate)  \
+	return (collate);
+
+int Value::collate_same_type (const Base& rhs) const
 {
 	COMPARE_CHECK_TYPE(Value);
 
-	LEXICOGRAPHICAL_COMPARE_LAST(value_ < node->value_);
+	LEXICOGRAPHICAL_COLLATE_LAST(collate_values (value_, node->value_));
 }
 
-bool Variable::less_same_type (const Base::Ptr& rhs) const
+int Variable::collate_same_type (const Base& rhs) const
 {
 	COMPARE_CHECK_TYPE(Variable);
 
-	LEXICOGRAPHICAL_COMPARE_CHAIN(is_error_ < node->is_error_,
-	                              is_error_ == node->is_error_);
-	LEXICOGRAPHICAL_COMPARE_LAST(name_ < node->name_);
+	LEXICOGRAPHICAL_COLLATE_CHAIN(collate_values (is_error_, node->is_error_));
+	LEXICOGRAPHICAL_COLLATE_LAST(name_.compare (node->name_));
 }
 
-bool Function::less_same_type (const Base::Ptr& rhs) const
+int Function::collate_same_type (const Base& rhs) const
 {
 	COMPARE_CHECK_TYPE(Function);
 
-	LEXICOGRAPHICAL_COMPARE_LAST(name_ < node->name_);
+	LEXICOGRAPHICAL_COLLATE_CHAIN(name_.compare (node->name_));
+	LEXICOGRAPHICAL_COLLATE_LAST(collate_children (children_, node->children_));
 }
 
-bool Power::less_same_type (const Base::Ptr& rhs) const
+int Power::collate_same_type (const Base& rhs) const
 {
 	COMPARE_CHECK_TYPE(Power);
 
-	LEXICOGRAPHICAL_COMPARE_CHAIN(exponent_->less (node->exponent_),
-	                              exponent_->compare (node->exponent_));
-	LEXICOGRAPHICAL_COMPARE_LAST(base_->less (node->base_));
+	LEXICOGRAPHICAL_COLLATE_CHAIN(exponent_->collate (*node->exponent_));
+	LEXICOGRAPHICAL_COLLATE_LAST(base_->collate (*node->base_));
 }
 
-bool AdditionSubtraction::less_same_type (const Base::Ptr& rhs) const
+int AdditionSubtraction::collate_same_type (const Base& rhs) const
 {
 	COMPARE_CHECK_TYPE(AdditionSubtraction);
 
-	LEXICOGRAPHICAL_COMPARE_LAST(children_ < node->children_);
+	LEXICOGRAPHICAL_COLLATE_LAST(collate_children (children_, node->children_));
 }
 
-bool MultiplicationDivision::less_same_type (const Base::Ptr& rhs) const
+int MultiplicationDivision::collate_same_type (const Base& rhs) const
 {
 	COMPARE_CHECK_TYPE(MultiplicationDivision);
 
-	LEXICOGRAPHICAL_COMPARE_LAST(children_ < node->children_);
+	LEXICOGRAPHICAL_COLLATE_LAST(collate_children (children_, node->children_));
 }
+
 } // namespace Node
@@ -32,7 +32,7 @@ void Function::Dump (std::ostream& str) const
 
 	for (const auto& child: children_) {
 		str << " ";
-		child.node->Dump (str);
+		DeepStack::call ([&] { child.node->Dump (str); });
 	}
 
 	str << ")";
@@ -41,9 +41,9 @@ void Function::Dump (std::ostream& str) const
 void Power::Dump (std::ostream& str) const
 {
 	str << "( ** ";
-	base_->Dump (str);
+	DeepStack::call ([&] { base_->Dump (str); });
 	str << " ";
-	exponent_->Dump (str);
+	DeepStack::call ([&] { exponent_->Dump (str); });
 	str << " )";
 }
 
@@ -53,7 +53,7 @@ void AdditionSubtraction::Dump (std::ostream& str) const
 
 	for (auto& child: children_) {
 		str << " " << (child.tag.negated ? "-" : "+") << " ";
-		child.node->Dump (str);
+		DeepStack::call ([&] { child.node->Dump (str); });
 	}
 
 	str << ")";
@@ -65,7 +65,7 @@ void MultiplicationDivision::Dump (std::ostream& str) const
 
 	for (auto& child: children_) {
 		str << " " << (child.tag.reciprocated ? "/" : "*") << " ";
-		child.node->Dump (str);
+		DeepStack::call ([&] { child.node->Dump (str); });
 	}
 
 	str << ")";
@@ -0,0 +1,218 @@
+#include "node.h"
+
+#include <atomic>
+
+namespace {
+
+/* a live count with its high-water mark */
+struct Counter
+{
+	std::atomic<size_t> value, peak;
+
+	void add (size_t amount)
+	{
+		size_t current = value.fetch_add (amount, std::memory_order_relaxed) + amount,
+		       highest = peak.load (std::memory_order_relaxed);
+
+		while ((current > highest) && !peak.compare_exchange_weak (highest, current, std::memory_order_relaxed)) {
+		}
+	}
+
+	void sub (size_t amount)
+	{
+		value.fetch_sub (amount, std::memory_order_relaxed);
+	}
+
+	/* returns the previous high-water mark */
+	size_t reset_peak()
+	{
+		return peak.exchange (value.load (std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+
+	void merge_peak (size_t previous)
+	{
+		size_t highest = peak.load (std::memory_order_relaxed);
+
+		while ((previous > highest) && !peak.compare_exchange_weak (highest, previous, std::memory_order_relaxed)) {
+		}
+	}
+};
+
+Counter nodes[Node::Memory::type_count], node_bytes, container_bytes, value_bytes, total_bytes;
+
+bool enabled = false;
+
+/* in the order of TypeOrdered */
+const size_t node_sizes[Node::Memory::type_count] = {
+	sizeof (Node::Value),
+	sizeof (Node::Function),
+	sizeof (Node::Variable),
+	sizeof (Node::Power),
+	sizeof (Node::MultiplicationDivision),
+	sizeof (Node::AdditionSubtraction)
+};
+
+const char* const type_names[Node::Memory::type_count] = {
+	"Value",
+	"Function",
+	"Variable",
+	"Power",
+	"MultiplicationDivision",
+	"AdditionSubtraction"
+};
+
+size_t heap_bytes (const integer_t& value)
+{
+	const auto& backend = value.backend();
+	return (backend.capacity() > backend.internal_limb_count) ? backend.capacity() * sizeof (boost::multiprecision::limb_type) : 0;
+}
+
+} // anonymous namespace
+
+namespace Node
+{
+
+namespace Memory
+{
+
+Usage current()
+{
+	Usage result;
+
+	for (size_t i = 0; i < type_count; ++i) {
+		result.nodes[i] = ::nodes[i].value.load (std::memory_order_relaxed);
+	}
+	result.node_bytes = ::node_bytes.value.load (std::memory_order_relaxed);
+	result.container_bytes = ::container_bytes.value.load (std::memory_order_relaxed);
+	result.value_bytes = ::value_bytes.value.load (std::memory_order_relaxed);
+	result.total_bytes = ::total_bytes.value.load (std::memory_order_relaxed);
+
+	return result;
+}
+
+Usage peak()
+{
+	Usage result;
+
+	for (size_t i = 0; i < type_count; ++i) {
+		result.nodes[i] = ::nodes[i].peak.load (std::memory_order_relaxed);
+	}
+	result.node_bytes = ::node_bytes.peak.load (std::memory_order_relaxed);
+	result.container_bytes = ::container_bytes.peak.load (std::memory_order_relaxed);
+	result.value_bytes = ::value_bytes.peak.load (std::memory_order_relaxed);
+	result.total_bytes = ::total_bytes.peak.load (std::memory_order_relaxed);
+
+	return result;
+}
+
+Usage reset_peaks()
+{
+	Usage result;
+
+	for (size_t i = 0; i < type_count; ++i) {
+		result.nodes[i] = ::nodes[i].reset_peak();
+	}
+	result.node_bytes = ::node_bytes.reset_peak();
+	result.container_bytes = ::container_bytes.reset_peak();
+	result.value_bytes = ::value_bytes.reset_peak();
+	result.total_bytes = ::total_bytes.reset_peak();
+
+	return result;
+}
+
+void merge_peaks (const Usage& previous)
+{
+	for (size_t i = 0; i < type_count; ++i) {
+		::nodes[i].merge_peak (previous.nodes[i]);
+	}
+	::node_bytes.merge_peak (previous.node_bytes);
+	::container_bytes.merge_peak (previous.container_bytes);
+	::value_bytes.merge_peak (previous.value_bytes);
+	::total_bytes.merge_peak (previous.total_bytes);
+}
+
+const char* type_name (TypeOrdered type)
+{
+	return type_names[static_cast<size_t> (type)];
+}
+
+void enable()
+{
+	ASSERT (Base::live_count() == 0, "Memory accounting enabled while trees exist");
+	::enabled = true;
+}
+
+#ifdef ENABLE_STATS
+
+void node_created (TypeOrdered type)
+{
+	if (!::enabled) {
+		return;
+	}
+
+	size_t size = node_sizes[static_cast<size_t> (type)];
+
+	::nodes[static_cast<size_t> (type)].add (1);
+	::node_bytes.add (size);
+	::total_bytes.add (size);
+}
+
+void node_destroyed (TypeOrdered type)
+{
+	if (!::enabled) {
+		return;
+	}
+
+	size_t size = node_sizes[static_cast<size_t> (type)];
+
+	::nodes[static_cast<size_t> (type)].sub (1);
+	::node_bytes.sub (size);
+	::total_bytes.sub (size);
+}
+
+void containers_grown (size_t bytes)
+{
+	if (!::enabled) {
+		return;
+	}
+
+	::container_bytes.add (bytes);
+	::total_bytes.add (bytes);
+}
+
+void containers_shrunk (size_t bytes)
+{
+	if (!::enabled) {
+		return;
+	}
+
+	::container_bytes.sub (bytes);
+	::total_bytes.sub (bytes);
+}
+
+void values_grown (size_t bytes)
+{
+	if (::enabled && bytes) {
+		::value_bytes.add (bytes);
+		::total_bytes.add (bytes);
+	}
+}
+
+void values_shrunk (size_t bytes)
+{
+	if (::enabled && bytes) {
+		::value_bytes.sub (bytes);
+		::total_bytes.sub (bytes);
+	}
+}
+
+#endif // ENABLE_STATS
+
+size_t heap_bytes (const rational_t& value)
+{
+	return ::heap_bytes (value.numerator()) + ::heap_bytes (value.denominator());
+}
+
+} // namespace Memory
+
+} // namespace Node
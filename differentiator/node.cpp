@@ -1,5 +1,25 @@
 #include "node.h"
 #include "visitor.h"
+#include "budget.h"
+
+#include <atomic>
+
+namespace {
+
+std::atomic<size_t> live_nodes (0), peak_nodes (0);
+
+void node_created()
+{
+	size_t live = live_nodes.fetch_add (1, std::memory_order_relaxed) + 1,
+	       peak = peak_nodes.load (std::memory_order_relaxed);
+
+	while ((live > peak) && !peak_nodes.compare_exchange_weak (peak, live, std::memory_order_relaxed)) {
+	}
+
+	Budget::node_created();
+}
+
+} // anonymous namespace
 
 namespace Node
 {
@@ -10,16 +30,104 @@ std::ostream& operator<< (std::ostream& out, const Node::Base& node)
 	return out;
 }
 
-Base::~Base() = default;
+Base::Base()
+{
+	node_created();
+}
+
+Base::Base (const Base&)
+{
+	node_created();
+}
+
+Base::~Base()
+{
+	live_nodes.fetch_sub (1, std::memory_order_relaxed);
+	Budget::node_destroyed();
+}
+
+/*
+ * Destruction of a subtree is iterative: destructors of the nodes hand their children over to a queue
+ * of the thread, which is emptied by the outermost destructor, one node at a time.
+ */
+
+void Base::dispose (Ptr& node)
+{
+	thread_local std::vector<Base*> pending;
+	thread_local bool draining = false;
+
+	if (!node) {
+		return;
+	}
+
+	pending.push_back (node.release());
+
+	if (draining) {
+		return;
+	}
+
+	draining = true;
+
+	while (!pending.empty()) {
+		Base* next = pending.back();
+		pending.pop_back();
+		delete next;
+	}
+
+	draining = false;
+}
+
+size_t Base::live_count()
+{
+	return live_nodes.load (std::memory_order_relaxed);
+}
+
+size_t Base::peak_count()
+{
+	return peak_nodes.load (std::memory_order_relaxed);
+}
+
+void Base::reset_peak_count()
+{
+	peak_nodes.store (live_nodes.load (std::memory_order_relaxed), std::memory_order_relaxed);
+}
 
 Value::Value (rational_t value)
 : value_ (value)
 {
+	Memory::values_grown (Memory::heap_bytes (value_));
 }
 
 Value::Value (integer_t value)
 : value_ (value)
 {
+	Memory::values_grown (Memory::heap_bytes (value_));
+}
+
+Value::Value (long value)
+: value_ (integer_t (value))
+{
+	Memory::values_grown (Memory::heap_bytes (value_));
+}
+
+Value::Value (const Value& rhs)
+: Base (rhs)
+, Counted (rhs)
+, value_ (rhs.value_)
+{
+	Memory::values_grown (Memory::heap_bytes (value_));
+}
+
+Value::~Value()
+{
+	Memory::values_shrunk (Memory::heap_bytes (value_));
+}
+
+void Value::set_value (rational_t value)
+{
+	Memory::values_shrunk (Memory::heap_bytes (value_));
+	value_ = value;
+	Memory::values_grown (Memory::heap_bytes (value_));
 }
 
 Variable::Variable (const std::string& name, const ::Variable& variable, bool is_error)
@@ -34,6 +142,12 @@ Function::Function (const std::string& name)
 {
 }
 
+Power::~Power()
+{
+	dispose (base_);
+	dispose (exponent_);
+}
+
 rational_t Power::get_exponent_constant (bool release)
 {
 	rational_t result;
@@ -2,6 +2,7 @@
 
 #include <util/util.h>
 #include <util/variable.h>
+#include <util/deep-stack.h>
 
 #include <memory>
 
@@ -12,7 +13,8 @@ class Base;
 } // namespace Visitor
 
 #define DECLARE_ACCEPTOR virtual boost::any accept (Visitor::Base& visitor) const
-#define IMPLEMENT_ACCEPTOR(type) boost::any type::accept (Visitor::Base& visitor) const { return visitor.visit (*this); }
+/* every visitor recurses through accept(), so this is where the recursion is moved to a new stack segment if needed */
+#define IMPLEMENT_ACCEPTOR(type) boost::any type::accept (Visitor::Base& visitor) const { return DeepStack::call ([&] { return visitor.visit (*this); }); }
 
 #define IMPLEMENT_GET_TYPE(type) TypeOrdered type::get_type() const { return TypeOrdered::type; }
 
@@ -38,14 +40,115 @@ enum class TypeOrdered
 	AdditionSubtraction
 };
 
+/*
+ * Memory accounting of the trees: the live nodes of each type, the bytes held in the node objects,
+ * in the child containers and in the heap parts of the constants, and the high-water marks of each.
+ *
+ * Collected after enable() in builds with ENABLE_STATS; otherwise the hooks are empty and all counts stay zero.
+ */
+
+namespace Memory
+{
+
+const size_t type_count = static_cast<size_t> (TypeOrdered::AdditionSubtraction) + 1;
+
+struct Usage
+{
+	size_t nodes[type_count];
+	size_t node_bytes;
+	size_t container_bytes;
+	size_t value_bytes;
+	size_t total_bytes;
+};
+
+/* each field of the peak usage is the largest value of that field (they need not be reached at once) */
+Usage current();
+Usage peak();
+
+/* starts new high-water marks from the current usage, returning the previous ones */
+Usage reset_peaks();
+
+/* raises the high-water marks to at least the given ones (to restore them after a nested reset_peaks()) */
+void merge_peaks (const Usage& previous);
+
+const char* type_name (TypeOrdered type);
+
+/* must be called before any tree is built (the counts of the nodes existing before would go negative) */
+void enable();
+
+#ifdef ENABLE_STATS
+void node_created (TypeOrdered type);
+void node_destroyed (TypeOrdered type);
+void containers_grown (size_t bytes);
+void containers_shrunk (size_t bytes);
+void values_grown (size_t bytes);
+void values_shrunk (size_t bytes);
+#else // ENABLE_STATS
+inline void node_created (TypeOrdered) { }
+inline void node_destroyed (TypeOrdered) { }
+inline void containers_grown (size_t) { }
+inline void containers_shrunk (size_t) { }
+inline void values_grown (size_t) { }
+inline void values_shrunk (size_t) { }
+#endif // ENABLE_STATS
+
+/* the bytes of the numerator and the denominator which live outside of the rational itself */
+size_t heap_bytes (const rational_t& value);
+
+/* counts the live nodes of a type: an empty base of each node class */
+template <TypeOrdered type>
+class Counted
+{
+protected:
+	Counted() { node_created (type); }
+	Counted (const Counted&) { node_created (type); }
+	~Counted() { node_destroyed (type); }
+};
+
+/* counts the bytes held in the child containers */
+template <typename T>
+struct ChildAllocator
+{
+	typedef T value_type;
+
+	ChildAllocator() = default;
+	template <typename U> ChildAllocator (const ChildAllocator<U>&) { }
+
+	T* allocate (size_t count)
+	{
+		T* result = std::allocator<T>().allocate (count);
+		containers_grown (count * sizeof (T));
+		return result;
+	}
+
+	void deallocate (T* ptr, size_t count)
+	{
+		containers_shrunk (count * sizeof (T));
+		std::allocator<T>().deallocate (ptr, count);
+	}
+
+	template <typename U> bool operator== (const ChildAllocator<U>&) const { return true; }
+	template <typename U> bool operator!= (const ChildAllocator<U>&) const { return false; }
+};
+
+} // namespace Memory
+
 class Base
 {
 public:
 	typedef std::unique_ptr<Base> Ptr;
 
-	Base() = default;
+	Base();
+	Base (const Base&);
 	virtual ~Base();
 
+	/* returns the count of nodes currently existing (in all threads) */
+	static size_t live_count();
+
+	/* returns the largest count of nodes existing at once since the start or since reset_peak_count() */
+	static size_t peak_count();
+	static void reset_peak_count();
+
 	virtual Priority priority() const = 0;
 	virtual bool numeric_output() const;
 	virtual void Dump (std::ostream& str) const = 0;
@@ -53,17 +156,23 @@ public:
 	DECLARE_ACCEPTOR = 0;
 
 	virtual Ptr clone() const = 0;
-	bool compare (const Ptr& rhs) const;
-	bool less (const Ptr& rhs) const;
+	bool compare (const Base& rhs) const;
+	int collate (const Base& rhs) const;
+	bool less (const Base& rhs) const { return collate (rhs) < 0; }
+	bool compare (const Ptr& rhs) const { return compare (*rhs); }
+	bool less (const Ptr& rhs) const { return less (*rhs); }
 
 	Node::Base::Ptr accept_ptr (Visitor::Base& visitor) const { return Node::Base::Ptr (boost::any_cast<Node::Base*> (accept (visitor))); }
 
 	friend std::ostream& operator<< (std::ostream& out, const Base& node);
 
 protected:
-	virtual bool compare_same_type (const Ptr& rhs) const = 0;
- 	virtual bool less_same_type (const Ptr& rhs) const = 0;
+	virtual bool compare_same_type (const Base& rhs) const = 0;
+	virtual int collate_same_type (const Base& rhs) const = 0;
 	virtual TypeOrdered get_type() const = 0;
+
+	/* destroys the subtree (from a destructor) without recursing on the native stack */
+	static void dispose (Ptr& node);
 };
 
 template <typename Tag>
@@ -85,15 +194,21 @@ struct TaggedChild
 
 	bool operator< (const TaggedChild& rhs) const
 	{
-		return (tag < rhs.tag) ||
-		       ((tag == rhs.tag) && (node->less (rhs.node)));
+		return collate (rhs) < 0;
+	}
+
+	int collate (const TaggedChild& rhs) const
+	{
+		return (tag < rhs.tag) ? -1 :
+		       (rhs.tag < tag) ? 1 :
+		       node->collate (*rhs.node);
 	}
 
 	TaggedChild() = default;
 	TaggedChild (const TaggedChild&) = delete;
 	TaggedChild (TaggedChild&&) = default;
 	TaggedChild (Base::Ptr&& n, Tag t) : node (std::move (n)), tag (t) { }
-	TaggedChild clone() const { return TaggedChild<Tag> { node->clone(), tag }; }
+	TaggedChild clone() const { return TaggedChild<Tag> { DeepStack::call ([this] { return node->clone(); }), tag }; }
 };
 
 template <>
@@ -116,34 +231,50 @@ struct TaggedChild<void>
 		return node->less (rhs.node);
 	}
 
+	int collate (const TaggedChild<void>& rhs) const
+	{
+		return node->collate (*rhs.node);
+	}
+
 	TaggedChild() = default;
 	TaggedChild (const TaggedChild<void>&) = delete;
 	TaggedChild (TaggedChild<void>&&) = default;
 	TaggedChild (Base::Ptr&& n) : node (std::move (n)) { }
-	TaggedChild clone() const { return node->clone(); }
+	TaggedChild clone() const { return DeepStack::call ([this] { return node->clone(); }); }
 };
 
 template <typename Tag>
 class TaggedChildSet : public Base
 {
 public:
-	std::multiset<TaggedChild<Tag>>& children() { return children_; }
-	const std::multiset<TaggedChild<Tag>>& children() const { return children_; }
+	typedef std::multiset<TaggedChild<Tag>, std::less<TaggedChild<Tag>>, Memory::ChildAllocator<TaggedChild<Tag>>> Children;
+
+	virtual ~TaggedChildSet();
+
+	Children& children() { return children_; }
+	const Children& children() const { return children_; }
 
 	void add_children_from (const TaggedChildSet<Tag>& rhs);
 
+	/* inserts many children at once (sorting them first, so that each insertion is at the end) */
+	void add_children (std::vector<TaggedChild<Tag>>&& children);
+
 protected:
 	void add_child (TaggedChild<Tag>&& child);
 
-	std::multiset<TaggedChild<Tag>> children_;
+	Children children_;
 };
 
 template <typename Tag>
 class TaggedChildList : public Base
 {
 public:
-	std::list<TaggedChild<Tag>>& children() { return children_; }
-	const std::list<TaggedChild<Tag>>& children() const { return children_; }
+	typedef std::list<TaggedChild<Tag>, Memory::ChildAllocator<TaggedChild<Tag>>> Children;
+
+	virtual ~TaggedChildList();
+
+	Children& children() { return children_; }
+	const Children& children() const { return children_; }
 
 	void add_children_from (const TaggedChildList<Tag>& rhs);
 
@@ -151,19 +282,22 @@ protected:
 	void add_child (TaggedChild<Tag>&& child);
 	void add_child_front (TaggedChild<Tag>&& child);
 
-	std::list<TaggedChild<Tag>> children_;
+	Children children_;
 };
 
-class Value : public Base
+class Value : public Base, private Memory::Counted<TypeOrdered::Value>
 {
 public:
 	typedef std::unique_ptr<Value> Ptr;
 
 	Value (rational_t value);
 	Value (integer_t value);
+	Value (long value);
+	Value (const Value& rhs);
+	virtual ~Value();
 
 	rational_t value() const { return value_; }
-	void set_value (rational_t value) { value_ = value; }
+	void set_value (rational_t value);
 
 	static Priority priority_static();
 	virtual Priority priority() const;
@@ -175,15 +309,15 @@ public:
 	virtual Base::Ptr clone() const;
 
 protected:
-	virtual bool compare_same_type (const Base::Ptr& rhs) const;
-	virtual bool less_same_type (const Base::Ptr& rhs) const;
+	virtual bool compare_same_type (const Base& rhs) const;
+	virtual int collate_same_type (const Base& rhs) const;
 	virtual TypeOrdered get_type() const;
 
 private:
 	rational_t value_;
 };
 
-class Variable : public Base
+class Variable : public Base, private Memory::Counted<TypeOrdered::Variable>
 {
 public:
 	typedef std::unique_ptr<Variable> Ptr;
@@ -207,8 +341,8 @@ public:
 	virtual Base::Ptr clone() const;
 
 protected:
-	virtual bool compare_same_type (const Base::Ptr& rhs) const;
-	virtual bool less_same_type (const Base::Ptr& rhs) const;
+	virtual bool compare_same_type (const Base& rhs) const;
+	virtual int collate_same_type (const Base& rhs) const;
 	virtual TypeOrdered get_type() const;
 
 private:
@@ -217,7 +351,7 @@ private:
 	bool is_error_;
 };
 
-class Function : public TaggedChildList<void>
+class Function : public TaggedChildList<void>, private Memory::Counted<TypeOrdered::Function>
 {
 public:
 	typedef std::unique_ptr<Function> Ptr;
@@ -237,19 +371,21 @@ public:
 	virtual Base::Ptr clone() const;
 
 protected:
-	virtual bool compare_same_type (const Base::Ptr& rhs) const;
-	virtual bool less_same_type (const Base::Ptr& rhs) const;
+	virtual bool compare_same_type (const Base& rhs) const;
+	virtual int collate_same_type (const Base& rhs) const;
 	virtual TypeOrdered get_type() const;
 
 private:
 	std::string name_;
 };
 
-class Power : public Base
+class Power : public Base, private Memory::Counted<TypeOrdered::Power>
 {
 public:
 	typedef std::unique_ptr<Power> Ptr;
 
+	virtual ~Power();
+
 	static Priority priority_static();
 	virtual Priority priority() const;
 	virtual bool numeric_output() const;
@@ -274,8 +410,8 @@ public:
 	virtual Base::Ptr clone() const;
 
 protected:
-	virtual bool compare_same_type (const Base::Ptr& rhs) const;
-	virtual bool less_same_type (const Base::Ptr& rhs) const;
+	virtual bool compare_same_type (const Base& rhs) const;
+	virtual int collate_same_type (const Base& rhs) const;
 	virtual TypeOrdered get_type() const;
 
 	Base::Ptr base_, exponent_;
@@ -291,7 +427,7 @@ struct AdditionSubtractionTag
 	bool operator< (const AdditionSubtractionTag& rhs) const { return !negated && rhs.negated; }
 };
 
-class AdditionSubtraction : public TaggedChildSet<AdditionSubtractionTag>
+class AdditionSubtraction : public TaggedChildSet<AdditionSubtractionTag>, private Memory::Counted<TypeOrdered::AdditionSubtraction>
 {
 public:
 	typedef std::unique_ptr<AdditionSubtraction> Ptr;
@@ -310,8 +446,8 @@ public:
 	virtual Base::Ptr clone() const;
 
 protected:
-	virtual bool compare_same_type (const Base::Ptr& rhs) const;
-	virtual bool less_same_type (const Base::Ptr& rhs) const;
+	virtual bool compare_same_type (const Base& rhs) const;
+	virtual int collate_same_type (const Base& rhs) const;
 	virtual TypeOrdered get_type() const;
 
 private:
@@ -328,7 +464,7 @@ struct MultiplicationDivisionTag
 	bool operator< (const MultiplicationDivisionTag& rhs) const { return !reciprocated && rhs.reciprocated; }
 };
 
-class MultiplicationDivision : public TaggedChildSet<MultiplicationDivisionTag>
+class MultiplicationDivision : public TaggedChildSet<MultiplicationDivisionTag>, private Memory::Counted<TypeOrdered::MultiplicationDivision>
 {
 public:
 	typedef std::unique_ptr<MultiplicationDivision> Ptr;
@@ -350,11 +486,20 @@ public:
 	virtual Base::Ptr clone() const;
 
 protected:
-	virtual bool compare_same_type (const Base::Ptr& rhs) const;
-	virtual bool less_same_type (const Base::Ptr& rhs) const;
+	virtual bool compare_same_type (const Base& rhs) const;
+	virtual int collate_same_type (const Base& rhs) const;
 	virtual TypeOrdered get_type() const;
 };
 
+template <typename Tag>
+TaggedChildSet<Tag>::~TaggedChildSet()
+{
+	/* the elements are only const to keep the order, which does not matter any more */
+	for (const TaggedChild<Tag>& child: children_) {
+		dispose (const_cast<TaggedChild<Tag>&> (child).node);
+	}
+}
+
 template <typename Tag>
 void TaggedChildSet<Tag>::add_child (TaggedChild<Tag>&& child)
 {
@@ -369,6 +514,35 @@ void TaggedChildSet<Tag>::add_children_from (const TaggedChildSet<Tag>& rhs)
 	}
 }
 
+template <typename Tag>
+void TaggedChildSet<Tag>::add_children (std::vector<TaggedChild<Tag>>&& children)
+{
+	/* TaggedChild is not assignable, so the order is computed on pointers */
+	std::vector<TaggedChild<Tag>*> order;
+	order.reserve (children.size());
+
+	for (TaggedChild<Tag>& child: children) {
+		order.push_back (&child);
+	}
+
+	/* stable, so that equal children keep their order as with add_child() */
+	std::stable_sort (order.begin(), order.end(), [] (const TaggedChild<Tag>* lhs, const TaggedChild<Tag>* rhs) { return *lhs < *rhs; });
+
+	for (TaggedChild<Tag>* child: order) {
+		children_.insert (children_.end(), std::move (*child));
+	}
+
+	children.clear();
+}
+
+template <typename Tag>
+TaggedChildList<Tag>::~TaggedChildList()
+{
+	for (TaggedChild<Tag>& child: children_) {
+		dispose (child.node);
+	}
+}
+
 template <typename Tag>
 void TaggedChildList<Tag>::add_child (TaggedChild<Tag>&& child)
 {
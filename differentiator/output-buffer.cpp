@@ -0,0 +1,65 @@
+#include "output-buffer.h"
+
+#include <cstdio>
+
+OutputBuffer::OutputBuffer (std::ostream& stream)
+: stream_ (stream)
+{
+}
+
+void OutputBuffer::flush()
+{
+	stream_.write (buffer_.data(), buffer_.size());
+	flushed_ += buffer_.size();
+	buffer_.clear();
+}
+
+void OutputBuffer::append_integer (const integer_t& value)
+{
+	static const integer_t min = std::numeric_limits<long long>::min(),
+	                       max = std::numeric_limits<long long>::max();
+
+	/* the multi-limb integers are rare, let boost format them */
+	if ((value < min) || (value > max)) {
+		*this << value.str();
+		return;
+	}
+
+	long long native = value.convert_to<long long>();
+	unsigned long long magnitude = (native < 0) ? 0ull - static_cast<unsigned long long> (native)
+	                                            : static_cast<unsigned long long> (native);
+
+	char digits[24];
+	char* begin = std::end (digits);
+
+	do {
+		*--begin = '0' + (magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude);
+
+	if (native < 0) {
+		*--begin = '-';
+	}
+
+	append (begin, std::end (digits) - begin);
+}
+
+void OutputBuffer::append_rational (const rational_t& value)
+{
+	/* same as rational_to_ostream() */
+	append_integer (value.numerator());
+
+	if (value.denominator() != 1) {
+		*this << '/';
+		append_integer (value.denominator());
+	}
+}
+
+void OutputBuffer::append_fp (data_t value)
+{
+	/* same as the default formatting of std::ostream */
+	char digits[64];
+	int length = snprintf (digits, sizeof (digits), "%Lg", value);
+
+	append (digits, std::min<size_t> (length, sizeof (digits) - 1));
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <util/util.h>
+
+#include <cstring>
+
+/*
+ * Accumulates text in a large buffer and writes it to the underlying stream in big blocks,
+ * formatting numbers without going through iostream.
+ *
+ * Nothing reaches the stream until the buffer fills up or flush() is called.
+ * The buffer grows as the text is appended, so short texts do not cost the whole capacity.
+ */
+
+class OutputBuffer
+{
+	std::ostream& stream_;
+	std::string buffer_;
+	size_t flushed_ = 0;
+
+	static const size_t capacity = 1 << 16;
+
+	void maybe_flush()
+	{
+		if (buffer_.size() >= capacity) {
+			flush();
+		}
+	}
+
+public:
+	explicit OutputBuffer (std::ostream& stream);
+
+	OutputBuffer (const OutputBuffer&) = delete;
+	OutputBuffer& operator= (const OutputBuffer&) = delete;
+
+	void flush();
+
+	/* the count of characters appended so far, including the flushed ones */
+	size_t written() const { return flushed_ + buffer_.size(); }
+
+	void append (const char* data, size_t length)
+	{
+		buffer_.append (data, length);
+		maybe_flush();
+	}
+
+	void append_integer (const integer_t& value);
+	void append_rational (const rational_t& value);
+	void append_fp (data_t value);
+
+	OutputBuffer& operator<< (char value)               { buffer_.push_back (value); maybe_flush(); return *this; }
+	OutputBuffer& operator<< (const char* value)        { append (value, strlen (value)); return *this; }
+	OutputBuffer& operator<< (const std::string& value) { append (value.data(), value.size()); return *this; }
+	OutputBuffer& operator<< (const integer_t& value)   { append_integer (value); return *this; }
+	OutputBuffer& operator<< (const rational_t& value)  { append_rational (value); return *this; }
+	OutputBuffer& operator<< (data_t value)             { append_fp (value); return *this; }
+};
@@ -1,144 +1,255 @@
 #include "parser.h"
 
-Parser::Parser (const Lexer::string& s, const Variable::Map& v)
-: current_ (LexerIterator (s))
-, variables_ (v)
-{
-}
+typedef LexerIterator::Operator Operator;
 
-Node::Base::Ptr Parser::parse()
-{
-	Node::Base::Ptr result = get_toplevel();
-	if (current_) {
-		ERROR (std::runtime_error, "Parse error: " << current_ << ": expected end of input");
-	}
-	return result;
-}
+/*
+ * Operands and operators of one nesting level (the whole input, a parenthesized sub-expression
+ * or a function argument), collected until the level ends.
+ *
+ * A sum is a list of terms, each of them a product of factors, each of them a power or an operand.
+ * A node for a sum or a product is made only if it has an operator (possibly a leading one).
+ */
 
-Node::Base::Ptr Parser::get_toplevel()
+struct Parser::Level
 {
-	return get_add_sub();
-}
+	enum class Kind
+	{
+		TopLevel,
+		Parenthesis,
+		FunctionArgument
+	};
 
-template <typename T, typename ChildInserter>
-Node::Base::Ptr Parser::get_arithm (Node::Base::Ptr(Parser::*next)(),
-                                    std::initializer_list<LexerIterator::string> tokens,
-                                    ChildInserter inserter)
-{
-	Node::Base::Ptr child;
-	typename T::Ptr node;
-	size_t idx;
+	Kind kind;
+	Node::Function::Ptr function;
 
-	if (current_.check_and_advance (tokens, &idx)) {
-		node = typename T::Ptr (new T);
-		inserter (node, (this->*next)(), idx);
-	} else {
-		child = (this->*next)();
-	}
+	std::vector<Node::TaggedChild<Node::AdditionSubtractionTag>> terms;
+	bool sum_has_operator = false;
+	bool negate_next = false;
+
+	std::vector<Node::TaggedChild<Node::MultiplicationDivisionTag>> factors;
+	bool product_has_operator = false;
+	bool reciprocate_next = false;
+
+	/* the base of a power whose exponent is being parsed */
+	Node::Base::Ptr power_base;
+
+	Level (Kind k) : kind (k) { }
 
-	while (current_.check_and_advance (tokens, &idx)) {
-		if (!node) {
-			node = typename T::Ptr (new T);
-			inserter (node, std::move (child), 0);
+	Node::Base::Ptr finish_product()
+	{
+		Node::Base::Ptr result;
+
+		if (!product_has_operator && (factors.size() == 1)) {
+			result = std::move (factors.front().node);
+		} else {
+			Node::MultiplicationDivision::Ptr node (new Node::MultiplicationDivision);
+			node->add_children (std::move (factors));
+			result = std::move (node);
 		}
 
-		inserter (node, (this->*next)(), idx);
+		factors.clear();
+		product_has_operator = false;
+		reciprocate_next = false;
+		return result;
 	}
 
-	if (child) {
-		return child;
-	} else {
-		return std::move (node);
+	void finish_term()
+	{
+		terms.emplace_back (finish_product(), negate_next);
+		negate_next = false;
 	}
-}
 
-Node::Base::Ptr Parser::get_add_sub()
-{
-	return get_arithm<Node::AdditionSubtraction> (&Parser::get_mul_div,
-	                                              { "+", "-" },
-	                                              [] (Node::AdditionSubtraction::Ptr& node, Node::Base::Ptr&& child, size_t idx)
-	                                                 { node->add_child (std::move (child), (idx == 1)); });
-}
+	Node::Base::Ptr finish_sum()
+	{
+		Node::Base::Ptr result;
+
+		if (!sum_has_operator && (terms.size() == 1)) {
+			result = std::move (terms.front().node);
+		} else {
+			Node::AdditionSubtraction::Ptr node (new Node::AdditionSubtraction);
+			node->add_children (std::move (terms));
+			result = std::move (node);
+		}
 
-Node::Base::Ptr Parser::get_mul_div()
+		terms.clear();
+		sum_has_operator = false;
+		return result;
+	}
+};
+
+Parser::Parser (const Lexer::string& s, const Variable::Map& v)
+: current_ (LexerIterator (s))
+, variables_ (v)
 {
-	return get_arithm<Node::MultiplicationDivision> (&Parser::get_power,
-	                                                 { "*", "/" },
-	                                                 [] (Node::MultiplicationDivision::Ptr& node, Node::Base::Ptr&& child, size_t idx)
-	                                                    { node->add_child (std::move (child), (idx == 1)); });
 }
 
-Node::Base::Ptr Parser::get_power()
+Node::Base::Ptr Parser::parse()
 {
-	Node::Base::Ptr base = get_sub_expr();
+	std::vector<Level> levels;
+	levels.emplace_back (Level::Kind::TopLevel);
 
-	if (current_.check_and_advance ({ "^", "**" })) {
-		Node::Power::Ptr result (new Node::Power);
-		result->set_base (std::move (base));
-		result->set_exponent (get_sub_expr());
-		return std::move (result);
-	} else {
-		return base;
+	for (;;) {
+		Node::Base::Ptr operand;
+
+		if (!start_level (levels, operand)) {
+			continue;
+		}
+
+		Node::Base::Ptr result;
+
+		if (complete_operand (levels, std::move (operand), result) == Step::Done) {
+			return result;
+		}
 	}
 }
 
-Node::Base::Ptr Parser::get_sub_expr()
+/*
+ * Parses an operand (with its leading operators, if allowed at this position).
+ * Returns false if the operand opens a new nesting level instead.
+ */
+
+bool Parser::start_level (std::vector<Level>& levels, Node::Base::Ptr& operand)
 {
+	Level& level = levels.back();
+	size_t idx;
+
+	/* leading operators (an exponent may not have them) */
+	if (!level.power_base) {
+		if (level.terms.empty() && level.factors.empty() && !level.sum_has_operator &&
+		    current_.check_and_advance ({ Operator::Plus, Operator::Minus }, &idx)) {
+			level.sum_has_operator = true;
+			level.negate_next = (idx == 1);
+		}
+
+		if (level.factors.empty() && !level.product_has_operator &&
+		    current_.check_and_advance ({ Operator::Multiply, Operator::Divide }, &idx)) {
+			level.product_has_operator = true;
+			level.reciprocate_next = (idx == 1);
+		}
+	}
+
 	/* end of expression */
 	if (!current_) {
 		ERROR (std::runtime_error, "Parse error: " << current_ << ": expected expression");
 	}
 
 	/* sub-expression */
-	if (current_.check_and_advance ("(")) {
-		Node::Base::Ptr sub_expr = get_toplevel();
-		if (current_.check_and_advance (")")) {
-			return sub_expr;
-		} else {
-			ERROR (std::runtime_error, "Parse error: " << current_ << ": expected closing parenthesis");
-		}
+	if (current_.check_and_advance (Operator::ParenthesisOpening)) {
+		levels.emplace_back (Level::Kind::Parenthesis);
+		return false;
 	}
 
 	/* numeric literal */
 	if (current_.get_class() == LexerIterator::Classification::Numeric) {
-		integer_t value = current_.get_numeric();
+		operand = Node::Value::Ptr (new Node::Value (current_.get_numeric()));
 		++current_;
-		return Node::Value::Ptr (new Node::Value (value));
+		return true;
 	}
 
 	/* function or variable */
 	if (current_.get_class() != LexerIterator::Classification::Alphabetical) {
-			ERROR (std::runtime_error, "Parse error: " << current_ << ": symbol expected");
+		ERROR (std::runtime_error, "Parse error: " << current_ << ": symbol expected");
 	}
 
-	std::string name = *current_;
+	std::string name = current_->text();
 
-	if (std::next (current_).check ("(")) {
+	if (std::next (current_).check (Operator::ParenthesisOpening)) {
 		std::advance (current_, 2);
 
 		Node::Function::Ptr node (new Node::Function (name));
 
-		if (current_.check_and_advance (")")) {
-			return std::move (node);
+		if (current_.check (Operator::ParenthesisClosing)) {
+			ERROR (std::runtime_error, "Parse error: " << current_ << ": function '" << name << "' expects 1 argument");
 		}
 
-		do {
-			node->add_child (get_toplevel());
-		} while (current_.check_and_advance (","));
-
-		if (current_.check_and_advance (")")) {
-			return std::move (node);
-		} else {
-			ERROR (std::runtime_error, "Parse error: " << current_ << ": expected closing parenthesis");
-		}
+		levels.emplace_back (Level::Kind::FunctionArgument);
+		levels.back().function = std::move (node);
+		return false;
 	}
 
 	/* variable */
 	auto it = variables_.find (name);
 	if (it != variables_.end()) {
 		++current_;
-		return Node::Variable::Ptr (new Node::Variable (it->first, it->second, false));
+		operand = Node::Variable::Ptr (new Node::Variable (it->first, it->second, false));
+		return true;
 	} else {
-		ERROR (std::runtime_error, "Parse error: unknown variable: '" << *current_ << "'");
+		ERROR (std::runtime_error, "Parse error: unknown variable: '" << name << "'");
+	}
+}
+
+/*
+ * Attaches a parsed operand to the innermost level and handles the operator which follows it,
+ * closing as many levels as end there.
+ */
+
+Parser::Step Parser::complete_operand (std::vector<Level>& levels, Node::Base::Ptr&& operand, Node::Base::Ptr& result)
+{
+	size_t idx;
+
+	for (;;) {
+		Level& level = levels.back();
+
+		if (level.power_base) {
+			Node::Power::Ptr power (new Node::Power);
+			power->set_base (std::move (level.power_base));
+			power->set_exponent (std::move (operand));
+			operand = std::move (power);
+		} else if (current_.check_and_advance (Operator::Power)) {
+			level.power_base = std::move (operand);
+			return Step::NeedOperand;
+		}
+
+		level.factors.emplace_back (std::move (operand), level.reciprocate_next);
+
+		if (current_.check_and_advance ({ Operator::Multiply, Operator::Divide }, &idx)) {
+			level.product_has_operator = true;
+			level.reciprocate_next = (idx == 1);
+			return Step::NeedOperand;
+		}
+
+		level.finish_term();
+
+		if (current_.check_and_advance ({ Operator::Plus, Operator::Minus }, &idx)) {
+			level.sum_has_operator = true;
+			level.negate_next = (idx == 1);
+			return Step::NeedOperand;
+		}
+
+		Node::Base::Ptr value = level.finish_sum();
+
+		switch (level.kind) {
+		case Level::Kind::TopLevel:
+			if (current_) {
+				ERROR (std::runtime_error, "Parse error: " << current_ << ": expected end of input");
+			}
+			result = std::move (value);
+			return Step::Done;
+
+		case Level::Kind::Parenthesis:
+			if (!current_.check_and_advance (Operator::ParenthesisClosing)) {
+				ERROR (std::runtime_error, "Parse error: " << current_ << ": expected closing parenthesis");
+			}
+			operand = std::move (value);
+			levels.pop_back();
+			break;
+
+		case Level::Kind::FunctionArgument:
+			/* all supported functions are unary */
+			if (current_.check (Operator::Comma)) {
+				ERROR (std::runtime_error, "Parse error: " << current_ << ": function '" << level.function->name() << "' expects 1 argument");
+			}
+
+			level.function->add_child (std::move (value));
+
+			if (!current_.check_and_advance (Operator::ParenthesisClosing)) {
+				ERROR (std::runtime_error, "Parse error: " << current_ << ": expected closing parenthesis");
+			}
+			operand = std::move (level.function);
+			levels.pop_back();
+			break;
+
+		HANDLE_DEFAULT_CASE
+		}
 	}
 }
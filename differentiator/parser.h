@@ -3,21 +3,28 @@
 #include "lexer.h"
 #include "node.h"
 
+/*
+ * An operator-precedence parser. Nesting levels (parenthesized sub-expressions and function arguments)
+ * are kept on an explicit stack rather than on the native one, so the nesting depth is limited
+ * only by memory. Operands of a sum or a product are collected first and inserted into the
+ * n-ary node at once.
+ */
+
 class Parser
 {
+	struct Level;
+
+	enum class Step
+	{
+		NeedOperand,
+		Done
+	};
+
 	LexerIterator current_;
 	const Variable::Map& variables_;
 
-	template <typename T, typename ChildInserter>
-	Node::Base::Ptr get_arithm (Node::Base::Ptr(Parser::*next)(),
-	                            std::initializer_list<LexerIterator::string> tokens,
-	                            ChildInserter inserter);
-
-	Node::Base::Ptr get_toplevel();
-	Node::Base::Ptr get_add_sub();
-	Node::Base::Ptr get_mul_div();
-	Node::Base::Ptr get_power();
-	Node::Base::Ptr get_sub_expr();
+	bool start_level (std::vector<Level>& levels, Node::Base::Ptr& operand);
+	Step complete_operand (std::vector<Level>& levels, Node::Base::Ptr&& operand, Node::Base::Ptr& result);
 
 public:
 	Parser (const Lexer::string& s, const Variable::Map& v);
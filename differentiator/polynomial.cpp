@@ -0,0 +1,628 @@
+#include "polynomial.h"
+
+namespace {
+
+Polynomial::Monomial make_guard_mask()
+{
+	Polynomial::Monomial result = 0;
+
+	for (unsigned i = 0; i < Polynomial::max_variables; ++i) {
+		result |= Polynomial::Monomial (1) << ((i + 1) * Polynomial::bits_per_variable - 1);
+	}
+
+	return result;
+}
+
+} // anonymous namespace
+
+const unsigned Polynomial::bits_per_variable;
+const unsigned Polynomial::max_variables;
+const unsigned Polynomial::max_exponent;
+const Polynomial::Monomial Polynomial::guard_mask = make_guard_mask();
+
+Polynomial::Polynomial (const rational_t& constant)
+{
+	if (constant != 0) {
+		terms_.emplace (Monomial (0), constant);
+	}
+}
+
+Polynomial Polynomial::variable (unsigned index)
+{
+	ASSERT (index < max_variables, "Polynomial variable index out of range: " << index);
+
+	Polynomial result;
+	result.terms_.emplace (Monomial (1) << (index * bits_per_variable), rational_t (1));
+	return result;
+}
+
+void Polynomial::add (const Polynomial& rhs, const rational_t& multiplier)
+{
+	if (multiplier == 0) {
+		return;
+	}
+
+	for (const auto& term: rhs.terms_) {
+		auto r = terms_.emplace (term.first, term.second * multiplier);
+		if (!r.second) {
+			r.first->second += term.second * multiplier;
+
+			if (r.first->second == 0) {
+				terms_.erase (r.first);
+			}
+		}
+	}
+}
+
+void Polynomial::scale (const rational_t& multiplier)
+{
+	if (multiplier == 0) {
+		terms_.clear();
+		return;
+	}
+
+	for (auto& term: terms_) {
+		term.second *= multiplier;
+	}
+}
+
+bool Polynomial::multiply (const Polynomial& rhs, size_t term_limit)
+{
+	/* multiplication by a constant does not touch the monomials */
+	if ((rhs.terms_.size() == 1) && (rhs.terms_.begin()->first == 0)) {
+		scale (rhs.terms_.begin()->second);
+		return true;
+	}
+
+	Terms result;
+
+	for (const auto& lhs_term: terms_) {
+		for (const auto& rhs_term: rhs.terms_) {
+			Monomial monomial;
+			if (!multiply_monomials (lhs_term.first, rhs_term.first, monomial)) {
+				return false;
+			}
+
+			auto r = result.emplace (monomial, lhs_term.second * rhs_term.second);
+			if (!r.second) {
+				r.first->second += lhs_term.second * rhs_term.second;
+			} else if (result.size() > term_limit) {
+				return false;
+			}
+		}
+	}
+
+	/* drop cancelled terms */
+	for (auto it = result.begin(); it != result.end(); ) {
+		if (it->second == 0) {
+			result.erase (it++);
+		} else {
+			++it;
+		}
+	}
+
+	terms_ = std::move (result);
+	return true;
+}
+
+bool Polynomial::raise (unsigned power, size_t term_limit)
+{
+	/* binary exponentiation */
+	Polynomial result (rational_t (1)), base (std::move (*this));
+
+	for (;;) {
+		if (power & 1) {
+			if (!result.multiply (base, term_limit)) {
+				return false;
+			}
+		}
+
+		power >>= 1;
+		if (!power) {
+			break;
+		}
+
+		if (!base.multiply (base, term_limit)) {
+			return false;
+		}
+	}
+
+	*this = std::move (result);
+	return true;
+}
+
+bool Polynomial::divide_exact (const Polynomial& divisor, size_t term_limit)
+{
+	ASSERT (!divisor.is_zero(), "Polynomial division by zero");
+
+	if (divisor.is_constant()) {
+		scale (1 / divisor.constant());
+		return true;
+	}
+
+	const Terms::value_type& divisor_leading = *divisor.terms_.rbegin();
+	Polynomial dividend (*this), quotient;
+
+	/* the leading term of a product is the product of the leading terms, so if the divisor is a factor,
+	 * its leading term divides the leading term of every remainder */
+	while (!dividend.is_zero()) {
+		Terms::value_type leading = *dividend.terms_.rbegin();
+
+		if (!divides_monomial (divisor_leading.first, leading.first)) {
+			return false;
+		}
+
+		Monomial factor = leading.first - divisor_leading.first;
+		rational_t coefficient = leading.second / divisor_leading.second;
+
+		quotient.terms_.emplace (factor, coefficient);
+		if (quotient.terms_.size() > term_limit) {
+			return false;
+		}
+
+		for (const auto& term: divisor.terms_) {
+			Monomial monomial;
+			if (!multiply_monomials (term.first, factor, monomial)) {
+				return false;
+			}
+
+			auto r = dividend.terms_.emplace (monomial, -coefficient * term.second);
+			if (!r.second) {
+				r.first->second -= coefficient * term.second;
+
+				if (r.first->second == 0) {
+					dividend.terms_.erase (r.first);
+				}
+			}
+		}
+	}
+
+	*this = std::move (quotient);
+	return true;
+}
+
+bool Polynomial::remainder (const Polynomial& divisor, size_t term_limit)
+{
+	const Terms::value_type& divisor_leading = *divisor.terms_.rbegin();
+
+	for (size_t steps = 0; !is_zero(); ++steps) {
+		Terms::value_type leading = *terms_.rbegin();
+
+		if (!divides_monomial (divisor_leading.first, leading.first)) {
+			break;
+		}
+
+		if (steps > term_limit) {
+			return false;
+		}
+
+		Monomial factor = leading.first - divisor_leading.first;
+		rational_t coefficient = leading.second / divisor_leading.second;
+
+		for (const auto& term: divisor.terms_) {
+			Monomial monomial;
+			if (!multiply_monomials (term.first, factor, monomial)) {
+				return false;
+			}
+
+			auto r = terms_.emplace (monomial, -coefficient * term.second);
+			if (!r.second) {
+				r.first->second -= coefficient * term.second;
+
+				if (r.first->second == 0) {
+					terms_.erase (r.first);
+				}
+			}
+		}
+	}
+
+	return true;
+}
+
+rational_t Polynomial::make_primitive()
+{
+	if (terms_.empty()) {
+		return rational_t (1);
+	}
+
+	integer_t numerators_gcd = 0, denominators_lcm = 1;
+
+	for (const auto& term: terms_) {
+		numerators_gcd = boost::multiprecision::gcd (numerators_gcd, boost::multiprecision::abs (term.second.numerator()));
+		denominators_lcm = boost::multiprecision::lcm (denominators_lcm, term.second.denominator());
+	}
+
+	rational_t content (numerators_gcd, denominators_lcm);
+	if (terms_.rbegin()->second < 0) {
+		content = -content;
+	}
+
+	for (auto& term: terms_) {
+		term.second /= content;
+	}
+
+	return content;
+}
+
+int Polynomial::single_variable() const
+{
+	Monomial used = 0;
+
+	for (const auto& term: terms_) {
+		used |= term.first;
+	}
+
+	int result = -1;
+
+	for (unsigned i = 0; i < max_variables; ++i) {
+		if (exponent (used, i)) {
+			if (result != -1) {
+				return -2;
+			}
+			result = i;
+		}
+	}
+
+	return result;
+}
+
+int Polynomial::main_variable() const
+{
+	Monomial used = 0;
+
+	for (const auto& term: terms_) {
+		used |= term.first;
+	}
+
+	for (unsigned i = max_variables; i > 0; --i) {
+		if (exponent (used, i - 1)) {
+			return i - 1;
+		}
+	}
+
+	return -1;
+}
+
+unsigned Polynomial::degree (unsigned index) const
+{
+	unsigned result = 0;
+
+	for (const auto& term: terms_) {
+		result = std::max (result, exponent (term.first, index));
+	}
+
+	return result;
+}
+
+std::map<unsigned, Polynomial> Polynomial::coefficients (unsigned index) const
+{
+	Monomial field = Monomial ((1u << bits_per_variable) - 1) << (index * bits_per_variable);
+	std::map<unsigned, Polynomial> result;
+
+	for (const auto& term: terms_) {
+		result[exponent (term.first, index)].terms_.emplace (term.first & ~field, term.second);
+	}
+
+	return result;
+}
+
+bool Polynomial::content (unsigned index, size_t term_limit, Polynomial& result) const
+{
+	Polynomial accumulated;
+
+	for (const auto& coefficient: coefficients (index)) {
+		Polynomial common;
+		if (!gcd_recursive (accumulated, coefficient.second, term_limit, common)) {
+			return false;
+		}
+
+		accumulated = std::move (common);
+		if (accumulated.is_constant()) {
+			break;
+		}
+	}
+
+	result = std::move (accumulated);
+	return true;
+}
+
+bool Polynomial::pseudo_remainder (const Polynomial& divisor, unsigned index, size_t term_limit)
+{
+	unsigned divisor_degree = divisor.degree (index);
+	Polynomial divisor_leading = divisor.coefficients (index).rbegin()->second;
+
+	while (!is_zero()) {
+		unsigned own_degree = degree (index);
+		if (own_degree < divisor_degree) {
+			break;
+		}
+
+		/* this = lc(divisor) * this - lc(this) * x^(own_degree - divisor_degree) * divisor,
+		 * which cancels the leading coefficient in x; the constant factors do not matter and are dropped */
+		Polynomial own_leading = coefficients (index).rbegin()->second, subtrahend (divisor);
+
+		Polynomial shift;
+		shift.terms_.emplace (Monomial (own_degree - divisor_degree) << (index * bits_per_variable), rational_t (1));
+
+		if (!own_leading.multiply (shift, term_limit) ||
+		    !subtrahend.multiply (own_leading, term_limit) ||
+		    !multiply (divisor_leading, term_limit)) {
+			return false;
+		}
+
+		add (subtrahend, -1);
+		if (terms_.size() > term_limit) {
+			return false;
+		}
+
+		make_primitive();
+	}
+
+	return true;
+}
+
+bool Polynomial::gcd_recursive (const Polynomial& lhs, const Polynomial& rhs, size_t term_limit, Polynomial& result)
+{
+	if (lhs.is_zero() || rhs.is_zero()) {
+		result = lhs.is_zero() ? rhs : lhs;
+		result.make_primitive();
+		return true;
+	}
+
+	if (lhs.is_constant() || rhs.is_constant()) {
+		result = Polynomial (rational_t (1));
+		return true;
+	}
+
+	int variable = lhs.single_variable();
+
+	if ((variable >= 0) && (variable == rhs.single_variable())) {
+		/* primitive remainder sequence */
+		Polynomial a (lhs), b (rhs);
+		a.make_primitive();
+		b.make_primitive();
+
+		while (!b.is_zero()) {
+			if (!a.remainder (b, term_limit)) {
+				return false;
+			}
+
+			a.make_primitive();
+			std::swap (a, b);
+		}
+
+		result = std::move (a);
+		return true;
+	}
+
+	/*
+	 * Recursive primitive remainder sequence in the main variable x (the one with the highest index),
+	 * the coefficients being polynomials in the remaining variables:
+	 * gcd (a, b) = gcd (cont (a), cont (b)) * gcd (pp (a), pp (b)), where the content is the gcd
+	 * of the coefficients and the second gcd is the primitive part of the last non-zero pseudo-remainder.
+	 */
+	variable = std::max (lhs.main_variable(), rhs.main_variable());
+
+	Polynomial lhs_content, rhs_content, common;
+	if (!lhs.content (variable, term_limit, lhs_content) ||
+	    !rhs.content (variable, term_limit, rhs_content) ||
+	    !gcd_recursive (lhs_content, rhs_content, term_limit, common)) {
+		return false;
+	}
+
+	Polynomial a (lhs), b (rhs);
+	if (!a.divide_exact (lhs_content, term_limit) ||
+	    !b.divide_exact (rhs_content, term_limit)) {
+		return false;
+	}
+
+	if (a.degree (variable) < b.degree (variable)) {
+		std::swap (a, b);
+	}
+
+	while (!b.is_zero()) {
+		/* a primitive polynomial of degree 0 in x is a constant */
+		if (!b.degree (variable)) {
+			a = Polynomial (rational_t (1));
+			break;
+		}
+
+		Polynomial remainder_content;
+		if (!a.pseudo_remainder (b, variable, term_limit) ||
+		    !a.content (variable, term_limit, remainder_content) ||
+		    (!a.is_zero() && !a.divide_exact (remainder_content, term_limit))) {
+			return false;
+		}
+
+		std::swap (a, b);
+	}
+
+	if (!a.multiply (common, term_limit)) {
+		return false;
+	}
+
+	a.make_primitive();
+	result = std::move (a);
+	return true;
+}
+
+Polynomial Polynomial::gcd (const Polynomial& lhs, const Polynomial& rhs, size_t term_limit)
+{
+	Polynomial result;
+	if (!gcd_recursive (lhs, rhs, term_limit, result)) {
+		return Polynomial (rational_t (1));
+	}
+
+	return result;
+}
+
+/*
+ * RationalFunction
+ */
+
+void RationalFunction::add_factor (Polynomial factor, unsigned power)
+{
+	ASSERT (!factor.is_constant(), "Constant factor in the denominator of a rational function");
+
+	if (power) {
+		denominator_[std::move (factor)] += power;
+	}
+}
+
+bool RationalFunction::expand_factors (const Factors& factors, Polynomial& result, size_t term_limit) const
+{
+	result = Polynomial (rational_t (1));
+
+	for (const auto& factor: factors) {
+		Polynomial power (factor.first);
+		if (!power.raise (factor.second, term_limit) ||
+		    !result.multiply (power, term_limit)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool RationalFunction::cancel (size_t term_limit)
+{
+	if (numerator_.is_zero()) {
+		denominator_.clear();
+		return true;
+	}
+
+	for (bool changed = true; changed; ) {
+		changed = false;
+
+		for (auto it = denominator_.begin(); it != denominator_.end(); ++it) {
+			Polynomial common = Polynomial::gcd (numerator_, it->first, term_limit);
+			if (common.is_constant()) {
+				continue;
+			}
+
+			/* f^n = common^n * rest^n, where common is cancelled once with the numerator */
+			Polynomial rest = it->first;
+			unsigned power = it->second;
+
+			if (!numerator_.divide_exact (common, term_limit) ||
+			    !rest.divide_exact (common, term_limit)) {
+				return false;
+			}
+
+			denominator_.erase (it);
+
+			rational_t rest_content = rest.make_primitive();
+			numerator_.scale (1 / pow_frac (rest_content, power));
+
+			add_factor (common, power - 1);
+			if (!rest.is_constant()) {
+				add_factor (std::move (rest), power);
+			}
+
+			changed = true;
+			break;
+		}
+	}
+
+	return true;
+}
+
+bool RationalFunction::add (const RationalFunction& rhs, const rational_t& multiplier, size_t term_limit)
+{
+	if ((multiplier == 0) || rhs.numerator_.is_zero()) {
+		return true;
+	}
+
+	/* the common denominator takes each factor with the largest power */
+	Factors common (denominator_), lhs_missing, rhs_missing;
+
+	for (const auto& factor: rhs.denominator_) {
+		unsigned& power = common[factor.first];
+		power = std::max (power, factor.second);
+	}
+
+	for (const auto& factor: common) {
+		Factors::const_iterator lhs_it = denominator_.find (factor.first),
+		                        rhs_it = rhs.denominator_.find (factor.first);
+		unsigned lhs_power = (lhs_it != denominator_.end()) ? lhs_it->second : 0,
+		         rhs_power = (rhs_it != rhs.denominator_.end()) ? rhs_it->second : 0;
+
+		if (factor.second > lhs_power) {
+			lhs_missing.emplace (factor.first, factor.second - lhs_power);
+		}
+		if (factor.second > rhs_power) {
+			rhs_missing.emplace (factor.first, factor.second - rhs_power);
+		}
+	}
+
+	Polynomial lhs_multiplier, rhs_multiplier, rhs_numerator (rhs.numerator_);
+
+	if (!expand_factors (lhs_missing, lhs_multiplier, term_limit) ||
+	    !expand_factors (rhs_missing, rhs_multiplier, term_limit) ||
+	    !numerator_.multiply (lhs_multiplier, term_limit) ||
+	    !rhs_numerator.multiply (rhs_multiplier, term_limit)) {
+		return false;
+	}
+
+	numerator_.add (rhs_numerator, multiplier);
+	if (numerator_.terms().size() > term_limit) {
+		return false;
+	}
+
+	denominator_ = std::move (common);
+	return cancel (term_limit);
+}
+
+bool RationalFunction::multiply (const RationalFunction& rhs, size_t term_limit)
+{
+	if (!numerator_.multiply (rhs.numerator_, term_limit)) {
+		return false;
+	}
+
+	for (const auto& factor: rhs.denominator_) {
+		add_factor (factor.first, factor.second);
+	}
+
+	return cancel (term_limit);
+}
+
+bool RationalFunction::raise (unsigned power, size_t term_limit)
+{
+	if (!numerator_.raise (power, term_limit)) {
+		return false;
+	}
+
+	if (!power) {
+		denominator_.clear();
+	}
+
+	for (auto& factor: denominator_) {
+		factor.second *= power;
+	}
+
+	return true;
+}
+
+bool RationalFunction::invert (size_t term_limit)
+{
+	if (numerator_.is_zero()) {
+		return false;
+	}
+
+	Polynomial denominator (std::move (numerator_));
+
+	if (!expand_factors (denominator_, numerator_, term_limit)) {
+		return false;
+	}
+
+	denominator_.clear();
+
+	rational_t content = denominator.make_primitive();
+	numerator_.scale (1 / content);
+
+	if (!denominator.is_constant()) {
+		add_factor (std::move (denominator), 1);
+	}
+
+	return true;
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <util/util.h>
+
+/*
+ * A sparse multivariate polynomial with rational coefficients.
+ *
+ * Variables are identified by their indices (there may be at most max_variables of them).
+ * Each monomial is a packed vector of exponents, bits_per_variable bits per variable,
+ * so that multiplication of monomials is a single integer addition. The highest bit of each field
+ * is a guard bit which detects overflows of the exponents.
+ *
+ * Multiplication fails (returning false and leaving the polynomial unspecified) rather than
+ * overflow the exponents or produce more terms than the given limit.
+ */
+
+class Polynomial
+{
+public:
+	typedef uint64_t Monomial;
+	typedef std::map<Monomial, rational_t> Terms;
+
+	static const unsigned bits_per_variable = 8;
+	static const unsigned max_variables = 64 / bits_per_variable;
+	static const unsigned max_exponent = (1u << (bits_per_variable - 1)) - 1;
+
+	Polynomial() = default;
+	explicit Polynomial (const rational_t& constant);
+
+	static Polynomial variable (unsigned index);
+
+	const Terms& terms() const { return terms_; }
+	bool is_zero() const { return terms_.empty(); }
+	bool is_constant() const { return terms_.empty() || ((terms_.size() == 1) && (terms_.begin()->first == 0)); }
+	rational_t constant() const { return terms_.empty() ? rational_t (0) : terms_.begin()->second; }
+
+	bool operator== (const Polynomial& rhs) const { return terms_ == rhs.terms_; }
+	bool operator< (const Polynomial& rhs) const { return terms_ < rhs.terms_; }
+
+	static unsigned exponent (Monomial monomial, unsigned index)
+	{
+		return (monomial >> (index * bits_per_variable)) & ((1u << bits_per_variable) - 1);
+	}
+
+	/* this += rhs * multiplier */
+	void add (const Polynomial& rhs, const rational_t& multiplier);
+	void scale (const rational_t& multiplier);
+
+	bool multiply (const Polynomial& rhs, size_t term_limit);
+	bool raise (unsigned power, size_t term_limit);
+
+	/* divides by the divisor if it is a factor of this polynomial, otherwise returns false and keeps the polynomial intact */
+	bool divide_exact (const Polynomial& divisor, size_t term_limit);
+
+	/* divides by the content (the constant factor) so that all coefficients are coprime integers
+	 * and the leading one is positive, returns the content */
+	rational_t make_primitive();
+
+	/*
+	 * Returns the primitive greatest common divisor of two polynomials.
+	 * It is computed by Euclid's algorithm if both polynomials depend on the same single variable,
+	 * and by the recursive primitive remainder sequence otherwise;
+	 * 1 is returned if an intermediate result exceeds the term limit.
+	 */
+	static Polynomial gcd (const Polynomial& lhs, const Polynomial& rhs, size_t term_limit);
+
+private:
+	static const Monomial guard_mask;
+
+	Terms terms_;
+
+	/* returns the index of the only variable used, or -1 if there are none, or -2 if there are several */
+	int single_variable() const;
+	/* returns the highest index of the variables used, or -1 if there are none */
+	int main_variable() const;
+	unsigned degree (unsigned index) const;
+	/* splits the polynomial by the powers of the given variable */
+	std::map<unsigned, Polynomial> coefficients (unsigned index) const;
+	/* the gcd of the coefficients by the powers of the given variable */
+	bool content (unsigned index, size_t term_limit, Polynomial& result) const;
+
+	bool remainder (const Polynomial& divisor, size_t term_limit);
+	/* a multiple of the remainder of division in the given variable, keeping the coefficients polynomial */
+	bool pseudo_remainder (const Polynomial& divisor, unsigned index, size_t term_limit);
+
+	static bool gcd_recursive (const Polynomial& lhs, const Polynomial& rhs, size_t term_limit, Polynomial& result);
+
+	static bool divides_monomial (Monomial divisor, Monomial dividend)
+	{
+		/* no field of the divisor is greater than the corresponding field of the dividend
+		 * iff subtracting with all guard bits set does not borrow any of them */
+		return (((dividend | guard_mask) - divisor) & guard_mask) == guard_mask;
+	}
+
+	static bool multiply_monomials (Monomial lhs, Monomial rhs, Monomial& result)
+	{
+		result = lhs + rhs;
+		return !(result & guard_mask);
+	}
+};
+
+/*
+ * A rational function: a polynomial numerator over a product of powers of primitive polynomials.
+ * The denominator is kept factored as it is built, and common factors with the numerator
+ * are cancelled after each operation.
+ *
+ * As with polynomials, the operations fail (returning false) rather than exceed the term limit;
+ * division by zero fails as well.
+ */
+
+class RationalFunction
+{
+public:
+	typedef std::map<Polynomial, unsigned> Factors;
+
+	RationalFunction() = default;
+	explicit RationalFunction (Polynomial numerator) : numerator_ (std::move (numerator)) { }
+
+	const Polynomial& numerator() const { return numerator_; }
+	const Factors& denominator() const { return denominator_; }
+
+	/* this += rhs * multiplier */
+	bool add (const RationalFunction& rhs, const rational_t& multiplier, size_t term_limit);
+	void scale (const rational_t& multiplier) { numerator_.scale (multiplier); }
+
+	bool multiply (const RationalFunction& rhs, size_t term_limit);
+	bool raise (unsigned power, size_t term_limit);
+	bool invert (size_t term_limit);
+
+private:
+	Polynomial numerator_;
+	Factors denominator_;
+
+	void add_factor (Polynomial factor, unsigned power);
+	bool expand_factors (const Factors& factors, Polynomial& result, size_t term_limit) const;
+	bool cancel (size_t term_limit);
+};
@@ -0,0 +1,274 @@
+#include "program.h"
+#include "visitor.h"
+#include "visitor-calculate.h"
+
+#include <unordered_set>
+
+/*
+ * The compiler emits the code of a subtree only if it depends on the slots (this is found out in a separate
+ * pass, so that each subtree is computed at most once); the independent subtrees are computed with
+ * Visitor::Calculate and emitted as constants.
+ */
+
+class Program::Compiler : public Visitor::Base
+{
+	Program& program_;
+	const std::vector<std::string>& slots_;
+	const std::vector<std::string>& error_slots_;
+	std::unordered_set<const Node::Base*> dependent_;
+	size_t depth_;
+
+	int32_t slot_index (const Node::Variable& variable) const;
+	bool mark (const Node::Base& node);
+	void emit (Opcode opcode, int32_t operand = 0);
+	void emit_constant (data_t value);
+	void compile (const Node::Base& node);
+
+public:
+	Compiler (Program& program, const std::vector<std::string>& slots, const std::vector<std::string>& error_slots)
+	: program_ (program)
+	, slots_ (slots)
+	, error_slots_ (error_slots)
+	, depth_ (0)
+	{
+	}
+
+	void run (const Node::Base& tree)
+	{
+		mark (tree);
+		compile (tree);
+		ASSERT (depth_ == 1, "Compiled program leaves " << depth_ << " values on the stack");
+	}
+
+	virtual boost::any visit (const Node::Value& node);
+	virtual boost::any visit (const Node::Variable& node);
+	virtual boost::any visit (const Node::Function& node);
+	virtual boost::any visit (const Node::Power& node);
+	virtual boost::any visit (const Node::AdditionSubtraction& node);
+	virtual boost::any visit (const Node::MultiplicationDivision& node);
+};
+
+/* returns the slot of a variable (or of its error), or -1 if it is not one */
+int32_t Program::Compiler::slot_index (const Node::Variable& variable) const
+{
+	const std::vector<std::string>& names = variable.is_error() ? error_slots_ : slots_;
+	auto it = std::find (names.begin(), names.end(), variable.name());
+
+	if (it == names.end()) {
+		return -1;
+	}
+
+	return (variable.is_error() ? slots_.size() : 0) + (it - names.begin());
+}
+
+bool Program::Compiler::mark (const Node::Base& node)
+{
+	if (DeepStack::near_limit()) {
+		return DeepStack::call ([&] { return mark (node); });
+	}
+
+	bool result = false;
+
+	if (const Node::Variable* variable = dynamic_cast<const Node::Variable*> (&node)) {
+		result = (slot_index (*variable) >= 0);
+	} else if (const Node::Power* power = dynamic_cast<const Node::Power*> (&node)) {
+		/* no short-circuiting, both subtrees have to be marked */
+		result = mark (*power->get_base());
+		result = mark (*power->get_exponent()) || result;
+	} else if (const Node::Function* function = dynamic_cast<const Node::Function*> (&node)) {
+		for (const auto& child: function->children()) {
+			result = mark (*child.node) || result;
+		}
+	} else if (const Node::AdditionSubtraction* sum = dynamic_cast<const Node::AdditionSubtraction*> (&node)) {
+		for (const auto& child: sum->children()) {
+			result = mark (*child.node) || result;
+		}
+	} else if (const Node::MultiplicationDivision* product = dynamic_cast<const Node::MultiplicationDivision*> (&node)) {
+		for (const auto& child: product->children()) {
+			result = mark (*child.node) || result;
+		}
+	}
+
+	if (result) {
+		dependent_.insert (&node);
+	}
+
+	return result;
+}
+
+void Program::Compiler::emit (Opcode opcode, int32_t operand)
+{
+	program_.code_.push_back ({ opcode, operand });
+
+	switch (opcode) {
+	case Opcode::Constant:
+	case Opcode::Slot:
+		++depth_;
+		program_.stack_size_ = std::max (program_.stack_size_, depth_);
+		break;
+
+	case Opcode::Add:
+	case Opcode::Subtract:
+	case Opcode::Multiply:
+	case Opcode::Divide:
+	case Opcode::Power:
+		--depth_;
+		break;
+
+	case Opcode::Negate:
+	case Opcode::PowerInt:
+	case Opcode::Sqrt:
+	case Opcode::Log:
+		break;
+	}
+}
+
+void Program::Compiler::emit_constant (data_t value)
+{
+	emit (Opcode::Constant, program_.constants_.size());
+	program_.constants_.push_back (value);
+}
+
+void Program::Compiler::compile (const Node::Base& node)
+{
+	if (dependent_.count (&node)) {
+		node.accept (*this);
+	} else {
+		Visitor::Calculate calculate;
+		boost::any value = node.accept (calculate);
+
+		VERIFY (!value.empty(), std::runtime_error, "Cannot compile the expression: a subexpression has no value: " << node);
+		emit_constant (any_to_fp (value));
+	}
+}
+
+boost::any Program::Compiler::visit (const Node::Value&)
+{
+	ERROR (std::logic_error, "Constant node marked as dependent");
+}
+
+boost::any Program::Compiler::visit (const Node::Variable& node)
+{
+	emit (Opcode::Slot, slot_index (node));
+	return boost::any();
+}
+
+boost::any Program::Compiler::visit (const Node::Function& node)
+{
+	VERIFY ((node.name() == "ln") && (node.children().size() == 1), std::runtime_error,
+	        "Cannot compile the expression: unknown function: '" << node.name() << "'");
+
+	compile (*node.children().front().node);
+	emit (Opcode::Log);
+	return boost::any();
+}
+
+boost::any Program::Compiler::visit (const Node::Power& node)
+{
+	compile (*node.get_base());
+
+	/* the common constant exponents do not need the general pow() */
+	if (const Node::Value* exponent = dynamic_cast<const Node::Value*> (node.get_exponent().get())) {
+		rational_t value = exponent->value();
+
+		if ((value.denominator() == 1) && (abs (value.numerator()) <= 64)) {
+			emit (Opcode::PowerInt, static_cast<int32_t> (value.numerator()));
+			return boost::any();
+		}
+
+		if (value == rational_t (1, 2)) {
+			emit (Opcode::Sqrt);
+			return boost::any();
+		}
+	}
+
+	compile (*node.get_exponent());
+	emit (Opcode::Power);
+	return boost::any();
+}
+
+boost::any Program::Compiler::visit (const Node::AdditionSubtraction& node)
+{
+	bool first = true;
+
+	for (const auto& child: node.children()) {
+		compile (*child.node);
+
+		if (first) {
+			if (child.tag.negated) {
+				emit (Opcode::Negate);
+			}
+			first = false;
+		} else {
+			emit (child.tag.negated ? Opcode::Subtract : Opcode::Add);
+		}
+	}
+
+	return boost::any();
+}
+
+boost::any Program::Compiler::visit (const Node::MultiplicationDivision& node)
+{
+	bool first = true;
+
+	for (const auto& child: node.children()) {
+		if (first && child.tag.reciprocated) {
+			emit_constant (1);
+			first = false;
+		}
+
+		compile (*child.node);
+
+		if (first) {
+			first = false;
+		} else {
+			emit (child.tag.reciprocated ? Opcode::Divide : Opcode::Multiply);
+		}
+	}
+
+	return boost::any();
+}
+
+Program::Program (const Node::Base& tree, const std::vector<std::string>& slots, const std::vector<std::string>& error_slots)
+: stack_size_ (0)
+{
+	Compiler (*this, slots, error_slots).run (tree);
+}
+
+data_t Program::evaluate (const data_t* slots, data_t* stack) const
+{
+	/* points to the top of the stack */
+	data_t* top = stack - 1;
+
+	for (const Instruction& instruction: code_) {
+		switch (instruction.opcode) {
+		case Opcode::Constant: *++top = constants_[instruction.operand]; break;
+		case Opcode::Slot:     *++top = slots[instruction.operand]; break;
+		case Opcode::Add:      --top; top[0] += top[1]; break;
+		case Opcode::Subtract: --top; top[0] -= top[1]; break;
+		case Opcode::Multiply: --top; top[0] *= top[1]; break;
+		case Opcode::Divide:   --top; top[0] /= top[1]; break;
+		case Opcode::Negate:   top[0] = -top[0]; break;
+		case Opcode::Power:    --top; top[0] = powl (top[0], top[1]); break;
+		case Opcode::Sqrt:     top[0] = sqrtl (top[0]); break;
+		case Opcode::Log:      top[0] = logl (top[0]); break;
+
+		case Opcode::PowerInt: {
+			/* binary exponentiation */
+			data_t base = top[0], result = 1;
+			unsigned power = std::abs (instruction.operand);
+
+			for (; power; power >>= 1, base *= base) {
+				if (power & 1) {
+					result *= base;
+				}
+			}
+
+			top[0] = (instruction.operand < 0) ? 1 / result : result;
+			break;
+		}
+		}
+	}
+
+	return *top;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "node.h"
+
+/*
+ * An expression tree compiled into a flat postfix program over floating-point numbers, for evaluating
+ * the same expression at many points without walking the tree (and without rational arithmetic).
+ *
+ * The variables are split into "slots", whose values are given at each evaluation, and the rest,
+ * whose values (and errors) are taken from the tree at compile time. The errors of the variables named
+ * in error_slots are slots as well, given after the values. The subtrees which do not depend on the slots
+ * are folded into constants.
+ */
+
+class Program
+{
+public:
+	Program (const Node::Base& tree, const std::vector<std::string>& slots, const std::vector<std::string>& error_slots = { });
+
+	/* the stack must have room for stack_size() values */
+	data_t evaluate (const data_t* slots, data_t* stack) const;
+
+	size_t stack_size() const { return stack_size_; }
+
+private:
+	class Compiler;
+
+	enum class Opcode : uint8_t
+	{
+		Constant,  /* push constants_[operand] */
+		Slot,      /* push slots[operand] */
+		Add,
+		Subtract,
+		Multiply,
+		Divide,
+		Negate,
+		Power,
+		PowerInt,  /* raise to the (signed) integer power operand */
+		Sqrt,
+		Log
+	};
+
+	struct Instruction
+	{
+		Opcode opcode;
+		int32_t operand;
+	};
+
+	std::vector<Instruction> code_;
+	std::vector<data_t> constants_;
+	size_t stack_size_;
+};
@@ -0,0 +1,261 @@
+#include "server.h"
+
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace {
+
+/* a connection which sends this much without a newline is dropped */
+const size_t max_request_size = 1 << 20;
+
+volatile sig_atomic_t stop_requested = 0;
+
+void request_stop (int)
+{
+	stop_requested = 1;
+}
+
+#define VERIFY_ERRNO(cond, text) VERIFY (cond, std::runtime_error, text << ": " << strerror (errno))
+
+sockaddr_un make_address (const std::string& path)
+{
+	sockaddr_un address = { };
+	address.sun_family = AF_UNIX;
+
+	VERIFY (path.size() < sizeof (address.sun_path), std::runtime_error, "Socket path is too long: '" << path << "'");
+	std::copy (path.begin(), path.end(), address.sun_path);
+
+	return address;
+}
+
+/* whether a socket file exists at the address, but nobody listens on it (e. g. a previous server has crashed) */
+bool is_stale (const sockaddr_un& address)
+{
+	int probe = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	VERIFY_ERRNO (probe >= 0, "Cannot create a socket");
+
+	bool result = (connect (probe, reinterpret_cast<const sockaddr*> (&address), sizeof (address)) < 0) && (errno == ECONNREFUSED);
+	close (probe);
+	return result;
+}
+
+bool send_all (int fd, const std::string& data)
+{
+	for (size_t sent = 0; sent < data.size(); ) {
+		ssize_t r = send (fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+
+		if (r < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+
+		sent += r;
+	}
+
+	return true;
+}
+
+} // anonymous namespace
+
+struct Server::Connection
+{
+	int fd;
+
+	/* the incomplete request received so far */
+	std::string buffer;
+};
+
+Server::Server (Batch& batch, std::string path, unsigned jobs)
+: batch_ (batch)
+, path_ (std::move (path))
+, jobs_ (jobs)
+, listener_ (-1)
+, wakeup_ { -1, -1 }
+{
+	try {
+		sockaddr_un address = make_address (path_);
+
+		listener_ = socket (AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+		VERIFY_ERRNO (listener_ >= 0, "Cannot create a socket");
+
+		if ((bind (listener_, reinterpret_cast<const sockaddr*> (&address), sizeof (address)) < 0) &&
+		    ((errno != EADDRINUSE) || !is_stale (address) || (unlink (path_.c_str()) < 0) ||
+		     (bind (listener_, reinterpret_cast<const sockaddr*> (&address), sizeof (address)) < 0))) {
+			ERROR (std::runtime_error, "Cannot bind the socket to '" << path_ << "': " << strerror (errno));
+		}
+
+		VERIFY_ERRNO (listen (listener_, SOMAXCONN) == 0, "Cannot listen on '" << path_ << "'");
+		VERIFY_ERRNO (pipe2 (wakeup_, O_CLOEXEC | O_NONBLOCK) == 0, "Cannot create a pipe");
+	} catch (...) {
+		if (listener_ >= 0) {
+			close (listener_);
+		}
+		throw;
+	}
+}
+
+Server::~Server()
+{
+	close (wakeup_[0]);
+	close (wakeup_[1]);
+	close (listener_);
+	unlink (path_.c_str());
+}
+
+void Server::give_back (const std::shared_ptr<Connection>& connection, bool alive)
+{
+	{
+		std::lock_guard<std::mutex> lock (returned_mutex_);
+		returned_.emplace_back (connection, alive);
+	}
+
+	/* if the pipe is full, the main loop is going to wake up anyway */
+	char byte = 0;
+	ssize_t r = write (wakeup_[1], &byte, 1);
+	(void) r;
+}
+
+void Server::serve (const std::shared_ptr<Connection>& connection)
+{
+	bool alive = true;
+
+	try {
+		char data[4096];
+		ssize_t r;
+
+		do {
+			r = recv (connection->fd, data, sizeof (data), 0);
+		} while ((r < 0) && (errno == EINTR));
+
+		if (r <= 0) {
+			alive = false;
+		} else {
+			connection->buffer.append (data, r);
+
+			std::string responses;
+			size_t begin = 0, end;
+
+			while ((end = connection->buffer.find ('\n', begin)) != std::string::npos) {
+				std::string line = connection->buffer.substr (begin, end - begin);
+				begin = end + 1;
+
+				if (!line.empty() && (line.back() == '\r')) {
+					line.pop_back();
+				}
+
+				if (!line.empty() && (line[0] != '#')) {
+					responses += batch_.process (line);
+					responses += '\n';
+				}
+			}
+
+			connection->buffer.erase (0, begin);
+
+			alive = send_all (connection->fd, responses) && (connection->buffer.size() < max_request_size);
+		}
+	} catch (std::exception& e) {
+		std::cerr << "Server error: " << e.what() << std::endl;
+		alive = false;
+	}
+
+	give_back (connection, alive);
+}
+
+void Server::run()
+{
+	/* the signals are only delivered while waiting in ppoll(), and only to this thread (the workers inherit the mask) */
+	sigset_t stop_signals, original_mask;
+	sigemptyset (&stop_signals);
+	sigaddset (&stop_signals, SIGINT);
+	sigaddset (&stop_signals, SIGTERM);
+	pthread_sigmask (SIG_BLOCK, &stop_signals, &original_mask);
+
+	struct sigaction action = { }, original_int, original_term;
+	action.sa_handler = &request_stop;
+	sigaction (SIGINT, &action, &original_int);
+	sigaction (SIGTERM, &action, &original_term);
+
+	stop_requested = 0;
+
+	std::map<int, std::shared_ptr<Connection>> idle;
+
+	{
+		ThreadPool pool (jobs_);
+		std::vector<pollfd> fds;
+
+		while (!stop_requested) {
+			fds.clear();
+			fds.push_back ({ listener_, POLLIN, 0 });
+			fds.push_back ({ wakeup_[0], POLLIN, 0 });
+
+			for (const auto& connection: idle) {
+				fds.push_back ({ connection.first, POLLIN, 0 });
+			}
+
+			if (ppoll (fds.data(), fds.size(), nullptr, &original_mask) < 0) {
+				VERIFY_ERRNO (errno == EINTR, "Cannot wait for requests");
+				continue;
+			}
+
+			if (fds[0].revents & POLLIN) {
+				int fd = accept4 (listener_, nullptr, nullptr, SOCK_CLOEXEC);
+
+				if (fd >= 0) {
+					idle.emplace (fd, std::make_shared<Connection> (Connection { fd, std::string() }));
+				} else if ((errno != EINTR) && (errno != ECONNABORTED)) {
+					std::cerr << "Server error: cannot accept a connection: " << strerror (errno) << std::endl;
+				}
+			}
+
+			if (fds[1].revents & POLLIN) {
+				char data[256];
+				while (read (wakeup_[0], data, sizeof (data)) > 0) { }
+
+				std::lock_guard<std::mutex> lock (returned_mutex_);
+
+				for (const auto& returned: returned_) {
+					if (returned.second) {
+						idle.emplace (returned.first->fd, returned.first);
+					} else {
+						close (returned.first->fd);
+					}
+				}
+
+				returned_.clear();
+			}
+
+			/* a connection is handed to a worker as a whole, so its requests are answered in order */
+			for (auto it = fds.begin() + 2; it != fds.end(); ++it) {
+				if (it->revents) {
+					std::shared_ptr<Connection> connection = idle.at (it->fd);
+					idle.erase (it->fd);
+
+					pool.submit ([this, connection] { serve (connection); });
+				}
+			}
+		}
+	}
+
+	/* the pool has finished all requests in flight */
+	for (const auto& returned: returned_) {
+		close (returned.first->fd);
+	}
+	returned_.clear();
+
+	for (const auto& connection: idle) {
+		close (connection.first);
+	}
+
+	sigaction (SIGINT, &original_int, nullptr);
+	sigaction (SIGTERM, &original_term, nullptr);
+	pthread_sigmask (SIG_SETMASK, &original_mask, nullptr);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "batch.h"
+
+#include <util/thread-pool.h>
+
+/*
+ * Server mode: serves requests of any number of clients on a Unix domain socket.
+ *
+ * A request is a batch job (see batch.h) terminated by a newline, and it is answered with a single line
+ * in the format of the batch mode. A client may send any number of requests over a connection, and the
+ * answers come in the order of the requests. The requests are processed on a pool of worker threads
+ * sharing the cache of symbolic results and of the programs compiled from them, so the cache stays warm
+ * across requests and clients.
+ *
+ * The server runs until it is interrupted (SIGINT or SIGTERM), then it removes the socket.
+ */
+
+class Server
+{
+public:
+	Server (Batch& batch, std::string path, unsigned jobs);
+	~Server();
+
+	Server (const Server&) = delete;
+	Server& operator= (const Server&) = delete;
+
+	void run();
+
+private:
+	struct Connection;
+
+	Batch& batch_;
+	std::string path_;
+	unsigned jobs_;
+
+	int listener_;
+	int wakeup_[2];
+
+	/* connections handed back by the workers after serving their requests */
+	std::mutex returned_mutex_;
+	std::vector<std::pair<std::shared_ptr<Connection>, bool>> returned_;
+
+	void serve (const std::shared_ptr<Connection>& connection);
+	void give_back (const std::shared_ptr<Connection>& connection, bool alive);
+};
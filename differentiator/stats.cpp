@@ -0,0 +1,232 @@
+#include "stats.h"
+#include "util-tree.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+
+#include <time.h>
+#include <sys/resource.h>
+
+namespace {
+
+std::atomic<size_t> allocations (0), allocated_bytes (0);
+std::mutex records_mutex;
+
+double wall_ms()
+{
+	return std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* CPU time of the whole process, including the worker threads */
+double cpu_ms()
+{
+	timespec ts;
+	clock_gettime (CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+size_t peak_rss_kb()
+{
+	rusage usage;
+	getrusage (RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+void write_json_string (std::ostream& out, const std::string& str)
+{
+	out << '"';
+
+	for (char c: str) {
+		if ((c == '"') || (c == '\\')) {
+			out << '\\' << c;
+		} else if (static_cast<unsigned char> (c) < 0x20) {
+			out << "\\u" << std::hex << std::setw (4) << std::setfill ('0') << int (c) << std::dec << std::setfill (' ');
+		} else {
+			out << c;
+		}
+	}
+
+	out << '"';
+}
+
+} // anonymous namespace
+
+#ifdef ENABLE_STATS
+
+/*
+ * Allocation accounting: the whole program goes through these.
+ */
+
+void* operator new (size_t size)
+{
+	if (Stats::enabled()) {
+		allocations.fetch_add (1, std::memory_order_relaxed);
+		allocated_bytes.fetch_add (size, std::memory_order_relaxed);
+	}
+
+	void* result = malloc (size ? size : 1);
+	if (!result) {
+		throw std::bad_alloc();
+	}
+	return result;
+}
+
+void operator delete (void* ptr) noexcept
+{
+	free (ptr);
+}
+
+#endif // ENABLE_STATS
+
+bool Stats::enabled_ = false;
+std::vector<Stats::Record> Stats::records_;
+
+void Stats::enable()
+{
+	enabled_ = true;
+	Node::Memory::enable();
+}
+
+size_t Stats::allocation_count()
+{
+	return allocations.load (std::memory_order_relaxed);
+}
+
+size_t Stats::allocation_bytes()
+{
+	return allocated_bytes.load (std::memory_order_relaxed);
+}
+
+Stats::Phase::Phase (std::string name)
+: record_ ()
+, active_ (enabled())
+{
+	if (!active_) {
+		return;
+	}
+
+	record_.name = std::move (name);
+	enclosing_peaks_ = Node::Memory::reset_peaks();
+	allocations_start_ = allocation_count();
+	allocated_bytes_start_ = allocation_bytes();
+	cpu_start_ = cpu_ms();
+	wall_start_ = wall_ms();
+}
+
+Stats::Phase::~Phase()
+{
+	if (!active_) {
+		return;
+	}
+
+	record_.wall_ms = wall_ms() - wall_start_;
+	record_.cpu_ms = cpu_ms() - cpu_start_;
+	record_.allocations = allocation_count() - allocations_start_;
+	record_.allocated_bytes = allocation_bytes() - allocated_bytes_start_;
+	record_.peak_rss_kb = peak_rss_kb();
+	record_.peak_trees = Node::Memory::peak();
+	Node::Memory::merge_peaks (enclosing_peaks_);
+
+	std::lock_guard<std::mutex> lock (records_mutex);
+	records_.push_back (std::move (record_));
+}
+
+void Stats::Phase::input (const Node::Base& tree)
+{
+	if (active_) {
+		record_.nodes_in += count_nodes (tree);
+		record_.depth_in = std::max (record_.depth_in, tree_depth (tree));
+	}
+}
+
+void Stats::Phase::output (const Node::Base& tree)
+{
+	if (active_) {
+		record_.nodes_out += count_nodes (tree);
+		record_.depth_out = std::max (record_.depth_out, tree_depth (tree));
+	}
+}
+
+void Stats::write_text (std::ostream& out)
+{
+	std::lock_guard<std::mutex> lock (records_mutex);
+
+	size_t name_width = 5;
+	for (const Record& r: records_) {
+		name_width = std::max (name_width, r.name.length());
+	}
+
+	out << "Statistics:" << std::endl
+	    << std::left << std::setw (name_width) << "phase" << std::right
+	    << std::setw (11) << "wall ms" << std::setw (11) << "cpu ms"
+	    << std::setw (11) << "nodes in" << std::setw (11) << "nodes out"
+	    << std::setw (10) << "depth in" << std::setw (10) << "depth out" << std::setw (13) << "allocations" << std::setw (13) << "alloc KiB"
+	    << std::setw (14) << "peak tree KiB" << std::setw (13) << "peak RSS KiB" << std::endl;
+
+	for (const Record& r: records_) {
+		out << std::left << std::setw (name_width) << r.name << std::right
+		    << std::fixed << std::setprecision (2)
+		    << std::setw (11) << r.wall_ms << std::setw (11) << r.cpu_ms
+		    << std::setw (11) << r.nodes_in << std::setw (11) << r.nodes_out
+		    << std::setw (10) << r.depth_in << std::setw (10) << r.depth_out
+		    << std::setw (13) << r.allocations << std::setw (13) << r.allocated_bytes / 1024
+		    << std::setw (14) << r.peak_trees.total_bytes / 1024 << std::setw (13) << r.peak_rss_kb << std::endl;
+	}
+
+	out.unsetf (std::ios::floatfield);
+	out << std::endl;
+
+	write_memory_text (out);
+}
+
+void Stats::write_memory_text (std::ostream& out)
+{
+	Node::Memory::Usage current = Node::Memory::current(), peak = Node::Memory::peak();
+
+	out << "Trees in memory:" << std::endl
+	    << std::left << std::setw (24) << "held by" << std::right
+	    << std::setw (13) << "live" << std::setw (13) << "peak" << std::endl;
+
+	for (size_t i = 0; i < Node::Memory::type_count; ++i) {
+		out << std::left << std::setw (24) << Node::Memory::type_name (static_cast<Node::TypeOrdered> (i)) << std::right
+		    << std::setw (13) << current.nodes[i] << std::setw (13) << peak.nodes[i] << std::endl;
+	}
+
+	out << std::left << std::setw (24) << "nodes, KiB" << std::right
+	    << std::setw (13) << current.node_bytes / 1024 << std::setw (13) << peak.node_bytes / 1024 << std::endl
+	    << std::left << std::setw (24) << "child containers, KiB" << std::right
+	    << std::setw (13) << current.container_bytes / 1024 << std::setw (13) << peak.container_bytes / 1024 << std::endl
+	    << std::left << std::setw (24) << "constants, KiB" << std::right
+	    << std::setw (13) << current.value_bytes / 1024 << std::setw (13) << peak.value_bytes / 1024 << std::endl
+	    << std::left << std::setw (24) << "total, KiB" << std::right
+	    << std::setw (13) << current.total_bytes / 1024 << std::setw (13) << peak.total_bytes / 1024 << std::endl
+	    << std::endl;
+}
+
+void Stats::write_json (std::ostream& out)
+{
+	std::lock_guard<std::mutex> lock (records_mutex);
+
+	out << "[";
+
+	for (size_t i = 0; i < records_.size(); ++i) {
+		const Record& r = records_[i];
+
+		out << (i ? "," : "") << std::endl
+		    << "  { \"phase\": "; write_json_string (out, r.name);
+		out << ", \"wall_ms\": " << r.wall_ms << ", \"cpu_ms\": " << r.cpu_ms
+		    << ", \"nodes_in\": " << r.nodes_in << ", \"nodes_out\": " << r.nodes_out
+		    << ", \"depth_in\": " << r.depth_in << ", \"depth_out\": " << r.depth_out
+		    << ", \"allocations\": " << r.allocations << ", \"allocated_bytes\": " << r.allocated_bytes
+		    << ", \"peak_tree_bytes\": " << r.peak_trees.total_bytes
+		    << ", \"peak_container_bytes\": " << r.peak_trees.container_bytes << ", \"peak_value_bytes\": " << r.peak_trees.value_bytes
+		    << ", \"peak_nodes\": {";
+		for (size_t j = 0; j < Node::Memory::type_count; ++j) {
+			out << (j ? ", " : " ") << "\"" << Node::Memory::type_name (static_cast<Node::TypeOrdered> (j)) << "\": " << r.peak_trees.nodes[j];
+		}
+		out << " }, \"peak_rss_kb\": " << r.peak_rss_kb << " }";
+	}
+
+	out << std::endl << "]" << std::endl;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "node.h"
+
+/*
+ * Per-phase statistics of a run: wall and CPU time, node counts and depth of the trees going in and out,
+ * memory allocations, the high-water marks of the trees in memory (see Node::Memory) and the peak resident set size.
+ *
+ * The phases are marked with the STATS_* macros below, which compile to nothing unless the build
+ * has ENABLE_STATS defined. Even then, nothing is measured (and allocations are not counted)
+ * until Stats::enable() is called.
+ */
+
+class Stats
+{
+public:
+	struct Record
+	{
+		std::string name;
+		double wall_ms, cpu_ms;
+		size_t nodes_in, nodes_out;
+		size_t depth_in, depth_out;
+		size_t allocations, allocated_bytes;
+		Node::Memory::Usage peak_trees;
+		size_t peak_rss_kb;
+	};
+
+	/* measures the enclosing scope as a phase, and records it when destroyed */
+	class Phase
+	{
+		Record record_;
+		double wall_start_, cpu_start_;
+		size_t allocations_start_, allocated_bytes_start_;
+		Node::Memory::Usage enclosing_peaks_;
+		bool active_;
+
+	public:
+		explicit Phase (std::string name);
+		~Phase();
+
+		Phase (const Phase&) = delete;
+		Phase& operator= (const Phase&) = delete;
+
+		void input (const Node::Base& tree);
+		void output (const Node::Base& tree);
+	};
+
+	static void enable();
+	static bool enabled() { return enabled_; }
+
+	/* counts of allocations (and of bytes allocated) since the start, if the allocations are counted */
+	static size_t allocation_count();
+	static size_t allocation_bytes();
+
+	static const std::vector<Record>& records() { return records_; }
+
+	static void write_text (std::ostream& out);
+
+	/* the live and peak counts of Node::Memory (also ending write_text()) */
+	static void write_memory_text (std::ostream& out);
+	static void write_json (std::ostream& out);
+
+private:
+	static bool enabled_;
+	static std::vector<Record> records_;
+};
+
+#ifdef ENABLE_STATS
+# define STATS_PHASE(var, name) Stats::Phase var (name)
+# define STATS_INPUT(var, tree) var.input (tree)
+# define STATS_OUTPUT(var, tree) var.output (tree)
+#else // ENABLE_STATS
+/* the tree expressions are not evaluated, but still count as used */
+# define STATS_PHASE(var, name) do { } while (0)
+# define STATS_INPUT(var, tree) do { (void) sizeof (tree); } while (0)
+# define STATS_OUTPUT(var, tree) do { (void) sizeof (tree); } while (0)
+#endif // ENABLE_STATS
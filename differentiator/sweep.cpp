@@ -0,0 +1,181 @@
+#include "sweep.h"
+
+#include <util/thread-pool.h>
+
+#include <limits>
+#include <cstring>
+
+namespace {
+
+/* points are handed to workers in chunks of this many */
+const size_t chunk_size = 4096;
+
+/* chunks in flight per worker before the output is waited for */
+const size_t chunks_per_worker = 4;
+
+data_t parse_number (const std::string& text, const std::string& spec)
+{
+	std::istringstream ss (text);
+	data_t result;
+	ss >> result;
+
+	VERIFY (consumed_entirely (ss), std::runtime_error, "Could not parse the value '" << text << "' of the sweep: '" << spec << "'");
+	return result;
+}
+
+} // anonymous namespace
+
+Sweep::Axis Sweep::Axis::parse (const std::string& spec)
+{
+	Axis result;
+	std::istringstream ss (spec);
+	std::string range;
+
+	ss >> result.name >> range;
+	VERIFY (consumed_entirely (ss) && !range.empty(), std::runtime_error, "Wrong sweep specifier: '" << spec << "'");
+
+	if (range.find (':') != std::string::npos) {
+		std::istringstream fields (range);
+		std::string start_s, step_s, stop_s;
+
+		std::getline (fields, start_s, ':');
+		std::getline (fields, step_s, ':');
+		std::getline (fields, stop_s);
+
+		data_t start = parse_number (start_s, spec),
+		       step = parse_number (step_s, spec),
+		       stop = parse_number (stop_s, spec);
+
+		VERIFY ((step != 0) && ((stop - start) / step >= 0), std::runtime_error, "Sweep range does not reach its end: '" << spec << "'");
+
+		/* the end is included even if it is missed by a rounding error */
+		data_t count = floorl ((stop - start) / step + eps) + 1;
+		VERIFY (count <= std::numeric_limits<uint32_t>::max(), std::runtime_error, "Sweep range is too long: '" << spec << "'");
+
+		result.values.reserve (count);
+		for (size_t i = 0; i < count; ++i) {
+			result.values.push_back (start + i * step);
+		}
+	} else {
+		std::istringstream fields (range);
+		std::string value;
+
+		while (std::getline (fields, value, ',')) {
+			result.values.push_back (parse_number (value, spec));
+		}
+	}
+
+	VERIFY (!result.values.empty(), std::runtime_error, "Sweep has no values: '" << spec << "'");
+	return result;
+}
+
+Sweep::Sweep (std::vector<Axis> axes, Options options)
+: axes_ (std::move (axes))
+, options_ (std::move (options))
+{
+	VERIFY (!axes_.empty(), std::logic_error, "Sweep without variables");
+}
+
+void Sweep::add_column (std::string name, const Node::Base& tree)
+{
+	std::vector<std::string> slots;
+
+	for (const Axis& axis: axes_) {
+		slots.push_back (axis.name);
+	}
+
+	columns_.emplace_back (tree, slots);
+	column_names_.push_back (std::move (name));
+}
+
+std::string Sweep::evaluate (size_t begin, size_t end) const
+{
+	size_t stack_size = 0;
+
+	for (const Program& column: columns_) {
+		stack_size = std::max (stack_size, column.stack_size());
+	}
+
+	std::vector<data_t> slots (axes_.size()), stack (stack_size);
+	std::vector<double> row;
+	std::ostringstream text;
+	std::string binary;
+
+	text << std::setprecision (std::numeric_limits<double>::max_digits10);
+
+	for (size_t point = begin; point < end; ++point) {
+		/* the index of the point in mixed radix, the last axis being the least significant digit */
+		size_t rest = point;
+
+		for (size_t i = axes_.size(); i-- > 0; ) {
+			slots[i] = axes_[i].values[rest % axes_[i].values.size()];
+			rest /= axes_[i].values.size();
+		}
+
+		row.assign (slots.begin(), slots.end());
+
+		for (const Program& column: columns_) {
+			row.push_back (column.evaluate (slots.data(), stack.data()));
+		}
+
+		switch (options_.format) {
+		case Format::CSV:
+			for (size_t i = 0; i < row.size(); ++i) {
+				if (i) {
+					text << ',';
+				}
+				text << row[i];
+			}
+			text << '\n';
+			break;
+
+		case Format::Binary:
+			binary.append (reinterpret_cast<const char*> (row.data()), row.size() * sizeof (double));
+			break;
+		}
+	}
+
+	return (options_.format == Format::CSV) ? text.str() : binary;
+}
+
+void Sweep::run (std::ostream& out) const
+{
+	size_t points = 1;
+
+	for (const Axis& axis: axes_) {
+		VERIFY (points <= std::numeric_limits<size_t>::max() / axis.values.size(), std::runtime_error, "Sweep has too many points");
+		points *= axis.values.size();
+	}
+
+	if (options_.format == Format::CSV) {
+		for (const Axis& axis: axes_) {
+			out << axis.name << ',';
+		}
+
+		for (size_t i = 0; i < column_names_.size(); ++i) {
+			out << (i ? "," : "") << column_names_[i];
+		}
+
+		out << '\n';
+	}
+
+	ThreadPool pool (options_.jobs);
+	std::deque<std::future<std::string>> pending;
+
+	for (size_t begin = 0; begin < points; begin += chunk_size) {
+		size_t end = std::min (points, begin + chunk_size);
+		pending.push_back (pool.submit ([this, begin, end] { return evaluate (begin, end); }));
+
+		while (pending.size() > chunks_per_worker * pool.size()) {
+			out << pending.front().get();
+			pending.pop_front();
+		}
+	}
+
+	while (!pending.empty()) {
+		out << pending.front().get();
+		pending.pop_front();
+	}
+
+	out << std::flush;
+}
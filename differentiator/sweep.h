@@ -0,0 +1,55 @@
+#pragma once
+
+#include "program.h"
+
+/*
+ * Sweep mode: evaluates a set of expressions (the value, derivatives, error) over the Cartesian product
+ * of the values of one or more variables, writing a table with a row per point.
+ *
+ * Each expression is compiled once (see program.h); the points are evaluated on a pool of worker threads
+ * in chunks, and the chunks are written in order as soon as they are ready.
+ */
+
+class Sweep
+{
+public:
+	enum class Format
+	{
+		CSV,    /* a header line and comma-separated rows */
+		Binary  /* rows of native-endian doubles, without a header */
+	};
+
+	struct Axis
+	{
+		std::string name;
+		std::vector<data_t> values;
+
+		/* parses "NAME START:STEP:STOP" or "NAME VALUE,VALUE,..." */
+		static Axis parse (const std::string& spec);
+	};
+
+	struct Options
+	{
+		unsigned jobs = 1;
+		Format format = Format::CSV;
+	};
+
+	Sweep (std::vector<Axis> axes, Options options);
+
+	/* the first axis varies the slowest */
+	const std::vector<Axis>& axes() const { return axes_; }
+
+	void add_column (std::string name, const Node::Base& tree);
+
+	void run (std::ostream& out) const;
+
+private:
+	std::vector<Axis> axes_;
+	Options options_;
+
+	std::vector<std::string> column_names_;
+	std::vector<Program> columns_;
+
+	/* evaluates and formats the rows [begin, end) */
+	std::string evaluate (size_t begin, size_t end) const;
+};
@@ -2,6 +2,14 @@
 #include "visitor.h"
 #include "visitor-simplify.h"
 #include "visitor-differentiate.h"
+#include "visitor-gradient.h"
+#include "derivative-tower.h"
+#include "egraph.h"
+#include "visitor-jet.h"
+#include "budget.h"
+#include "stats.h"
+
+#include <util/thread-pool.h>
 
 /*
  * Main data
@@ -21,32 +29,239 @@ void insert_constants()
 	variables.insert (Variable::make<data_t> ("g", 9.81, 0, true));
 }
 
+size_t count_nodes (const Node::Base& tree, size_t limit)
+{
+	std::vector<const Node::Base*> stack { &tree };
+	size_t result = 0;
+
+	while (!stack.empty() && (result < limit)) {
+		const Node::Base* next = stack.back();
+		stack.pop_back();
+		++result;
+
+		if (const Node::Power* power = dynamic_cast<const Node::Power*> (next)) {
+			stack.push_back (power->get_base().get());
+			stack.push_back (power->get_exponent().get());
+		} else if (const Node::Function* function = dynamic_cast<const Node::Function*> (next)) {
+			for (const auto& child: function->children()) {
+				stack.push_back (child.node.get());
+			}
+		} else if (const Node::AdditionSubtraction* addsub = dynamic_cast<const Node::AdditionSubtraction*> (next)) {
+			for (const auto& child: addsub->children()) {
+				stack.push_back (child.node.get());
+			}
+		} else if (const Node::MultiplicationDivision* muldiv = dynamic_cast<const Node::MultiplicationDivision*> (next)) {
+			for (const auto& child: muldiv->children()) {
+				stack.push_back (child.node.get());
+			}
+		}
+	}
+
+	return result;
+}
+
+size_t tree_depth (const Node::Base& tree)
+{
+	std::vector<std::pair<const Node::Base*, size_t>> stack { { &tree, 1 } };
+	size_t result = 0;
+
+	while (!stack.empty()) {
+		const Node::Base* next = stack.back().first;
+		size_t depth = stack.back().second;
+		stack.pop_back();
+
+		result = std::max (result, depth);
+
+		if (const Node::Power* power = dynamic_cast<const Node::Power*> (next)) {
+			stack.emplace_back (power->get_base().get(), depth + 1);
+			stack.emplace_back (power->get_exponent().get(), depth + 1);
+		} else if (const Node::Function* function = dynamic_cast<const Node::Function*> (next)) {
+			for (const auto& child: function->children()) {
+				stack.emplace_back (child.node.get(), depth + 1);
+			}
+		} else if (const Node::AdditionSubtraction* addsub = dynamic_cast<const Node::AdditionSubtraction*> (next)) {
+			for (const auto& child: addsub->children()) {
+				stack.emplace_back (child.node.get(), depth + 1);
+			}
+		} else if (const Node::MultiplicationDivision* muldiv = dynamic_cast<const Node::MultiplicationDivision*> (next)) {
+			for (const auto& child: muldiv->children()) {
+				stack.emplace_back (child.node.get(), depth + 1);
+			}
+		}
+	}
+
+	return result;
+}
+
+namespace {
+
+/*
+ * Runs the e-graph simplifier (if enabled) over a result of Visitor::Simplify.
+ * The hint is an equivalent tree (e. g. the unsimplified source) to be considered as well.
+ */
+
+Node::Base::Ptr saturate_tree (Node::Base::Ptr&& tree, const Node::Base* hint = nullptr)
+{
+	if (!EGraphSimplifier::options.enabled) {
+		return std::move (tree);
+	}
+
+	return EGraphSimplifier::simplify (*tree, hint);
+}
+
+} // anonymous namespace
+
 Node::Base::Ptr simplify_tree (Node::Base* tree)
 {
+	Budget::Scope budget;
 	Visitor::Simplify simplifier;
 
-	return tree->accept_ptr (simplifier);
+	return saturate_tree (tree->accept_ptr (simplifier), tree);
 }
 
 Node::Base::Ptr simplify_tree (Node::Base* tree, const std::string& partial_variable)
 {
+	Budget::Scope budget;
 	Visitor::Simplify simplifier (partial_variable);
 
-	return tree->accept_ptr (simplifier);
+	/* the source is not equivalent to the result if any variables have been substituted */
+	return saturate_tree (tree->accept_ptr (simplifier));
 }
 
 Node::Base::Ptr differentiate (Node::Base* tree, const std::string& partial_variable, unsigned int order /* = 1 */)
+{
+	Budget::Scope budget;
+
+	if (order == 1) {
+		STATS_PHASE (stats, "differentiate d/d" + partial_variable);
+		STATS_INPUT (stats, *tree);
+
+		Visitor::Simplify simplifier;
+		Visitor::Differentiate differentiator (partial_variable);
+
+		Node::Base::Ptr result = saturate_tree (tree->accept_ptr (differentiator)
+		                                            ->accept_ptr (simplifier));
+		STATS_OUTPUT (stats, *result);
+		return result;
+	}
+
+	DerivativeTower tower (*tree, partial_variable);
+
+	/* the orders are built one by one anyway; do it explicitly so that each is measured as a phase */
+	for (unsigned k = 1; k <= order; ++k) {
+		STATS_PHASE (stats, BUILD_STRING ("differentiate d^" << k << "/d" << partial_variable << "^" << k));
+		STATS_INPUT (stats, *tower.get (k - 1));
+		tower.get (k);
+		STATS_OUTPUT (stats, *tower.get (k));
+	}
+
+	return saturate_tree (tower.get (order)->clone());
+}
+
+namespace {
+
+std::map<std::string, Node::Base::Ptr> gradient_sequential (const Node::Base* tree, const std::set<std::string>& partial_variables)
 {
 	Visitor::Simplify simplifier;
-	Visitor::Differentiate differentiator (partial_variable);
+	Visitor::Gradient::Partials partials = Visitor::Gradient (partial_variables).compute (*tree);
+
+	for (auto& partial: partials) {
+		partial.second = saturate_tree (partial.second->accept_ptr (simplifier));
+	}
+
+	return partials;
+}
+
+} // anonymous namespace
+
+std::map<std::string, Node::Base::Ptr> gradient (const Node::Base* tree, const std::set<std::string>& partial_variables, unsigned jobs /* = 1 */)
+{
+	Budget::Scope budget;
+	size_t groups_count = std::min<size_t> (jobs, partial_variables.size());
+
+	if (groups_count <= 1) {
+		return gradient_sequential (tree, partial_variables);
+	}
+
+	/* distribute the variables round-robin */
+	std::vector<std::set<std::string>> groups (groups_count);
+	size_t next_group = 0;
+
+	for (const std::string& variable: partial_variables) {
+		groups[next_group++ % groups_count].insert (variable);
+	}
+
+	ThreadPool pool (groups_count);
+	std::vector<std::future<std::map<std::string, Node::Base::Ptr>>> results;
+	Budget::Handle operation = Budget::current();
+
+	for (const std::set<std::string>& group: groups) {
+		results.push_back (pool.submit ([tree, &group, operation] {
+			Budget::Scope budget (operation);
+			return gradient_sequential (tree, group);
+		}));
+	}
+
+	std::map<std::string, Node::Base::Ptr> partials;
 
-	Node::Base::Ptr ret = tree->accept_ptr (differentiator)
-	                          ->accept_ptr (simplifier);
+	for (auto& result: results) {
+		for (auto& partial: result.get()) {
+			partials.emplace (partial.first, std::move (partial.second));
+		}
+	}
+
+	return partials;
+}
+
+std::vector<boost::any> taylor_coefficients (const Node::Base* tree, const std::string& variable, unsigned order)
+{
+	std::vector<boost::any> result;
+
+	try {
+		for (const rational_t& coefficient: Visitor::Jet<rational_t> (variable, order).compute (*tree)) {
+			result.push_back (coefficient);
+		}
+	} catch (Visitor::JetNotRational&) {
+		result.clear();
+
+		for (data_t coefficient: Visitor::Jet<data_t> (variable, order).compute (*tree)) {
+			result.push_back (coefficient);
+		}
+	}
+
+	return result;
+}
+
+Node::Base::Ptr error_tree (const std::map<std::string, const Node::Base*>& partials, const Variable::Map& variables)
+{
+	Node::AdditionSubtraction::Ptr error_sq_sum (new Node::AdditionSubtraction);
+
+	for (const auto& partial: partials) {
+		auto var = variables.find (partial.first);
+		ASSERT (var != variables.end(), "Cannot find variable '" << partial.first << "' while computing error, despite differential exists");
+
+		if (var->second.no_error()) {
+			continue;
+		}
 
-	for (unsigned i = 1; i < order; ++i) {
-		ret = ret->accept_ptr (differentiator)
-		         ->accept_ptr (simplifier);
+		Node::Variable::Ptr error (new Node::Variable (var->first, var->second, true));
+
+		// dF/dx * error(x)
+		Node::MultiplicationDivision::Ptr product (new Node::MultiplicationDivision);
+		product->add_child (partial.second->clone(), false);
+		product->add_child (std::move (error), false);
+
+		// (dF/dx * error(x))^2
+		Node::Power::Ptr product_sq (new Node::Power);
+		product_sq->set_base (std::move (product));
+		product_sq->set_exponent (Node::Base::Ptr (new Node::Value (2)));
+
+		error_sq_sum->add_child (std::move (product_sq), false);
 	}
 
-	return ret;
+	Node::Power::Ptr error_sqrt (new Node::Power);
+	error_sqrt->set_base (std::move (error_sq_sum));
+	error_sqrt->set_exponent (Node::Base::Ptr (new Node::Value (rational_t (1, 2))));
+
+	return error_sqrt;
 }
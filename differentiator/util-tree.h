@@ -15,6 +15,43 @@ extern Variable::Map variables;
 
 void insert_constants();
 
+/*
+ * Returns the count of nodes in the tree, or any count not less than the limit if it is larger.
+ */
+
+size_t count_nodes (const Node::Base& tree, size_t limit = std::numeric_limits<size_t>::max());
+
+/*
+ * Returns the count of nodes on the longest path from the root to a leaf.
+ */
+
+size_t tree_depth (const Node::Base& tree);
+
 Node::Base::Ptr simplify_tree (Node::Base* tree);
 Node::Base::Ptr simplify_tree (Node::Base* tree, const std::string& partial_variable);
 Node::Base::Ptr differentiate (Node::Base* tree, const std::string& partial_variable, unsigned order = 1);
+
+/*
+ * Computes simplified first-order partial derivatives for all given variables in a single traversal.
+ * Variables which do not occur in the tree are omitted from the result.
+ *
+ * With jobs > 1, the variables are split into groups which are differentiated and simplified concurrently,
+ * each by its own visitors; the tree is shared between the threads and must not be modified meanwhile.
+ */
+
+std::map<std::string, Node::Base::Ptr> gradient (const Node::Base* tree, const std::set<std::string>& partial_variables, unsigned jobs = 1);
+
+/*
+ * Computes the Taylor coefficients f^(k)(a) / k!, k = 0..order, of the tree for the given variable
+ * at the current values of the variables, numerically (without building the derivatives).
+ * The coefficients are exact (rational_t) when possible, data_t otherwise.
+ */
+
+std::vector<boost::any> taylor_coefficients (const Node::Base* tree, const std::string& variable, unsigned order);
+
+/*
+ * Builds the (unsimplified) error estimate sqrt (Σ (dF/dx * Δx)^2) from the first-order partial derivatives
+ * of a function for variables having a non-zero error.
+ */
+
+Node::Base::Ptr error_tree (const std::map<std::string, const Node::Base*>& partials, const Variable::Map& variables);
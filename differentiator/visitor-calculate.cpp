@@ -9,12 +9,19 @@ boost::any Calculate::visit (const Node::Value& node)
 
 boost::any Calculate::visit (const Node::Variable& node)
 {
+	if (values_) {
+		auto it = values_->find (node.name());
+		if (it != values_->end()) {
+			return node.is_error() ? it->second.error : it->second.value;
+		}
+	}
+
 	return node.value();
 }
 
 boost::any Calculate::visit (const Node::Function& node)
 {
-	typedef std::list<Node::TaggedChild<void>> Children;
+	typedef Node::Function::Children Children;
 	typedef std::function<boost::any(Base&, const Children&)> Calculator;
 
 	static std::unordered_map<std::string, Calculator> calculators {
@@ -43,11 +50,12 @@ boost::any Calculate::visit (const Node::Power& node)
 		return boost::any();
 	} else if (any_isa<rational_t> (base) &&
 	           any_isa<rational_t> (exponent)) {
-		rational_t exponent_r = any_to_rational (exponent);
+		rational_t result;
 
-		// only attempt rational calculations if we do not need to take roots
-		if (exponent_r.denominator() == 1) {
-			return pow_frac (any_to_rational (base), exponent_r.numerator());
+		// only attempt rational calculations if the roots (if any) are exact and there is no division by zero
+		if (((any_to_rational (base) != 0) || (any_to_rational (exponent) >= 0)) &&
+		    pow_frac_exact (any_to_rational (base), any_to_rational (exponent), result)) {
+			return result;
 		}
 		// otherwise fall through to real-number calculations
 	}
@@ -101,7 +109,8 @@ boost::any Calculate::visit (const Node::MultiplicationDivision& node)
 
 		if (next.empty()) {
 			return boost::any();
-		} else if (is_rational && any_isa<rational_t> (next)) {
+		} else if (is_rational && any_isa<rational_t> (next) && !(child.tag.reciprocated && (any_to_rational (next) == 0))) {
+			/* division by an exact zero is done in real numbers below (as it was before the roots became exact) */
 			if (child.tag.reciprocated) {
 				result_r /= any_to_rational (next);
 			} else {
@@ -6,7 +6,15 @@ namespace Visitor {
 
 class Calculate : public Base
 {
+	const ::Variable::Map* values_;
+
 public:
+	/*
+	 * If given, the values of variables are looked up by name in the map rather than taken
+	 * from the variables the tree has been parsed with (so that a tree may be reused for other values).
+	 */
+	explicit Calculate (const ::Variable::Map* values = nullptr) : values_ (values) { }
+
 	virtual boost::any visit (const Node::Value& node);
 	virtual boost::any visit (const Node::Variable& node);
 	virtual boost::any visit (const Node::Function& node);
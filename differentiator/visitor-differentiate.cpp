@@ -1,4 +1,5 @@
 #include "visitor-differentiate.h"
+#include "budget.h"
 
 namespace Visitor {
 
@@ -9,11 +10,15 @@ Differentiate::Differentiate(const std::string& variable)
 
 boost::any Differentiate::visit (const Node::Value&)
 {
+	Budget::check ("Differentiate");
+
 	return static_cast<Node::Base*> (new Node::Value (0));
 }
 
 boost::any Differentiate::visit (const Node::Variable& node)
 {
+	Budget::check ("Differentiate");
+
 	if (node.is_target_variable (variable_)) {
 		return static_cast<Node::Base*> (new Node::Value (1));
 	} else {
@@ -23,8 +28,9 @@ boost::any Differentiate::visit (const Node::Variable& node)
 
 boost::any Differentiate::visit (const Node::Function& node)
 {
+	Budget::check ("Differentiate");
 
-	typedef std::list<Node::TaggedChild<void>> Children;
+	typedef Node::Function::Children Children;
 	typedef std::function<Node::Base*(Base&, const Children&)> Differentiator;
 
 	static std::unordered_map<std::string, Differentiator> differentiators {
@@ -48,6 +54,8 @@ boost::any Differentiate::visit (const Node::Function& node)
 
 boost::any Differentiate::visit (const Node::AdditionSubtraction& node)
 {
+	Budget::check ("Differentiate");
+
 	Node::AdditionSubtraction::Ptr result (new Node::AdditionSubtraction);
 
 	for (auto& child: node.children()) {
@@ -59,6 +67,8 @@ boost::any Differentiate::visit (const Node::AdditionSubtraction& node)
 
 boost::any Differentiate::visit (const Node::MultiplicationDivision& node)
 {
+	Budget::check ("Differentiate");
+
 	Node::MultiplicationDivision::Ptr so_far (new Node::MultiplicationDivision);
 	Node::Base::Ptr deriv_so_far;
 
@@ -124,6 +134,8 @@ boost::any Differentiate::visit (const Node::MultiplicationDivision& node)
 
 boost::any Differentiate::visit (const Node::Power& node)
 {
+	Budget::check ("Differentiate");
+
 	/* f, a */
 	const Node::Base::Ptr &base = node.get_base(),
 	                      &exponent = node.get_exponent();
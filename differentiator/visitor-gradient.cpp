@@ -0,0 +1,216 @@
+#include "visitor-gradient.h"
+#include "budget.h"
+
+namespace {
+
+/* accumulates a sum of terms for each variable */
+class PartialSums
+{
+	std::map<std::string, Node::AdditionSubtraction::Ptr> sums_;
+
+public:
+	void add (const std::string& variable, Node::Base::Ptr&& term, bool negate)
+	{
+		Node::AdditionSubtraction::Ptr& sum = sums_[variable];
+		if (!sum) {
+			sum = Node::AdditionSubtraction::Ptr (new Node::AdditionSubtraction);
+		}
+		sum->add_child (std::move (term), negate);
+	}
+
+	Visitor::Gradient::Partials* release()
+	{
+		std::unique_ptr<Visitor::Gradient::Partials> result (new Visitor::Gradient::Partials);
+
+		for (auto& sum: sums_) {
+			Node::AdditionSubtraction* sum_node = sum.second.get();
+			result->emplace (sum.first, sum_node->decay_move (Node::Base::Ptr (sum.second.release())));
+		}
+
+		return result.release();
+	}
+};
+
+} // anonymous namespace
+
+namespace Visitor {
+
+Gradient::Gradient (std::set<std::string> variables)
+: variables_ (std::move (variables))
+{
+}
+
+std::unique_ptr<Gradient::Partials> Gradient::accept_partials (const Node::Base& node)
+{
+	return std::unique_ptr<Partials> (boost::any_cast<Partials*> (node.accept (*this)));
+}
+
+Gradient::Partials Gradient::compute (const Node::Base& node)
+{
+	return std::move (*accept_partials (node));
+}
+
+boost::any Gradient::visit (const Node::Value&)
+{
+	Budget::check ("Gradient");
+
+	return new Partials;
+}
+
+boost::any Gradient::visit (const Node::Variable& node)
+{
+	Budget::check ("Gradient");
+
+	std::unique_ptr<Partials> result (new Partials);
+
+	if (!node.is_error() && variables_.count (node.name())) {
+		result->emplace (node.name(), Node::Base::Ptr (new Node::Value (1)));
+	}
+
+	return result.release();
+}
+
+boost::any Gradient::visit (const Node::Function& node)
+{
+	Budget::check ("Gradient");
+
+	typedef Node::Function::Children Children;
+	typedef std::function<Node::Base::Ptr(const Children&, Node::Base::Ptr&&)> Differentiator;
+
+	/* each differentiator applies the chain rule to the derivative of the (only) argument */
+	static std::unordered_map<std::string, Differentiator> differentiators {
+		{ "ln", [](const Children& children, Node::Base::Ptr&& deriv_argument) -> Node::Base::Ptr {
+			Node::MultiplicationDivision::Ptr result (new Node::MultiplicationDivision);
+
+			result->add_child (std::move (deriv_argument), false);
+			result->add_child (children.front().node->clone(), true);
+
+			return result;
+		} }
+	};
+
+	std::unique_ptr<Partials> result (new Partials);
+
+	if (node.children().empty()) {
+		return result.release();
+	}
+
+	std::unique_ptr<Partials> argument_partials = accept_partials (*node.children().front().node);
+	if (argument_partials->empty()) {
+		return result.release();
+	}
+
+	auto it = differentiators.find (node.name());
+	if (it == differentiators.end()) {
+		ERROR (std::runtime_error, "Gradient error: unknown function: '" << node.name() << "'");
+	}
+
+	for (auto& partial: *argument_partials) {
+		result->emplace (partial.first, it->second (node.children(), std::move (partial.second)));
+	}
+
+	return result.release();
+}
+
+boost::any Gradient::visit (const Node::Power& node)
+{
+	Budget::check ("Gradient");
+
+	/* f, a */
+	const Node::Base::Ptr &base = node.get_base(),
+	                      &exponent = node.get_exponent();
+
+	std::unique_ptr<Partials> result (new Partials),
+	                          base_partials = accept_partials (*base),
+	                          exponent_partials = accept_partials (*exponent);
+
+	if (!exponent_partials->empty()) {
+		ERROR (std::runtime_error, "Gradient error: sorry, unimplemented: exponent depends on a differentiation variable");
+	}
+
+	if (base_partials->empty()) {
+		return result.release();
+	}
+
+	const Node::Value* exponent_value = dynamic_cast<const Node::Value*> (exponent.get());
+	if (!exponent_value) {
+		ERROR (std::runtime_error, "Gradient error: sorry, unimplemented: exponent is not a constant");
+	}
+
+	/* f^(a-1) */
+	Node::Power::Ptr pwr_minus_one (new Node::Power);
+	pwr_minus_one->set_base (base->clone());
+	pwr_minus_one->set_exponent (Node::Base::Ptr (new Node::Value (exponent_value->value() - 1)));
+
+	/* a * f^(a-1), shared by all partial derivatives */
+	Node::MultiplicationDivision::Ptr factor (new Node::MultiplicationDivision);
+	factor->add_child (exponent->clone(), false);
+	factor->add_child (std::move (pwr_minus_one), false);
+
+	/* a * f^(a-1) * f' */
+	for (auto& partial: *base_partials) {
+		Node::MultiplicationDivision::Ptr term (static_cast<Node::MultiplicationDivision*> (factor->clone().release()));
+		term->add_child (std::move (partial.second), false);
+		result->emplace (partial.first, std::move (term));
+	}
+
+	return result.release();
+}
+
+boost::any Gradient::visit (const Node::AdditionSubtraction& node)
+{
+	Budget::check ("Gradient");
+
+	PartialSums sums;
+
+	for (auto& child: node.children()) {
+		std::unique_ptr<Partials> child_partials = accept_partials (*child.node);
+
+		for (auto& partial: *child_partials) {
+			sums.add (partial.first, std::move (partial.second), child.tag.negated);
+		}
+	}
+
+	return sums.release();
+}
+
+boost::any Gradient::visit (const Node::MultiplicationDivision& node)
+{
+	Budget::check ("Gradient");
+
+	PartialSums sums;
+
+	for (auto it = node.children().begin(); it != node.children().end(); ++it) {
+		std::unique_ptr<Partials> child_partials = accept_partials (*it->node);
+
+		if (child_partials->empty()) {
+			continue;
+		}
+
+		/* the product of all other factors, shared by all partial derivatives of this factor:
+		 * (f * g)' = f * g' + ...
+		 * (f / g)' = - f * g' / g^2 + ... */
+		Node::MultiplicationDivision::Ptr others (new Node::MultiplicationDivision);
+
+		for (auto other = node.children().begin(); other != node.children().end(); ++other) {
+			if (other != it) {
+				others->add_child (other->node->clone(), other->tag.reciprocated);
+			}
+		}
+
+		if (it->tag.reciprocated) {
+			others->add_child (it->node->clone(), true);
+			others->add_child (it->node->clone(), true);
+		}
+
+		for (auto& partial: *child_partials) {
+			Node::MultiplicationDivision::Ptr term (static_cast<Node::MultiplicationDivision*> (others->clone().release()));
+			term->add_child (std::move (partial.second), false);
+			sums.add (partial.first, std::move (term), it->tag.reciprocated);
+		}
+	}
+
+	return sums.release();
+}
+
+} // namespace Visitor
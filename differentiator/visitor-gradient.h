@@ -0,0 +1,37 @@
+#pragma once
+
+#include "visitor.h"
+
+namespace Visitor {
+
+/*
+ * Computes first-order partial derivatives for a set of variables in a single traversal.
+ * Each node yields a sparse map holding derivatives only for the requested variables it depends on,
+ * so a subtree which does not contain a variable is never differentiated for it.
+ * The result is not simplified.
+ */
+
+class Gradient : public Base
+{
+public:
+	typedef std::map<std::string, Node::Base::Ptr> Partials;
+
+private:
+	std::set<std::string> variables_;
+
+	std::unique_ptr<Partials> accept_partials (const Node::Base& node);
+
+public:
+	Gradient (std::set<std::string> variables);
+
+	Partials compute (const Node::Base& node);
+
+	virtual boost::any visit (const Node::Value& node);
+	virtual boost::any visit (const Node::Variable& node);
+	virtual boost::any visit (const Node::Function& node);
+	virtual boost::any visit (const Node::Power& node);
+	virtual boost::any visit (const Node::AdditionSubtraction& node);
+	virtual boost::any visit (const Node::MultiplicationDivision& node);
+};
+
+} // namespace Visitor
@@ -0,0 +1,318 @@
+#include "visitor-jet.h"
+
+namespace {
+
+/*
+ * Conversions and elementary functions for both coefficient types.
+ */
+
+template <typename T>
+T from_any (const boost::any& value);
+
+template <>
+rational_t from_any<rational_t> (const boost::any& value)
+{
+	if (!any_isa<rational_t> (value)) {
+		throw Visitor::JetNotRational();
+	}
+	return any_to_rational (value);
+}
+
+template <>
+data_t from_any<data_t> (const boost::any& value)
+{
+	return any_to_fp (value);
+}
+
+template <typename T>
+T from_rational (const rational_t& value);
+
+template <>
+rational_t from_rational<rational_t> (const rational_t& value)
+{
+	return value;
+}
+
+template <>
+data_t from_rational<data_t> (const rational_t& value)
+{
+	return to_fp (value);
+}
+
+/* computes base^exponent where exponent is a constant */
+rational_t power (const rational_t& base, const rational_t& exponent)
+{
+	rational_t result;
+	if (((base == 0) && (exponent < 0)) || !pow_frac_exact (base, exponent, result)) {
+		throw Visitor::JetNotRational();
+	}
+	return result;
+}
+
+data_t power (data_t base, data_t exponent)
+{
+	return powl (base, exponent);
+}
+
+rational_t logarithm (const rational_t& value)
+{
+	if (value != 1) {
+		throw Visitor::JetNotRational();
+	}
+	return rational_t (0);
+}
+
+data_t logarithm (data_t value)
+{
+	return logl (value);
+}
+
+rational_t exponential (const rational_t& value)
+{
+	if (value != 0) {
+		throw Visitor::JetNotRational();
+	}
+	return rational_t (1);
+}
+
+data_t exponential (data_t value)
+{
+	return expl (value);
+}
+
+/*
+ * Operations on truncated power series.
+ */
+
+template <typename T>
+std::vector<T> series_multiply (const std::vector<T>& a, const std::vector<T>& b)
+{
+	std::vector<T> result (a.size(), T (0));
+
+	for (size_t k = 0; k < result.size(); ++k) {
+		for (size_t j = 0; j <= k; ++j) {
+			result[k] += a[j] * b[k - j];
+		}
+	}
+
+	return result;
+}
+
+template <typename T>
+std::vector<T> series_divide (const std::vector<T>& a, const std::vector<T>& b)
+{
+	VERIFY (b[0] != T (0), std::runtime_error, "Jet error: division by a series with zero constant term");
+
+	std::vector<T> result (a.size(), T (0));
+
+	for (size_t k = 0; k < result.size(); ++k) {
+		T sum = a[k];
+		for (size_t j = 1; j <= k; ++j) {
+			sum -= b[j] * result[k - j];
+		}
+		result[k] = sum / b[0];
+	}
+
+	return result;
+}
+
+/* ln a: b' = a' / a */
+template <typename T>
+std::vector<T> series_log (const std::vector<T>& a)
+{
+	VERIFY (a[0] != T (0), std::runtime_error, "Jet error: logarithm of a series with zero constant term");
+
+	std::vector<T> result (a.size(), T (0));
+	result[0] = logarithm (a[0]);
+
+	for (size_t k = 1; k < result.size(); ++k) {
+		T sum (0);
+		for (size_t j = 1; j < k; ++j) {
+			sum += T (j) * result[j] * a[k - j];
+		}
+		result[k] = (a[k] - sum / T (k)) / a[0];
+	}
+
+	return result;
+}
+
+/* exp a: b' = a' b */
+template <typename T>
+std::vector<T> series_exp (const std::vector<T>& a)
+{
+	std::vector<T> result (a.size(), T (0));
+	result[0] = exponential (a[0]);
+
+	for (size_t k = 1; k < result.size(); ++k) {
+		T sum (0);
+		for (size_t j = 1; j <= k; ++j) {
+			sum += T (j) * a[j] * result[k - j];
+		}
+		result[k] = sum / T (k);
+	}
+
+	return result;
+}
+
+/* a^r for a constant r: a b' = r a' b */
+template <typename T>
+std::vector<T> series_power (const std::vector<T>& a, const T& exponent)
+{
+	std::vector<T> result (a.size(), T (0));
+
+	if (a[0] == T (0)) {
+		/* the recurrence does not apply, but a non-negative integer power is a repeated product */
+		rational_t exponent_r;
+		try {
+			exponent_r = from_any<rational_t> (boost::any (exponent));
+		} catch (Visitor::JetNotRational&) {
+			ERROR (std::runtime_error, "Jet error: non-rational power of a series with zero constant term");
+		}
+
+		VERIFY ((exponent_r.denominator() == 1) && (exponent_r >= 0), std::runtime_error,
+		        "Jet error: negative or fractional power of a series with zero constant term");
+
+		result[0] = T (1);
+		for (integer_t i = 0; i < exponent_r.numerator(); ++i) {
+			result = series_multiply (result, a);
+		}
+		return result;
+	}
+
+	result[0] = power (a[0], exponent);
+
+	for (size_t k = 1; k < result.size(); ++k) {
+		T sum (0);
+		for (size_t j = 1; j <= k; ++j) {
+			sum += (exponent * T (j) - T (k - j)) * a[j] * result[k - j];
+		}
+		result[k] = sum / (T (k) * a[0]);
+	}
+
+	return result;
+}
+
+template <typename T>
+bool series_is_constant (const std::vector<T>& a)
+{
+	return std::all_of (a.begin() + 1, a.end(), [] (const T& c) { return c == T (0); });
+}
+
+} // anonymous namespace
+
+namespace Visitor {
+
+template <typename T>
+Jet<T>::Jet (const std::string& variable, unsigned order)
+: variable_ (variable)
+, order_ (order)
+{
+}
+
+template <typename T>
+std::unique_ptr<typename Jet<T>::Series> Jet<T>::accept_series (const Node::Base& node)
+{
+	return std::unique_ptr<Series> (boost::any_cast<Series*> (node.accept (*this)));
+}
+
+template <typename T>
+typename Jet<T>::Series Jet<T>::compute (const Node::Base& node)
+{
+	return std::move (*accept_series (node));
+}
+
+template <typename T>
+typename Jet<T>::Series* Jet<T>::constant (const T& value)
+{
+	Series* result = new Series (order_ + 1, T (0));
+	(*result)[0] = value;
+	return result;
+}
+
+template <typename T>
+boost::any Jet<T>::visit (const Node::Value& node)
+{
+	return constant (from_rational<T> (node.value()));
+}
+
+template <typename T>
+boost::any Jet<T>::visit (const Node::Variable& node)
+{
+	boost::any value = node.value();
+	VERIFY (!value.empty(), std::runtime_error, "Jet error: variable '" << node.pretty_name() << "' has no value");
+
+	Series* result = constant (from_any<T> (value));
+
+	if (node.is_target_variable (variable_) && (order_ > 0)) {
+		(*result)[1] = T (1);
+	}
+
+	return result;
+}
+
+template <typename T>
+boost::any Jet<T>::visit (const Node::Function& node)
+{
+	VERIFY ((node.name() == "ln") && (node.children().size() == 1), std::runtime_error,
+	        "Jet error: unknown function: '" << node.name() << "'");
+
+	std::unique_ptr<Series> argument = accept_series (*node.children().front().node);
+	return new Series (series_log (*argument));
+}
+
+template <typename T>
+boost::any Jet<T>::visit (const Node::Power& node)
+{
+	std::unique_ptr<Series> base = accept_series (*node.get_base()),
+	                        exponent = accept_series (*node.get_exponent());
+
+	if (series_is_constant (*exponent)) {
+		return new Series (series_power (*base, (*exponent)[0]));
+	}
+
+	/* f^g = exp (g ln f) */
+	return new Series (series_exp (series_multiply (*exponent, series_log (*base))));
+}
+
+template <typename T>
+boost::any Jet<T>::visit (const Node::AdditionSubtraction& node)
+{
+	Series* result = constant (T (0));
+
+	for (const auto& child: node.children()) {
+		std::unique_ptr<Series> term = accept_series (*child.node);
+
+		for (size_t k = 0; k < result->size(); ++k) {
+			if (child.tag.negated) {
+				(*result)[k] -= (*term)[k];
+			} else {
+				(*result)[k] += (*term)[k];
+			}
+		}
+	}
+
+	return result;
+}
+
+template <typename T>
+boost::any Jet<T>::visit (const Node::MultiplicationDivision& node)
+{
+	std::unique_ptr<Series> result (constant (T (1)));
+
+	for (const auto& child: node.children()) {
+		std::unique_ptr<Series> factor = accept_series (*child.node);
+
+		if (child.tag.reciprocated) {
+			*result = series_divide (*result, *factor);
+		} else {
+			*result = series_multiply (*result, *factor);
+		}
+	}
+
+	return result.release();
+}
+
+template class Jet<rational_t>;
+template class Jet<data_t>;
+
+} // namespace Visitor
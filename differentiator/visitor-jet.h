@@ -0,0 +1,45 @@
+#pragma once
+
+#include "visitor.h"
+
+namespace Visitor {
+
+/*
+ * Computes the Taylor coefficients f(a), f'(a), f''(a) / 2!, ..., f^(n)(a) / n! of an expression
+ * for a single variable at the current values of all variables, by arithmetic on truncated power series
+ * (Taylor-mode automatic differentiation). Nothing is built symbolically, so the cost is polynomial
+ * in the order regardless of how the symbolic derivatives would grow.
+ *
+ * T is the coefficient type: rational_t (exact, fails with JetNotRational if the result is not rational)
+ * or data_t.
+ */
+
+struct JetNotRational { };
+
+template <typename T>
+class Jet : public Base
+{
+public:
+	typedef std::vector<T> Series;
+
+private:
+	std::string variable_;
+	unsigned order_;
+
+	std::unique_ptr<Series> accept_series (const Node::Base& node);
+	Series* constant (const T& value);
+
+public:
+	Jet (const std::string& variable, unsigned order);
+
+	Series compute (const Node::Base& node);
+
+	virtual boost::any visit (const Node::Value& node);
+	virtual boost::any visit (const Node::Variable& node);
+	virtual boost::any visit (const Node::Function& node);
+	virtual boost::any visit (const Node::Power& node);
+	virtual boost::any visit (const Node::AdditionSubtraction& node);
+	virtual boost::any visit (const Node::MultiplicationDivision& node);
+};
+
+} // namespace Visitor
@@ -8,7 +8,8 @@ namespace {
 const std::string border_width = "10pt";
 const std::string extra_left_border_width = "0pt";
 
-void rational_to_latex (std::ostream& out, const rational_t& obj)
+template <typename Output>
+void rational_to_latex (Output& out, const rational_t& obj)
 {
 	if (obj.denominator() == 1) {
 		out << obj.numerator();
@@ -17,7 +18,8 @@ void rational_to_latex (std::ostream& out, const rational_t& obj)
 	}
 }
 
-void fp_to_latex (std::ostream& out, data_t value)
+template <typename Output>
+void fp_to_latex (Output& out, data_t value)
 {
 	std::ostringstream ss;
 	ss << value;
@@ -32,7 +34,8 @@ void fp_to_latex (std::ostream& out, data_t value)
 	}
 }
 
-void any_to_latex (std::ostream& out, const boost::any& obj)
+template <typename Output>
+void any_to_latex (Output& out, const boost::any& obj)
 {
 	if (const rational_t* val = boost::any_cast<rational_t> (&obj)) {
 		rational_to_latex (out, *val);
@@ -118,10 +121,10 @@ void LaTeX::Document::write_equation_header (const std::string& name)
 	first_in_document_ = true;
 }
 
-void LaTeX::Document::print_expression (Node::Base* tree, Base& visitor)
+void LaTeX::Document::print_expression (Node::Base* tree, LaTeX& printer)
 {
 	stream_ << " & =";
-	tree->accept (visitor);
+	printer.print (*tree);
 	stream_ << " \\\\" << std::endl;
 }
 
@@ -170,7 +173,7 @@ void LaTeX::Document::print (const std::string& name, Node::Base* tree, Node::Ba
 
 boost::any LaTeX::visit (const Node::Value& node)
 {
-	rational_to_latex (stream_, node.value());
+	rational_to_latex (out_, node.value());
 
 	return boost::any();
 }
@@ -178,12 +181,12 @@ boost::any LaTeX::visit (const Node::Value& node)
 boost::any LaTeX::visit (const Node::Variable& node)
 {
 	if (substitute_ && node.can_be_substituted() && !node.value().empty()) {
-		any_to_latex (stream_, node.value());
+		any_to_latex (out_, node.value());
 	} else {
 		if (node.is_error()) {
-			stream_ << "\\sigma ";
+			out_ << "\\sigma ";
 		}
-		stream_ << prepare_name (node.name());
+		out_ << prepare_name (node.name());
 	}
 
 	return boost::any();
@@ -200,25 +203,25 @@ boost::any LaTeX::visit (const Node::Power& node)
 	    exponent_value->value().numerator() == 1) {
 		integer_t denominator = exponent_value->value().denominator();
 		if (denominator == 2) {
-			stream_ << "\\sqrt {";
+			out_ << "\\sqrt {";
 		} else {
-			stream_ << "\\sqrt[" << denominator << "] {";
+			out_ << "\\sqrt[" << denominator << "] {";
 		}
 		/* skip parenthesizing anything because { .. } are effectively parentheses */
 		base->accept (*this);
-		stream_ << "}";
+		out_ << "}";
 	} else if (exponent_value &&
 	           exponent_value->value() == rational_t (-1)) {
-		stream_ << "\\frac {1} {";
+		out_ << "\\frac {1} {";
 		/* skip parenthesizing anything because { .. } are effectively parentheses */
 		base->accept (*this);
-		stream_ << "}";
+		out_ << "}";
 	} else {
 		parenthesized_visit (node, base);
-		stream_ << "^{";
+		out_ << "^{";
 		/* skip parenthesizing anything because { .. } are effectively parentheses */
 		exponent->accept (*this);
-		stream_ << "}";
+		out_ << "}";
 	}
 
 	return boost::any();
@@ -237,7 +240,7 @@ boost::any LaTeX::visit (const Node::MultiplicationDivision& node)
 	}
 
 	if (div_count) {
-		stream_ << "\\frac {";
+		out_ << "\\frac {";
 	}
 
 	enum class State {
@@ -251,7 +254,7 @@ boost::any LaTeX::visit (const Node::MultiplicationDivision& node)
 		switch (state) {
 		case State::First:
 			if (child.tag.reciprocated) {
-				stream_ << "1} {";
+				out_ << "1} {";
 				state = State::Divisors;
 			} else {
 				state = State::Multipliers;
@@ -260,7 +263,7 @@ boost::any LaTeX::visit (const Node::MultiplicationDivision& node)
 
 		case State::Multipliers:
 			if (child.tag.reciprocated) {
-				stream_ << "} {";
+				out_ << "} {";
 				state = State::Divisors;
 			} else {
 				maybe_print_multiplication (child.node);
@@ -292,7 +295,7 @@ boost::any LaTeX::visit (const Node::MultiplicationDivision& node)
 	}
 
 	if (div_count) {
-		stream_ << "}";
+		out_ << "}";
 	}
 
 	return boost::any();
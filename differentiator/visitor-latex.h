@@ -20,7 +20,7 @@ public:
 		void write_equation_header (const std::string& name);
 		void write_equation_footer();
 
-		void print_expression (Node::Base* tree, Visitor::Base& visitor);
+		void print_expression (Node::Base* tree, LaTeX& printer);
 		void print_value (const boost::any& value);
 
 	public:
@@ -31,10 +31,8 @@ public:
 		void print (const std::string& name, Node::Base* tree, Node::Base* simplified);
 	};
 
-private:
 	LaTeX (std::ostream& stream, bool substitute);
 
-public:
     virtual boost::any visit (const Node::Value& node);
     virtual boost::any visit (const Node::Variable& node);
     virtual boost::any visit (const Node::Power& node);
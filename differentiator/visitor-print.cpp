@@ -3,7 +3,7 @@
 namespace Visitor {
 
 Print::Print (std::ostream& stream, bool substitute)
-: stream_ (stream)
+: out_ (stream)
 , substitute_ (substitute)
 , paren_left_ ("(")
 , paren_right_ (")")
@@ -11,25 +11,65 @@ Print::Print (std::ostream& stream, bool substitute)
 }
 
 Print::Print (std::ostream& stream, bool substitute, std::string paren_left, std::string paren_right)
-: stream_ (stream)
+: out_ (stream)
 , substitute_ (substitute)
 , paren_left_ (std::move (paren_left))
 , paren_right_ (std::move (paren_right))
 {
 }
 
+void Print::print (const Node::Base& node)
+{
+	print_start_ = out_.written();
+	marker_end_ = std::string::npos;
+	truncated_ = false;
+
+	node.accept (*this);
+	out_.flush();
+}
+
+bool Print::elide_rest()
+{
+	if (!truncated_ && elision_.characters && (out_.written() - print_start_ >= elision_.characters)) {
+		truncated_ = true;
+	}
+
+	/* mark each level which leaves something out (so that a cut numerator does not pass for
+	 * the whole fraction), but not twice in a row */
+	if (truncated_ && (out_.written() != marker_end_)) {
+		out_ << " …";
+		marker_end_ = out_.written();
+	}
+
+	return truncated_;
+}
+
+bool Print::elide_terms (size_t index, size_t count, const char* separator, const char* kind)
+{
+	if (elide_rest()) {
+		return true;
+	}
+
+	if (elision_.terms && (index == elision_.terms) && (count > elision_.terms)) {
+		out_ << separator << "… (" << BUILD_STRING (count - elision_.terms) << " more " << kind << ")";
+		return true;
+	}
+
+	return false;
+}
+
 boost::any Print::parenthesized_visit (Node::Priority parent_priority, const Node::Base::Ptr& child)
 {
 	bool need_parentheses = (child->priority() <= parent_priority);
 
 	if (need_parentheses) {
-		stream_ << paren_left_;
+		out_ << paren_left_;
 	}
 
 	boost::any ret = child->accept (*this);
 
 	if (need_parentheses) {
-		stream_ << paren_right_;
+		out_ << paren_right_;
 	}
 
 	return ret;
@@ -45,15 +85,15 @@ void Print::maybe_print_multiplication (const Node::Base::Ptr& child)
 {
 	/* elide multiplication sign only we're outputting symbolic variable names */
 	if (substitute_ || child->numeric_output()) {
-		stream_ << " * ";
+		out_ << " * ";
 	} else {
-		stream_ << " ";
+		out_ << " ";
 	}
 }
 
 boost::any Print::visit (const Node::Value& node)
 {
-	rational_to_ostream (stream_, node.value());
+	out_ << node.value();
 
 	return boost::any();
 }
@@ -61,9 +101,15 @@ boost::any Print::visit (const Node::Value& node)
 boost::any Print::visit (const Node::Variable& node)
 {
 	if (substitute_ && node.can_be_substituted() && !node.value().empty()) {
-		any_to_ostream (stream_, node.value());
+		boost::any value = node.value();
+
+		if (const rational_t* rational = boost::any_cast<rational_t> (&value)) {
+			out_ << *rational;
+		} else {
+			out_ << boost::any_cast<data_t> (value);
+		}
 	} else {
-		stream_ << node.pretty_name();
+		out_ << node.pretty_name();
 	}
 
 	return boost::any();
@@ -71,20 +117,20 @@ boost::any Print::visit (const Node::Variable& node)
 
 boost::any Print::visit (const Node::Function& node)
 {
-	stream_ << node.name() << "(";
+	out_ << node.name() << "(";
 
 	if (!node.children().empty()) {
 		auto child = node.children().begin();
 
 		(*child++).node->accept (*this);
 
-		while (child != node.children().end()) {
-			stream_ << ", ";
+		while ((child != node.children().end()) && !elide_rest()) {
+			out_ << ", ";
 			(*child++).node->accept (*this);
 		}
 	}
 
-	stream_ << ")";
+	out_ << ")";
 
 	return boost::any();
 }
@@ -100,24 +146,27 @@ boost::any Print::visit (const Node::Power& node)
 	    exponent_value->value().numerator() == 1) {
 		integer_t denominator = exponent_value->value().denominator();
 		if (denominator == 2) {
-			stream_ << "sqrt(";
+			out_ << "sqrt(";
 		} else if (denominator == 3) {
-			stream_ << "cbrt(";
+			out_ << "cbrt(";
 		} else {
-			stream_ << "root[" << denominator << "](";
+			out_ << "root[" << denominator << "](";
 		}
 		/* skip parenthesizing anything because { .. } are effectively parentheses */
 		base->accept (*this);
-		stream_ << ")";
+		out_ << ")";
 	} else if (exponent_value &&
 	           exponent_value->value() == rational_t (-1)) {
-		stream_ << "1 / ";
+		out_ << "1 / ";
 		/* parenthesize as if we were a muldiv node */
 		parenthesized_visit (Node::MultiplicationDivision::priority_static(), base);
 	} else {
 		parenthesized_visit (node, node.get_base());
-		stream_ << "^";
-		parenthesized_visit (node, node.get_exponent());
+
+		if (!elide_rest()) {
+			out_ << "^";
+			parenthesized_visit (node, node.get_exponent());
+		}
 	}
 
 	return boost::any();
@@ -126,12 +175,17 @@ boost::any Print::visit (const Node::Power& node)
 boost::any Print::visit (const Node::AdditionSubtraction& node)
 {
 	bool first = true;
+	size_t index = 0;
 
 	for (auto& child: node.children()) {
+		if (elide_terms (index++, node.children().size(), " + ", "terms")) {
+			break;
+		}
+
 		if (child.tag.negated) {
-			stream_ << " - ";
+			out_ << " - ";
 		} else if (!first) {
-			stream_ << " + ";
+			out_ << " + ";
 		}
 		parenthesized_visit (node, child.node);
 
@@ -144,15 +198,20 @@ boost::any Print::visit (const Node::AdditionSubtraction& node)
 boost::any Print::visit (const Node::MultiplicationDivision& node)
 {
 	bool first = true;
+	size_t index = 0;
 
 	for (auto& child: node.children()) {
+		if (elide_terms (index++, node.children().size(), " * ", "factors")) {
+			break;
+		}
+
 		if (first) {
 			if (child.tag.reciprocated) {
-				stream_ << " 1 / ";
+				out_ << " 1 / ";
 			}
 		} else {
 			if (child.tag.reciprocated) {
-				stream_ << " / ";
+				out_ << " / ";
 			} else if (!first) {
 				maybe_print_multiplication (child.node);
 			}
@@ -1,24 +1,50 @@
 #pragma once
 
 #include "visitor.h"
+#include "output-buffer.h"
 
 namespace Visitor {
 
 class Print : public Base
 {
+public:
+	/*
+	 * Limits for human-readable output of huge expressions (zero means "unlimited"):
+	 * sums and products with more than `terms` children are cut short, and printing stops
+	 * after about `characters` characters of an expression.
+	 */
+	struct Elision
+	{
+		size_t terms = 0;
+		size_t characters = 0;
+	};
+
 protected:
-	std::ostream& stream_;
+	OutputBuffer out_;
 	bool substitute_;
 	const std::string paren_left_, paren_right_;
 
+	Elision elision_;
+	size_t print_start_ = 0;
+	size_t marker_end_ = 0;
+	bool truncated_ = false;
+
 	boost::any parenthesized_visit (Node::Priority parent_priority, const Node::Base::Ptr& child);
 	boost::any parenthesized_visit (const Node::Base& parent, const Node::Base::Ptr& child);
 	void maybe_print_multiplication (const Node::Base::Ptr& child);
 
+	bool elide_rest();
+	bool elide_terms (size_t index, size_t count, const char* separator, const char* kind);
+
 public:
 	Print (std::ostream& stream, bool substitute);
 	Print (std::ostream& stream, bool substitute, std::string paren_left, std::string paren_right);
 
+	void elide (const Elision& elision) { elision_ = elision; }
+
+	/* prints the expression and flushes it to the stream (visiting the nodes directly leaves the output buffered) */
+	void print (const Node::Base& node);
+
 	virtual boost::any visit (const Node::Value& node);
 	virtual boost::any visit (const Node::Variable& node);
 	virtual boost::any visit (const Node::Function& node);
@@ -1,4 +1,13 @@
 #include "visitor-simplify.h"
+#include "budget.h"
+#include "polynomial.h"
+#include "util-tree.h"
+
+#include <util/thread-pool.h>
+
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
 
 namespace {
 
@@ -6,6 +15,144 @@ namespace {
 typedef std::map<Node::TaggedChild<void>, rational_t> DecompositionMap;
 typedef std::pair<Node::TaggedChild<void>, rational_t> StrippedNode;
 
+/*
+ * Profile of the rewrite rules
+ */
+
+enum class Rule
+{
+	ConstantFolding,
+	TrivialPower,
+	PowerOfProduct,
+	PowerOfPower,
+	NestedProduct,
+	NestedSum,
+	LikeTerms,
+	CommonDenominator,
+	RationalForm,
+	ParallelSum,
+	Count
+};
+
+struct RuleInfo
+{
+	const char* name;
+	bool timed; /* tried and timed as a whole (inclusive of the rules fired within), otherwise just counted */
+	bool sized; /* the sizes of the replaced and replacing subtrees are recorded */
+};
+
+const RuleInfo rule_info[] = {
+	{ "constant folding",     false, false },
+	{ "trivial power",        false, true  },
+	{ "power of product",     true,  true  },
+	{ "power of power",       true,  true  },
+	{ "nested product",       false, false },
+	{ "nested sum",           false, false },
+	{ "like terms",           false, false },
+	{ "common denominator",   true,  true  },
+	{ "rational normal form", true,  true  },
+	{ "parallel sum",         true,  false },
+};
+
+static_assert (sizeof (rule_info) / sizeof (*rule_info) == static_cast<size_t> (Rule::Count), "Rule descriptions do not match the rules");
+
+struct RuleCounters
+{
+	std::atomic<size_t> tried, fired;
+	std::atomic<size_t> nodes_in, nodes_out;
+	std::atomic<long long> time_ns;
+};
+
+RuleCounters rule_counters[static_cast<size_t> (Rule::Count)];
+
+#ifdef ENABLE_STATS
+bool profiling = false;
+#else // ENABLE_STATS
+/* lets the compiler drop the hooks */
+const bool profiling = false;
+#endif // ENABLE_STATS
+
+RuleCounters& counters (Rule rule)
+{
+	return rule_counters[static_cast<size_t> (rule)];
+}
+
+/* counts a rule which is too cheap to be timed */
+void rule_fired (Rule rule)
+{
+	if (profiling) {
+		counters (rule).tried.fetch_add (1, std::memory_order_relaxed);
+		counters (rule).fired.fetch_add (1, std::memory_order_relaxed);
+	}
+}
+
+/* same, recording the sizes of the replaced and replacing subtrees */
+void rule_fired (Rule rule, size_t nodes_in, size_t nodes_out)
+{
+	if (profiling) {
+		rule_fired (rule);
+		counters (rule).nodes_in.fetch_add (nodes_in, std::memory_order_relaxed);
+		counters (rule).nodes_out.fetch_add (nodes_out, std::memory_order_relaxed);
+	}
+}
+
+/* the size of a power with the given (simplified) operands */
+size_t power_nodes (const Node::Base& base, const Node::Base& exponent)
+{
+	return profiling ? 1 + count_nodes (base) + count_nodes (exponent) : 0;
+}
+
+/* times the enclosing scope as an attempt to apply a rule */
+class RuleScope
+{
+	Rule rule_;
+	std::chrono::steady_clock::time_point start_;
+
+public:
+	explicit RuleScope (Rule rule)
+	: rule_ (rule)
+	{
+		if (profiling) {
+			counters (rule_).tried.fetch_add (1, std::memory_order_relaxed);
+			start_ = std::chrono::steady_clock::now();
+		}
+	}
+
+	~RuleScope()
+	{
+		if (profiling) {
+			auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now() - start_);
+			counters (rule_).time_ns.fetch_add (elapsed.count(), std::memory_order_relaxed);
+		}
+	}
+
+	RuleScope (const RuleScope&) = delete;
+	RuleScope& operator= (const RuleScope&) = delete;
+
+	void fired()
+	{
+		if (profiling) {
+			counters (rule_).fired.fetch_add (1, std::memory_order_relaxed);
+		}
+	}
+
+	void fired (size_t nodes_in, const Node::Base& output)
+	{
+		if (profiling) {
+			fired();
+			counters (rule_).nodes_in.fetch_add (nodes_in, std::memory_order_relaxed);
+			counters (rule_).nodes_out.fetch_add (count_nodes (output), std::memory_order_relaxed);
+		}
+	}
+
+	void fired (const Node::Base& input, const Node::Base& output)
+	{
+		if (profiling) {
+			fired (count_nodes (input), output);
+		}
+	}
+};
+
 StrippedNode power_strip_exponent (Node::Base::Ptr&& node, rational_t node_exponent);
 Node::Base::Ptr power_add_exponent (StrippedNode&& node_data);
 
@@ -34,6 +181,17 @@ Node::Base::Ptr addsub_reconstruct (const rational_t& value, DecompositionMap&&
 DecompositionMap addsub_multiply_by_common_denominator (rational_t& constant, DecompositionMap& fractions); // returns the computed common denominator
 Node::Base::Ptr addsub_reconstruct_common_multiplier (rational_t value, DecompositionMap&& terms);
 
+/* maps polynomial variable indices to the (simplified) variable nodes */
+typedef std::vector<Node::Base::Ptr> PolynomialVariables;
+
+bool rational_decompose (Visitor::Simplify& visitor, PolynomialVariables& variables, RationalFunction& result, const Node::Base& node);
+bool rational_decompose_power (Visitor::Simplify& visitor, PolynomialVariables& variables, RationalFunction& result, const Node::Base& node, int exponent);
+Node::Base::Ptr polynomial_reconstruct (const PolynomialVariables& variables, const Polynomial& polynomial);
+Node::Base::Ptr rational_reconstruct (const PolynomialVariables& variables, const RationalFunction& rational);
+Node::Base::Ptr rational_simplify (Visitor::Simplify& visitor, const Node::Base& node);
+
+void addsub_decompose_fold_parallel (const Visitor::Simplify& visitor, rational_t& result_value, DecompositionMap& result, const Node::AdditionSubtraction& node);
+
 StrippedNode power_strip_exponent (Node::Base::Ptr&& node, rational_t node_exponent)
 {
 	StrippedNode result;
@@ -121,6 +279,7 @@ void generic_fold_single (DecompositionMap& result, StrippedNode&& term)
 	auto r = result.emplace (std::move (term.first), term.second);
 	if (!r.second) {
 		/* fold -- sum up exponents/multipliers */
+		rule_fired (Rule::LikeTerms);
 		r.first->second += term.second;
 
 		/* if exponent/multiplier is 0, erase the child */
@@ -132,13 +291,22 @@ void generic_fold_single (DecompositionMap& result, StrippedNode&& term)
 
 void muldiv_decompose_fold_nested_single_simplify (Visitor::Simplify& visitor, rational_t& result_value, DecompositionMap& result, const Node::Base& node, rational_t node_exponent)
 {
+	/* nested products are decomposed without going through accept(), so the stack is looked at here */
+	if (DeepStack::near_limit()) {
+		return DeepStack::call ([&] { muldiv_decompose_fold_nested_single_simplify (visitor, result_value, result, node, node_exponent); });
+	}
+
 	const Node::Value* node_value = dynamic_cast<const Node::Value*> (&node);
 	const Node::MultiplicationDivision* node_muldiv = dynamic_cast<const Node::MultiplicationDivision*> (&node);
 
-	if (node_value && (node_exponent.denominator() == 1)) {
-		result_value *= pow_frac (node_value->value(), node_exponent.numerator());
+	rational_t node_power;
+
+	if (node_value && pow_frac_exact (node_value->value(), node_exponent, node_power)) {
+		rule_fired (Rule::ConstantFolding);
+		result_value *= node_power;
 	} else if (node_muldiv) {
 		/* this is an optimization to go without simplifying while we can go deeper */
+		rule_fired (Rule::NestedProduct);
 		muldiv_decompose_fold_nested_muldiv_simplify (visitor, result_value, result, *node_muldiv, node_exponent);
 	} else {
 		/* here we actually call the simplifier (which duplicates the subtree) and pass control to the non-const version */
@@ -155,16 +323,24 @@ void muldiv_decompose_fold_nested_muldiv_simplify (Visitor::Simplify& visitor, r
 
 void muldiv_decompose_fold_nested_single (rational_t& result_value, DecompositionMap& result, Node::Base::Ptr&& node, rational_t node_exponent)
 {
+	if (DeepStack::near_limit()) {
+		return DeepStack::call ([&] { muldiv_decompose_fold_nested_single (result_value, result, std::move (node), node_exponent); });
+	}
+
 	Node::Value* node_value = dynamic_cast<Node::Value*> (node.get());
 
-	if (node_value && (node_exponent.denominator() == 1)) {
-		result_value *= pow_frac (node_value->value(), node_exponent.numerator());
+	rational_t node_power;
+
+	if (node_value && pow_frac_exact (node_value->value(), node_exponent, node_power)) {
+		rule_fired (Rule::ConstantFolding);
+		result_value *= node_power;
 	} else {
 		/* insert child into the destination map, attempting folding */
 		StrippedNode term = power_strip_exponent (std::move (node), node_exponent);
 		Node::MultiplicationDivision* term_muldiv = dynamic_cast<Node::MultiplicationDivision*> (term.first.node.get());
 
 		if (term_muldiv) {
+			rule_fired (Rule::NestedProduct);
 			muldiv_decompose_fold_nested_muldiv (result_value, result, term_muldiv, term.second);
 		} else {
 			generic_fold_single (result, std::move (term));
@@ -249,9 +425,14 @@ Node::Base::Ptr muldiv_reconstruct (const rational_t& value, DecompositionMap&&
 
 void addsub_decompose_fold_nested_single (rational_t& result_value, DecompositionMap& result, Node::Base::Ptr&& node, rational_t node_multiplier)
 {
+	if (DeepStack::near_limit()) {
+		return DeepStack::call ([&] { addsub_decompose_fold_nested_single (result_value, result, std::move (node), node_multiplier); });
+	}
+
 	Node::Value* node_value = dynamic_cast<Node::Value*> (node.get());
 
 	if (node_value) {
+		rule_fired (Rule::ConstantFolding);
 		result_value += node_value->value() * node_multiplier;
 	} else {
 		/* insert child into the destination map, attempting folding */
@@ -259,6 +440,7 @@ void addsub_decompose_fold_nested_single (rational_t& result_value, Decompositio
 		Node::AdditionSubtraction* term_addsub = dynamic_cast<Node::AdditionSubtraction*> (term.first.node.get());
 
 		if (term_addsub) {
+			rule_fired (Rule::NestedSum);
 			addsub_decompose_fold_nested_addsub (result_value, result, term_addsub, term.second);
 		} else {
 			generic_fold_single (result, std::move (term));
@@ -276,13 +458,19 @@ void addsub_decompose_fold_nested_addsub (rational_t& result_value, Decompositio
 
 void addsub_decompose_fold_nested_single_simplify (Visitor::Simplify& visitor, rational_t& result_value, DecompositionMap& result, const Node::Base& node, rational_t node_multiplier)
 {
+	if (DeepStack::near_limit()) {
+		return DeepStack::call ([&] { addsub_decompose_fold_nested_single_simplify (visitor, result_value, result, node, node_multiplier); });
+	}
+
 	const Node::Value* node_value = dynamic_cast<const Node::Value*> (&node);
 	const Node::AdditionSubtraction* node_addsub = dynamic_cast<const Node::AdditionSubtraction*> (&node);
 
 	if (node_value) {
+		rule_fired (Rule::ConstantFolding);
 		result_value += node_value->value() * node_multiplier;
 	} else if (node_addsub) {
 		/* this is an optimization to go without simplifying while we can go deeper */
+		rule_fired (Rule::NestedSum);
 		addsub_decompose_fold_nested_addsub_simplify (visitor, result_value, result, *node_addsub, node_multiplier);
 	} else {
 		/* here we actually call the simplifier (which duplicates the subtree) and pass control to the non-const version */
@@ -439,6 +627,15 @@ DecompositionMap addsub_multiply_by_common_denominator (rational_t& constant, De
 Node::Base::Ptr addsub_reconstruct_common_multiplier (rational_t value, DecompositionMap&& terms)
 {
 	if (Visitor::Simplify::options.sum_fractions) {
+		RuleScope rule (Rule::CommonDenominator);
+		size_t nodes_in = 0;
+
+		if (profiling) {
+			for (const auto& term: terms) {
+				nodes_in += count_nodes (*term.first.node);
+			}
+		}
+
 		rational_t denominator_multiplier (1);
 		DecompositionMap denominator = addsub_multiply_by_common_denominator (value, terms);
 
@@ -464,13 +661,453 @@ Node::Base::Ptr addsub_reconstruct_common_multiplier (rational_t value, Decompos
 			/* numerator can be a constant or a muldiv, so fold it properly */
 			muldiv_decompose_fold_nested_single (denominator_multiplier, denominator, std::move (numerator), rational_t (1));
 
-			return muldiv_reconstruct (denominator_multiplier, std::move (denominator));
+			Node::Base::Ptr result = muldiv_reconstruct (denominator_multiplier, std::move (denominator));
+			rule.fired (nodes_in, *result);
+			return result;
 		}
 	} else {
 		return addsub_reconstruct (value, std::move (terms));
 	}
 }
 
+/* whether a power with this exponent may be converted to the rational form */
+bool rational_exponent (const Node::Base& exponent)
+{
+	/* without summing fractions, only polynomials are handled */
+	bool allow_fractions = Visitor::Simplify::options.sum_fractions;
+	const Node::Value* exponent_value = dynamic_cast<const Node::Value*> (&exponent);
+
+	return exponent_value &&
+	       (exponent_value->value().denominator() == 1) &&
+	       (exponent_value->value() >= (allow_fractions ? -rational_t (Polynomial::max_exponent) : rational_t (0))) &&
+	       (exponent_value->value() <= Polynomial::max_exponent);
+}
+
+/*
+ * Whether the subtrees may be converted to the rational form, judging by their structure alone (the conversion
+ * may still exceed the limits). This is found in a single pass over the subtree of the outermost node being
+ * simplified, and kept (per thread) until that node is done, so that the visits of its descendants look themselves
+ * up rather than walk their subtrees again. The nodes stay alive meanwhile, so their addresses are not reused.
+ * The subtrees built while simplifying are not found, and get memos of their own.
+ */
+
+class RationalMemo
+{
+	static thread_local RationalMemo* innermost_;
+
+	RationalMemo* outer_;
+	std::unordered_map<const Node::Base*, bool> eligible_;
+	bool active_;
+
+	static const bool* find (const Node::Base& node);
+	bool mark (const Node::Base& node);
+
+public:
+	explicit RationalMemo (const Node::Base& root);
+	~RationalMemo();
+
+	RationalMemo (const RationalMemo&) = delete;
+	RationalMemo& operator= (const RationalMemo&) = delete;
+
+	/* returns whether the node may be converted (true if it is not in any memo) */
+	static bool eligible (const Node::Base& node)
+	{
+		const bool* result = find (node);
+		return !result || *result;
+	}
+};
+
+thread_local RationalMemo* RationalMemo::innermost_ = nullptr;
+
+RationalMemo::RationalMemo (const Node::Base& root)
+: outer_ (innermost_)
+, active_ (Visitor::Simplify::options.polynomial_term_limit && !find (root))
+{
+	if (active_) {
+		mark (root);
+		innermost_ = this;
+	}
+}
+
+RationalMemo::~RationalMemo()
+{
+	if (active_) {
+		innermost_ = outer_;
+	}
+}
+
+const bool* RationalMemo::find (const Node::Base& node)
+{
+	for (const RationalMemo* memo = innermost_; memo; memo = memo->outer_) {
+		auto it = memo->eligible_.find (&node);
+		if (it != memo->eligible_.end()) {
+			return &it->second;
+		}
+	}
+
+	return nullptr;
+}
+
+/* mirrors rational_decompose(), but goes through all children, so that every node of the subtree is marked */
+bool RationalMemo::mark (const Node::Base& node)
+{
+	if (DeepStack::near_limit()) {
+		return DeepStack::call ([&] { return mark (node); });
+	}
+
+	bool result = true;
+
+	if (const Node::Function* node_function = dynamic_cast<const Node::Function*> (&node)) {
+		for (const auto& child: node_function->children()) {
+			mark (*child.node);
+		}
+		result = false;
+	} else if (const Node::Power* node_power = dynamic_cast<const Node::Power*> (&node)) {
+		result = mark (*node_power->get_base());
+		mark (*node_power->get_exponent());
+		result = result && rational_exponent (*node_power->get_exponent());
+	} else if (const Node::AdditionSubtraction* node_addsub = dynamic_cast<const Node::AdditionSubtraction*> (&node)) {
+		for (const auto& child: node_addsub->children()) {
+			result = mark (*child.node) && result;
+		}
+	} else if (const Node::MultiplicationDivision* node_muldiv = dynamic_cast<const Node::MultiplicationDivision*> (&node)) {
+		for (const auto& child: node_muldiv->children()) {
+			result = mark (*child.node) && result;
+
+			/* division by a constant is handled without fractions */
+			if (child.tag.reciprocated && !Visitor::Simplify::options.sum_fractions && !dynamic_cast<const Node::Value*> (child.node.get())) {
+				result = false;
+			}
+		}
+	}
+
+	eligible_.emplace (&node, result);
+	return result;
+}
+
+bool rational_decompose (Visitor::Simplify& visitor, PolynomialVariables& variables, RationalFunction& result, const Node::Base& node)
+{
+	if (DeepStack::near_limit()) {
+		return DeepStack::call ([&] { return rational_decompose (visitor, variables, result, node); });
+	}
+
+	size_t term_limit = Visitor::Simplify::options.polynomial_term_limit;
+
+	/* without summing fractions, only polynomials are handled */
+	bool allow_fractions = Visitor::Simplify::options.sum_fractions;
+
+	if (const Node::Value* node_value = dynamic_cast<const Node::Value*> (&node)) {
+		result = RationalFunction (Polynomial (node_value->value()));
+		return true;
+	}
+
+	if (dynamic_cast<const Node::Variable*> (&node)) {
+		/* the variable may be substituted */
+		Node::Base::Ptr variable = node.accept_ptr (visitor);
+
+		if (const Node::Value* variable_value = dynamic_cast<const Node::Value*> (variable.get())) {
+			result = RationalFunction (Polynomial (variable_value->value()));
+			return true;
+		}
+
+		auto it = std::find_if (variables.begin(), variables.end(), [&variable] (const Node::Base::Ptr& known) { return known->compare (*variable); });
+		if (it == variables.end()) {
+			if (variables.size() == Polynomial::max_variables) {
+				return false;
+			}
+			it = variables.insert (it, std::move (variable));
+		}
+
+		result = RationalFunction (Polynomial::variable (it - variables.begin()));
+		return true;
+	}
+
+	if (const Node::AdditionSubtraction* node_addsub = dynamic_cast<const Node::AdditionSubtraction*> (&node)) {
+		result = RationalFunction();
+
+		for (const auto& child: node_addsub->children()) {
+			RationalFunction child_rational;
+			if (!rational_decompose (visitor, variables, child_rational, *child.node) ||
+			    !result.add (child_rational, rational_t (child.tag.negated ? -1 : 1), term_limit)) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	if (const Node::MultiplicationDivision* node_muldiv = dynamic_cast<const Node::MultiplicationDivision*> (&node)) {
+		result = RationalFunction (Polynomial (rational_t (1)));
+
+		for (const auto& child: node_muldiv->children()) {
+			if (child.tag.reciprocated) {
+				/* division by a constant is handled without fractions */
+				if (const Node::Value* child_value = dynamic_cast<const Node::Value*> (child.node.get())) {
+					if (child_value->value() == 0) {
+						return false;
+					}
+
+					result.scale (1 / child_value->value());
+					continue;
+				}
+
+				if (!allow_fractions) {
+					return false;
+				}
+			}
+
+			RationalFunction child_rational;
+			if (!rational_decompose_power (visitor, variables, child_rational, *child.node, child.tag.reciprocated ? -1 : 1) ||
+			    !result.multiply (child_rational, term_limit)) {
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	if (const Node::Power* node_power = dynamic_cast<const Node::Power*> (&node)) {
+		if (!rational_exponent (*node_power->get_exponent())) {
+			return false;
+		}
+
+		const Node::Value* exponent_value = static_cast<const Node::Value*> (node_power->get_exponent().get());
+		return rational_decompose_power (visitor, variables, result, *node_power->get_base(), static_cast<int> (exponent_value->value().numerator()));
+	}
+
+	return false;
+}
+
+/*
+ * Decomposes node^exponent.
+ * Powers and products are inverted factor by factor before raising, so that the denominator stays factored
+ * (inverting an expanded polynomial yields a single factor).
+ */
+
+bool rational_decompose_power (Visitor::Simplify& visitor, PolynomialVariables& variables, RationalFunction& result, const Node::Base& node, int exponent)
+{
+	size_t term_limit = Visitor::Simplify::options.polynomial_term_limit;
+
+	if (exponent < 0) {
+		if (const Node::Power* node_power = dynamic_cast<const Node::Power*> (&node)) {
+			const Node::Value* exponent_value = dynamic_cast<const Node::Value*> (node_power->get_exponent().get());
+			if (exponent_value &&
+			    (exponent_value->value().denominator() == 1) &&
+			    (boost::multiprecision::abs (exponent_value->value().numerator() * exponent) <= Polynomial::max_exponent)) {
+				return rational_decompose_power (visitor, variables, result, *node_power->get_base(), static_cast<int> (exponent_value->value().numerator()) * exponent);
+			}
+		}
+
+		if (const Node::MultiplicationDivision* node_muldiv = dynamic_cast<const Node::MultiplicationDivision*> (&node)) {
+			result = RationalFunction (Polynomial (rational_t (1)));
+
+			for (const auto& child: node_muldiv->children()) {
+				RationalFunction child_rational;
+				if (!rational_decompose_power (visitor, variables, child_rational, *child.node, child.tag.reciprocated ? -exponent : exponent) ||
+				    !result.multiply (child_rational, term_limit)) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+	}
+
+	return rational_decompose (visitor, variables, result, node) &&
+	       ((exponent >= 0) || result.invert (term_limit)) &&
+	       result.raise (std::abs (exponent), term_limit);
+}
+
+Node::Base::Ptr polynomial_reconstruct (const PolynomialVariables& variables, const Polynomial& polynomial)
+{
+	rational_t value (0);
+
+	/* sum: term -> multiplier */
+	DecompositionMap terms;
+
+	for (const auto& term: polynomial.terms()) {
+		/* product: variable -> exponent */
+		DecompositionMap monomial;
+
+		for (unsigned i = 0; i < variables.size(); ++i) {
+			if (unsigned exponent = Polynomial::exponent (term.first, i)) {
+				monomial.emplace (variables[i]->clone(), rational_t (exponent));
+			}
+		}
+
+		if (monomial.empty()) {
+			value += term.second;
+		} else {
+			generic_fold_single (terms, StrippedNode (muldiv_reconstruct (rational_t (1), std::move (monomial)), term.second));
+		}
+	}
+
+	return addsub_reconstruct (value, std::move (terms));
+}
+
+Node::Base::Ptr rational_reconstruct (const PolynomialVariables& variables, const RationalFunction& rational)
+{
+	Node::Base::Ptr numerator = polynomial_reconstruct (variables, rational.numerator());
+
+	if (rational.denominator().empty()) {
+		return numerator;
+	}
+
+	rational_t value (1);
+
+	/* product: factor -> exponent */
+	DecompositionMap terms;
+
+	for (const auto& factor: rational.denominator()) {
+		generic_fold_single (terms, StrippedNode (polynomial_reconstruct (variables, factor.first), -rational_t (factor.second)));
+	}
+
+	/* numerator can be a constant or a muldiv, so fold it properly */
+	muldiv_decompose_fold_nested_single (value, terms, std::move (numerator), rational_t (1));
+
+	return muldiv_reconstruct (value, std::move (terms));
+}
+
+/*
+ * Simplifies a subtree which is a rational function (built of constants, variables, sums, products,
+ * quotients and integer powers) by converting it to the sparse form, where the arithmetic, expansion
+ * and collection of terms are cheap, and common factors of the numerator and the denominator are cancelled.
+ * Returns nullptr if the subtree is not a rational function or exceeds the limits.
+ */
+
+Node::Base::Ptr rational_simplify (Visitor::Simplify& visitor, const Node::Base& node)
+{
+	if (!Visitor::Simplify::options.polynomial_term_limit || !RationalMemo::eligible (node)) {
+		return nullptr;
+	}
+
+	RuleScope rule (Rule::RationalForm);
+	PolynomialVariables variables;
+	RationalFunction rational;
+
+	if (!rational_decompose (visitor, variables, rational, node)) {
+		return nullptr;
+	}
+
+	Node::Base::Ptr result = rational_reconstruct (variables, rational);
+	rule.fired (node, *result);
+	return result;
+}
+
+/*
+ * Parallel simplification of large sums
+ */
+
+ThreadPool& simplify_pool()
+{
+	static ThreadPool pool (Visitor::Simplify::options.jobs);
+	return pool;
+}
+
+struct PartialSum
+{
+	rational_t value;
+	DecompositionMap terms;
+};
+
+void addsub_merge (PartialSum& target, PartialSum&& source)
+{
+	/* fold the smaller map into the larger one */
+	if (target.terms.size() < source.terms.size()) {
+		std::swap (target.terms, source.terms);
+	}
+
+	target.value += source.value;
+
+	for (auto it = source.terms.begin(); it != source.terms.end(); ) {
+		generic_fold_single (target.terms, take_map (source.terms, it++));
+	}
+}
+
+/*
+ * The terms are split into contiguous groups which are simplified and folded concurrently (each by a copy
+ * of the visitor, so that large terms may be split further), and then the partial sums are merged pairwise,
+ * also concurrently. Rational arithmetic is exact, so the result does not depend on the grouping.
+ */
+
+void addsub_decompose_fold_parallel (const Visitor::Simplify& visitor, rational_t& result_value, DecompositionMap& result, const Node::AdditionSubtraction& node)
+{
+	typedef std::shared_ptr<PartialSum> PartialSumPtr;
+
+	ThreadPool& pool = simplify_pool();
+	std::vector<const Node::TaggedChild<Node::AdditionSubtractionTag>*> children;
+
+	for (const auto& child: node.children()) {
+		children.push_back (&child);
+	}
+
+	size_t groups_count = std::min (children.size(), 4 * pool.size());
+	std::vector<std::future<PartialSumPtr>> pending;
+
+	/* the pool is shared, and a waiting thread runs tasks of other operations: each task joins its own */
+	Budget::Handle operation = Budget::current();
+
+	for (size_t i = 0; i < groups_count; ++i) {
+		size_t begin = children.size() * i / groups_count,
+		       end = children.size() * (i + 1) / groups_count;
+
+		pending.push_back (pool.submit ([&visitor, &children, begin, end, operation] {
+			Budget::Scope budget (operation);
+			std::unique_ptr<Visitor::Simplify> group_visitor = visitor.fork();
+			PartialSumPtr partial (new PartialSum);
+
+			for (size_t j = begin; j < end; ++j) {
+				addsub_decompose_fold_nested_single_simplify (*group_visitor, partial->value, partial->terms, *children[j]->node,
+				                                              children[j]->tag.negated ? rational_t (-1) : rational_t (1));
+			}
+
+			return partial;
+		}));
+	}
+
+	for (;;) {
+		/* every task has to finish before an exception is rethrown, since they refer to the tree and to the visitor */
+		std::vector<PartialSumPtr> partials;
+		std::exception_ptr error;
+
+		for (auto& future: pending) {
+			try {
+				partials.push_back (pool.wait (future));
+			} catch (...) {
+				error = std::current_exception();
+			}
+		}
+
+		if (error) {
+			std::rethrow_exception (error);
+		}
+
+		if (partials.size() == 1) {
+			result_value = std::move (partials.front()->value);
+			result = std::move (partials.front()->terms);
+			return;
+		}
+
+		pending.clear();
+
+		for (size_t i = 0; i + 1 < partials.size(); i += 2) {
+			PartialSumPtr target = partials[i], source = partials[i + 1];
+
+			pending.push_back (pool.submit ([target, source, operation] {
+				Budget::Scope budget (operation);
+				addsub_merge (*target, std::move (*source));
+				return target;
+			}));
+		}
+
+		if (partials.size() % 2) {
+			std::promise<PartialSumPtr> odd;
+			odd.set_value (partials.back());
+			pending.push_back (odd.get_future());
+		}
+	}
+}
+
 } // anonymous namespace
 
 namespace Visitor {
@@ -488,11 +1125,15 @@ Simplify::Simplify()
 
 boost::any Simplify::visit (const Node::Value& node)
 {
+	Budget::check ("Simplify");
+
 	return static_cast<Node::Base*> (node.clone().release());
 }
 
 boost::any Simplify::visit (const Node::Variable& node)
 {
+	Budget::check ("Simplify");
+
 	// we substitute if both 1) variable is eligible for substitution and 2) it holds a rational value
 	if (!simplification_variable_.empty() && !node.is_target_variable (simplification_variable_)) {
 		boost::any value = node.value();
@@ -506,7 +1147,10 @@ boost::any Simplify::visit (const Node::Variable& node)
 
 boost::any Simplify::visit (const Node::Function& node)
 {
-	std::cerr << "Simplify warning: unknown function: '" << node.name() << "'" << std::endl;
+	Budget::check ("Simplify");
+
+	/* written in one piece: partial derivatives may be simplified concurrently */
+	std::cerr << BUILD_STRING ("Simplify warning: unknown function: '" << node.name() << "'" << std::endl) << std::flush;
 
 	Node::Function::Ptr result (new Node::Function (node.name()));
 
@@ -519,6 +1163,13 @@ boost::any Simplify::visit (const Node::Function& node)
 
 boost::any Simplify::visit (const Node::Power& node)
 {
+	Budget::check ("Simplify");
+
+	RationalMemo memo (node);
+	if (Node::Base::Ptr rational = rational_simplify (*this, node)) {
+		return rational.release();
+	}
+
 	Node::Base::Ptr base (node.get_base()->accept_ptr (*this)),
 	                exponent (node.get_exponent()->accept_ptr (*this));
 
@@ -527,17 +1178,26 @@ boost::any Simplify::visit (const Node::Power& node)
 	Node::MultiplicationDivision* base_muldiv = dynamic_cast<Node::MultiplicationDivision*> (base.get());
 	Node::Power* base_power = dynamic_cast<Node::Power*> (base.get());
 
-	if (base_value && exponent_value && (exponent_value->value().denominator() == 1)) {
-		return static_cast<Node::Base*> (new Node::Value (pow_frac (base_value->value(), exponent_value->value().numerator())));
-	} else if (base_value && (base_value->value() == 0)) {
+	rational_t power;
+
+	if (base_value && exponent_value && pow_frac_exact (base_value->value(), exponent_value->value(), power)) {
+		rule_fired (Rule::ConstantFolding);
+		return static_cast<Node::Base*> (new Node::Value (power));
+	} else if (base_value && (base_value->value() == 0) && exponent_value && (exponent_value->value() > 0)) {
+		rule_fired (Rule::TrivialPower, power_nodes (*base, *exponent), 1);
 		return static_cast<Node::Base*> (new Node::Value (0));
 	} else if (base_value && (base_value->value() == 1)) {
+		rule_fired (Rule::TrivialPower, power_nodes (*base, *exponent), 1);
 		return static_cast<Node::Base*> (new Node::Value (1));
 	} else if (exponent_value && (exponent_value->value() == 0)) {
+		rule_fired (Rule::TrivialPower, power_nodes (*base, *exponent), 1);
 		return static_cast<Node::Base*> (new Node::Value (1));
 	} else if (exponent_value && (exponent_value->value() == 1)) {
+		rule_fired (Rule::TrivialPower, power_nodes (*base, *exponent), profiling ? count_nodes (*base) : 0);
 		return static_cast<Node::Base*> (base.release());
 	} else if (base_muldiv) {
+		RuleScope rule (Rule::PowerOfProduct);
+		size_t nodes_in = power_nodes (*base, *exponent);
 		Node::MultiplicationDivision::Ptr result (new Node::MultiplicationDivision);
 
 		for (auto it = base_muldiv->children().begin(); it != base_muldiv->children().end(); ) {
@@ -549,8 +1209,12 @@ boost::any Simplify::visit (const Node::Power& node)
 			result->add_child (std::move (base_term_pwr), base_term.tag.reciprocated);
 		}
 
-		return result->accept_ptr (*this).release();
+		Node::Base::Ptr simplified = result->accept_ptr (*this);
+		rule.fired (nodes_in, *simplified);
+		return simplified.release();
 	} else if (base_power) {
+		RuleScope rule (Rule::PowerOfPower);
+		size_t nodes_in = power_nodes (*base, *exponent);
 		Node::Base::Ptr base_base (std::move (base_power->get_base())),
 		                base_exponent (std::move (base_power->get_exponent()));
 
@@ -561,7 +1225,10 @@ boost::any Simplify::visit (const Node::Power& node)
 		Node::Power::Ptr result (new Node::Power);
 		result->set_base (std::move (base_base));
 		result->set_exponent (std::move (result_exponent));
-		return result->accept_ptr (*this).release();
+
+		Node::Base::Ptr simplified = result->accept_ptr (*this);
+		rule.fired (nodes_in, *simplified);
+		return simplified.release();
 	} else {
 		Node::Power::Ptr result (new Node::Power);
 		result->set_base (std::move (base));
@@ -572,6 +1239,13 @@ boost::any Simplify::visit (const Node::Power& node)
 
 boost::any Simplify::visit (const Node::MultiplicationDivision& node)
 {
+	Budget::check ("Simplify");
+
+	RationalMemo memo (node);
+	if (Node::Base::Ptr rational = rational_simplify (*this, node)) {
+		return rational.release();
+	}
+
 	rational_t result_value (1);
 
 	/* product: term -> exponent */
@@ -584,14 +1258,109 @@ boost::any Simplify::visit (const Node::MultiplicationDivision& node)
 
 boost::any Simplify::visit (const Node::AdditionSubtraction& node)
 {
+	Budget::check ("Simplify");
+
+	RationalMemo memo (node);
+	if (Node::Base::Ptr rational = rational_simplify (*this, node)) {
+		return rational.release();
+	}
+
 	rational_t result_value (0);
 
 	/* sum: term -> multiplier */
 	DecompositionMap node_terms;
 
-	addsub_decompose_fold_nested_addsub_simplify (*this, result_value, node_terms, node, rational_t (1));
+	if ((options.jobs <= 1) || sequential_) {
+		addsub_decompose_fold_nested_addsub_simplify (*this, result_value, node_terms, node, rational_t (1));
+	} else if (count_nodes (node, options.parallel_threshold) >= options.parallel_threshold) {
+		RuleScope rule (Rule::ParallelSum);
+		addsub_decompose_fold_parallel (*this, result_value, node_terms, node);
+		rule.fired();
+	} else {
+		/* all sums below are even smaller, so they need not be counted */
+		std::unique_ptr<Simplify> sequential = fork();
+		sequential->sequential_ = true;
+
+		addsub_decompose_fold_nested_addsub_simplify (*sequential, result_value, node_terms, node, rational_t (1));
+	}
 
 	return addsub_reconstruct_common_multiplier (result_value, std::move (node_terms)).release();
 }
 
+void Simplify::enable_profile()
+{
+#ifdef ENABLE_STATS
+	profiling = true;
+#else // ENABLE_STATS
+	ERROR (std::runtime_error, "Simplifier profile is not available: the program has been built without ENABLE_STATS");
+#endif // ENABLE_STATS
+}
+
+bool Simplify::profile_enabled()
+{
+	return profiling;
+}
+
+void Simplify::write_profile_text (std::ostream& out)
+{
+	out << "Simplifier rules:" << std::endl
+	    << std::left << std::setw (22) << "rule" << std::right
+	    << std::setw (11) << "tried" << std::setw (11) << "fired" << std::setw (11) << "time ms"
+	    << std::setw (13) << "nodes in" << std::setw (13) << "nodes out" << std::setw (9) << "growth" << std::endl;
+
+	for (size_t i = 0; i < static_cast<size_t> (Rule::Count); ++i) {
+		const RuleInfo& info = rule_info[i];
+		const RuleCounters& c = rule_counters[i];
+
+		out << std::left << std::setw (22) << info.name << std::right
+		    << std::setw (11) << c.tried.load() << std::setw (11) << c.fired.load()
+		    << std::fixed << std::setprecision (2);
+
+		if (info.timed) {
+			out << std::setw (11) << c.time_ns.load() / 1e6;
+		} else {
+			out << std::setw (11) << "-";
+		}
+
+		if (info.sized) {
+			out << std::setw (13) << c.nodes_in.load() << std::setw (13) << c.nodes_out.load();
+			if (c.nodes_in.load()) {
+				out << std::setw (9) << double (c.nodes_out.load()) / c.nodes_in.load();
+			} else {
+				out << std::setw (9) << "-";
+			}
+		} else {
+			out << std::setw (13) << "-" << std::setw (13) << "-" << std::setw (9) << "-";
+		}
+
+		out << std::endl;
+	}
+
+	out.unsetf (std::ios::floatfield);
+	out << "(the times of the rules include those of the rules fired within)" << std::endl
+	    << std::endl;
+}
+
+void Simplify::write_profile_json (std::ostream& out)
+{
+	out << "[";
+
+	for (size_t i = 0; i < static_cast<size_t> (Rule::Count); ++i) {
+		const RuleInfo& info = rule_info[i];
+		const RuleCounters& c = rule_counters[i];
+
+		out << (i ? "," : "") << std::endl
+		    << "  { \"rule\": \"" << info.name << "\", \"tried\": " << c.tried.load() << ", \"fired\": " << c.fired.load();
+		if (info.timed) {
+			out << ", \"time_ms\": " << c.time_ns.load() / 1e6;
+		}
+		if (info.sized) {
+			out << ", \"nodes_in\": " << c.nodes_in.load() << ", \"nodes_out\": " << c.nodes_out.load();
+		}
+		out << " }";
+	}
+
+	out << std::endl << "]" << std::endl;
+}
+
 } // namespace Visitor
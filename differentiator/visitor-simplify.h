@@ -8,10 +8,17 @@ class Simplify : public Base
 {
 	std::string simplification_variable_;
 
+	/* set below a sum which has been found too small to be simplified in parallel */
+	bool sequential_ = false;
+
 public:
 
 	Simplify (const std::string& variable);
 	Simplify();
+	virtual ~Simplify() = default;
+
+	/* returns a copy of the visitor for a concurrent task (subclasses keeping state must share it safely) */
+	virtual std::unique_ptr<Simplify> fork() const { return std::unique_ptr<Simplify> (new Simplify (*this)); }
 
 	virtual boost::any visit (const Node::Value& node);
 	virtual boost::any visit (const Node::Variable& node);
@@ -23,9 +30,28 @@ public:
 	struct Options
 	{
 		bool sum_fractions = true;
+
+		/* polynomial subtrees with at most this many terms are expanded and collected in the sparse form (0 disables) */
+		size_t polynomial_term_limit = 64;
+
+		/* sums of at least parallel_threshold nodes have their terms simplified concurrently by this many threads
+		 * (the thread pool is created on first use) */
+		unsigned jobs = 1;
+		size_t parallel_threshold = 4096;
 	};
 
 	static Options options;
+
+	/*
+	 * Profile of the rewrite rules: how many times each has been tried and fired, the time spent in it
+	 * and the sizes of the subtrees it has replaced. Shared by all simplifiers and collected only
+	 * after enable_profile() in builds with ENABLE_STATS (otherwise the hooks compile to nothing).
+	 */
+	static void enable_profile();
+	static bool profile_enabled();
+
+	static void write_profile_text (std::ostream& out);
+	static void write_profile_json (std::ostream& out);
 };
 
 } // namespace Visitor
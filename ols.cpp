@@ -1,4 +1,5 @@
 #include <util/util.h>
+#include <util/text-reader.h>
 #include <cstring>
 
 #include <getopt.h>
@@ -53,7 +54,8 @@ int main (int argc, char** argv)
 		} output;
 
 		struct {
-			std::ifstream x_file, y_file;
+			const char* x_file;
+			const char* y_file;
 		} input;
 
 		Mode mode = Mode::Unknown;
@@ -85,11 +87,11 @@ int main (int argc, char** argv)
 			break;
 
 		case ARG_FILE_X:
-			open (parameters.input.x_file, optarg);
+			parameters.input.x_file = optarg;
 			break;
 
 		case ARG_FILE_Y:
-			open (parameters.input.y_file, optarg);
+			parameters.input.y_file = optarg;
 			break;
 
 		default:
@@ -111,6 +113,11 @@ int main (int argc, char** argv)
 		usage (argv[0]);
 	}
 
+	if (!parameters.input.x_file || !parameters.input.y_file) {
+		std::cerr << "Both data files ('-x' and '-y') are expected." << std::endl;
+		usage (argv[0]);
+	}
+
 	auto x_data = read_into_vector<double> (parameters.input.x_file),
 	     y_data = read_into_vector<double> (parameters.input.y_file);
 
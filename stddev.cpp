@@ -1,4 +1,8 @@
 #include <util/util.h>
+#include <util/statistics.h>
+#include <util/mapped-file.h>
+#include <util/text-reader.h>
+#include <util/thread-pool.h>
 
 #include <getopt.h>
 
@@ -8,7 +12,13 @@ enum {
 	ARG_TERSE_OUTPUT            = 'q',
 	ARG_ADDITIONAL_ERROR        = 'E',
 	ARG_INPUT_HAS_ERRORS        = 'e',
+	ARG_INPUT_FILE              = 'i',
+	ARG_STREAM                  = 's',
+	ARG_JOBS                    = 'j',
+	ARG_PERCENTILES             = 'p',
 	ARG_MACHINE_OUTPUT_VAR_NAME = 0x100,
+	ARG_QUANTILES,
+	ARG_SIGMAS,
 };
 
 namespace {
@@ -20,22 +30,382 @@ const option option_array[] = {
 	{ "name-machine",  required_argument, nullptr, ARG_MACHINE_OUTPUT_VAR_NAME },
 	{ "input-errors",  no_argument,       nullptr, ARG_INPUT_HAS_ERRORS },
 	{ "error",         required_argument, nullptr, ARG_ADDITIONAL_ERROR },
+	{ "input",         required_argument, nullptr, ARG_INPUT_FILE },
+	{ "stream",        no_argument,       nullptr, ARG_STREAM },
+	{ "jobs",          required_argument, nullptr, ARG_JOBS },
+	{ "quantiles",     no_argument,       nullptr, ARG_QUANTILES },
+	{ "percentiles",   required_argument, nullptr, ARG_PERCENTILES },
+	{ "sigmas",        required_argument, nullptr, ARG_SIGMAS },
 	{ }
 };
 
 void usage (const char* name) {
 	std::cerr << "Usage: " << name << " [-m|--machine] [-q|--terse]" << std::endl
 	          << "       [-n|--name NAME] [--name-machine NAME]" << std::endl
-	          << "       [-e|--input-errors] [-E|--error SYSTEMATIC-ERROR]" << std::endl;
+	          << "       [-e|--input-errors] [-E|--error SYSTEMATIC-ERROR]" << std::endl
+	          << "       [-i|--input FILE] [-s|--stream] [-j|--jobs JOBS]" << std::endl
+	          << "       [--quantiles] [-p|--percentiles P1,P2,...] [--sigmas S1,S2,...]" << std::endl;
 	exit (EXIT_FAILURE);
 }
 
-const size_t MAX_SIGMA = 2;
+/* the size of the pieces the input is parsed in (in parallel), which does not depend on the count of threads */
+const size_t CHUNK_SIZE = 8 << 20;
+
+/* the ratio of the standard deviation to the median absolute deviation of a normal distribution */
+const data_t MAD_TO_SIGMA = 1.482602218505602L;
+
+/*
+ * The range analysis (counts of the values within the sigma bands around the average) needs the average and
+ * the standard deviation first. A mapped file is read again to do it, while a stream is read once,
+ * keeping the values (or a histogram of them, for approximate counts).
+ *
+ * The quantiles (the median, the median absolute deviation from it and the percentiles asked for) are selected
+ * from the values kept in memory, or estimated from a sketch in bounded memory.
+ */
+
+enum class RangeAnalysis
+{
+	None,
+	SecondPass,
+	KeepValues,
+	Histogram
+};
+
+enum class QuantileAnalysis
+{
+	None,
+	Exact,
+	Sketch
+};
+
+struct Analysis
+{
+	std::vector<data_t> sigmas;
+	std::vector<data_t> percentiles;
+	RangeAnalysis ranges;
+	QuantileAnalysis quantiles;
+
+	bool keep_values() const { return (ranges == RangeAnalysis::KeepValues) || (quantiles == QuantileAnalysis::Exact); }
+};
+
+/*
+ * What is reported of a dataset: its moments, the counts of the measurements within the sigma bands
+ * and the quantiles (if these are asked for).
+ */
+
+struct Summary
+{
+	Moments moments;
+
+	std::vector<data_t> in_range;
+	bool ranges_exact;
+
+	data_t median, mad;
+	std::vector<data_t> percentiles;
+	size_t sketch_size;
+};
+
+/* parses a comma-separated list of numbers */
+std::vector<data_t> parse_list (const char* text, const char* what)
+{
+	std::vector<data_t> result;
+	std::istringstream ss (text);
+	std::string item;
+
+	while (std::getline (ss, item, ',')) {
+		std::istringstream item_ss (item);
+		data_t value;
+		item_ss >> value;
+
+		if (!consumed_entirely (item_ss)) {
+			ERROR (std::runtime_error, "Could not parse the " << what << ": '" << text << "'");
+		}
+
+		result.push_back (value);
+	}
+
+	return result;
+}
+
+/* counts a value into the sigma bands around an average */
+void count_in_ranges (data_t value, data_t average, data_t stddev, const std::vector<data_t>& sigmas, size_t* counts)
+{
+	data_t deviation = fabsl (value - average);
+	for (size_t i = 0; i < sigmas.size(); ++i) {
+		counts[i] += (deviation <= stddev * sigmas[i]);
+	}
+}
+
+/* what is accumulated of a dataset while reading (a chunk of) it; accumulators of consecutive chunks are merged in order */
+struct Accumulator
+{
+	Summary summary;
+	std::vector<data_t> values;
+	Histogram histogram;
+	QuantileSketch sketch;
+
+	void add (data_t value, const Analysis& analysis)
+	{
+		summary.moments.add (value);
+
+		if (analysis.keep_values()) {
+			values.push_back (value);
+		}
+
+		if (analysis.ranges == RangeAnalysis::Histogram) {
+			histogram.add (value);
+		}
+
+		if (analysis.quantiles == QuantileAnalysis::Sketch) {
+			sketch.add (value);
+		}
+	}
+
+	void merge (Accumulator& other)
+	{
+		summary.moments.merge (other.summary.moments);
+		values.insert (values.end(), other.values.begin(), other.values.end());
+		histogram.merge (other.histogram);
+		sketch.merge (other.sketch);
+	}
+
+	/* completes the range analysis and the quantiles from the values, the histogram or the sketch kept */
+	void finish (const Analysis& analysis)
+	{
+		data_t average = summary.moments.average(), stddev = summary.moments.stddev();
+
+		switch (analysis.ranges) {
+		case RangeAnalysis::KeepValues: {
+			std::vector<size_t> counts (analysis.sigmas.size(), 0);
+			for (data_t value: values) {
+				count_in_ranges (value, average, stddev, analysis.sigmas, counts.data());
+			}
+
+			summary.in_range.assign (counts.begin(), counts.end());
+			summary.ranges_exact = true;
+			break;
+		}
+
+		case RangeAnalysis::Histogram:
+			for (data_t sigma: analysis.sigmas) {
+				summary.in_range.push_back (histogram.count_within (average - stddev * sigma, average + stddev * sigma));
+			}
+
+			summary.ranges_exact = histogram.exact();
+			break;
+
+		default:
+			break;
+		}
+
+		std::vector<data_t> probabilities (1, 0.5);
+		for (data_t percentile: analysis.percentiles) {
+			probabilities.push_back (percentile / 100);
+		}
+
+		switch (analysis.quantiles) {
+		case QuantileAnalysis::Exact: {
+			std::vector<data_t> quantiles = select_quantiles (values, probabilities);
+			summary.median = quantiles.front();
+			summary.percentiles.assign (quantiles.begin() + 1, quantiles.end());
+
+			/* the values are not needed any more: make them the deviations from the median */
+			for (data_t& value: values) {
+				value = fabsl (value - summary.median);
+			}
+
+			summary.mad = select_quantiles (values, { 0.5 }).front();
+			break;
+		}
+
+		case QuantileAnalysis::Sketch: {
+			std::vector<std::pair<data_t, size_t>> items = sketch.items();
+			summary.median = QuantileSketch::weighted_quantile (items, 0.5);
+			for (auto it = probabilities.begin() + 1; it != probabilities.end(); ++it) {
+				summary.percentiles.push_back (QuantileSketch::weighted_quantile (items, *it));
+			}
+
+			for (auto& item: items) {
+				item.first = fabsl (item.first - summary.median);
+			}
+
+			std::sort (items.begin(), items.end());
+			summary.mad = QuantileSketch::weighted_quantile (items, 0.5);
+			summary.sketch_size = items.size();
+			break;
+		}
+
+		default:
+			break;
+		}
+
+		values.clear();
+		values.shrink_to_fit();
+	}
+};
+
+/* a named series of measurements with errors ('NAME VALUE ERROR' lines) */
+struct Series: Accumulator
+{
+	data_t error;
+
+	void merge (Series& other)
+	{
+		Accumulator::merge (other);
+		error = std::max (error, other.error);
+	}
+};
+
+/*
+ * Parses the chunks of the input on a pool of threads with parse (chunk), and passes the results to reduce (result)
+ * in the order of the chunks, so that the outcome does not depend on the count of threads.
+ */
+
+template <typename Parse, typename Reduce>
+void reduce_chunks (TextChunks& chunks, ThreadPool& pool, Parse parse, Reduce reduce)
+{
+	typedef typename std::result_of<Parse (const TextChunks::Chunk&)>::type Result;
+
+	std::deque<std::future<Result>> pending;
+	TextChunks::Chunk chunk;
+
+	while (chunks.next (chunk)) {
+		pending.push_back (pool.submit ([parse, chunk] { return parse (chunk); }));
+
+		/* keep a few chunks in flight only, so that a stream is not read into memory at once */
+		if (pending.size() > 2 * pool.size()) {
+			reduce (pending.front().get());
+			pending.pop_front();
+		}
+	}
+
+	for (; !pending.empty(); pending.pop_front()) {
+		reduce (pending.front().get());
+	}
+}
+
+/* summarizes whitespace-separated values */
+Summary summarize_values (TextChunks& chunks, const Analysis& analysis, ThreadPool& pool)
+{
+	Accumulator total;
+
+	reduce_chunks (chunks, pool,
+		[&analysis] (const TextChunks::Chunk& chunk) {
+			Accumulator accumulator;
+			TextReader reader (chunk.begin, chunk.end);
+			for_each_value (reader, [&accumulator, &analysis] (data_t value) { accumulator.add (value, analysis); });
+			return accumulator;
+		},
+		[&total] (Accumulator accumulator) { total.merge (accumulator); });
+
+	total.finish (analysis);
+	return total.summary;
+}
+
+/* counts the values within the sigma bands, in a second pass over the file */
+void count_values_in_ranges (Summary& summary, const MappedFile& file, const Analysis& analysis, ThreadPool& pool)
+{
+	data_t average = summary.moments.average(), stddev = summary.moments.stddev();
+	std::vector<size_t> counts (analysis.sigmas.size(), 0);
+	TextChunks chunks (file, CHUNK_SIZE, TextChunks::Boundary::Whitespace);
+
+	reduce_chunks (chunks, pool,
+		[average, stddev, &analysis] (const TextChunks::Chunk& chunk) {
+			std::vector<size_t> counts (analysis.sigmas.size(), 0);
+			TextReader reader (chunk.begin, chunk.end);
+			for_each_value (reader, [average, stddev, &analysis, &counts] (data_t value) {
+				count_in_ranges (value, average, stddev, analysis.sigmas, counts.data());
+			});
+			return counts;
+		},
+		[&counts] (const std::vector<size_t>& chunk_counts) {
+			std::transform (counts.begin(), counts.end(), chunk_counts.begin(), counts.begin(), std::plus<size_t>());
+		});
+
+	summary.in_range.assign (counts.begin(), counts.end());
+	summary.ranges_exact = true;
+}
+
+/* summarizes series of measurements with errors, per name */
+Groups<Series> summarize_series (TextChunks& chunks, const Analysis& analysis, ThreadPool& pool)
+{
+	Groups<Series> groups;
+
+	reduce_chunks (chunks, pool,
+		[&analysis] (const TextChunks::Chunk& chunk) {
+			Groups<Series> groups;
+			TextReader reader (chunk.begin, chunk.end);
+
+			const char* name_begin;
+			const char* name_end;
+			data_t value, error;
+
+			while (reader.next (name_begin, name_end)) {
+				VERIFY (reader.read (value) && reader.read (error), std::runtime_error,
+				        "Value or error missing for dataset '" << std::string (name_begin, name_end) << "'");
+
+				Series& series = groups.get (name_begin, name_end);
+				series.add (value, analysis);
+				series.error = std::max (series.error, error);
+			}
+
+			return groups;
+		},
+		[&groups] (Groups<Series> chunk_groups) { groups.merge (chunk_groups, [] (Series& into, Series& from) { into.merge (from); }); });
+
+	for (size_t index = 0; index < groups.size(); ++index) {
+		groups[index].finish (analysis);
+	}
+
+	return groups;
+}
+
+/* counts the values of each series within its sigma bands, in a second pass over the file */
+void count_series_in_ranges (Groups<Series>& groups, const MappedFile& file, const Analysis& analysis, ThreadPool& pool)
+{
+	size_t bands = analysis.sigmas.size();
+	std::vector<data_t> averages, stddevs;
+
+	for (const auto& series: groups) {
+		averages.push_back (series.second.summary.moments.average());
+		stddevs.push_back (series.second.summary.moments.stddev());
+	}
+
+	std::vector<size_t> counts (groups.size() * bands, 0);
+	TextChunks chunks (file, CHUNK_SIZE, TextChunks::Boundary::Line);
+
+	reduce_chunks (chunks, pool,
+		[&groups, &averages, &stddevs, &analysis, bands] (const TextChunks::Chunk& chunk) {
+			std::vector<size_t> counts (groups.size() * bands, 0);
+			TextReader reader (chunk.begin, chunk.end);
+			std::string key;
+
+			const char* name_begin;
+			const char* name_end;
+			data_t value, error;
+
+			while (reader.next (name_begin, name_end) && reader.read (value) && reader.read (error)) {
+				size_t index = groups.find (name_begin, name_end, key);
+				count_in_ranges (value, averages[index], stddevs[index], analysis.sigmas, &counts[index * bands]);
+			}
+
+			return counts;
+		},
+		[&counts] (const std::vector<size_t>& chunk_counts) {
+			std::transform (counts.begin(), counts.end(), chunk_counts.begin(), counts.begin(), std::plus<size_t>());
+		});
+
+	for (size_t index = 0; index < groups.size(); ++index) {
+		Summary& summary = groups[index].summary;
+		summary.in_range.assign (counts.begin() + index * bands, counts.begin() + (index + 1) * bands);
+		summary.ranges_exact = true;
+	}
+}
 
 } // anonymous namespace
 
-void process_dataset (const std::string& name, const std::string& name_machine, const std::vector<data_t>& data, data_t systematic_error,
-                      bool output_machine, bool output_terse);
+void process_dataset (const std::string& name, const std::string& name_machine, const Summary& summary, const Analysis& analysis,
+                      data_t systematic_error, bool output_machine, bool output_terse);
 
 int main (int argc, char** argv)
 {
@@ -55,15 +425,29 @@ int main (int argc, char** argv)
 		struct {
 			bool has_errors;
 			data_t additional_error;
+			std::string file;
+			bool stream;
 		} input;
+
+		struct {
+			bool quantiles;
+			std::vector<data_t> percentiles;
+			std::vector<data_t> sigmas;
+		} analysis;
+
+		struct {
+			unsigned jobs;
+		} execution;
 	} parameters = { };
 
+	parameters.analysis.sigmas = { 1, 2 };
+
 	/*
 	 * Parse the command-line arguments.
 	 */
 
 	int option;
-	while ((option = getopt_long (argc, argv, "mn:qeE:", option_array, nullptr)) != -1) {
+	while ((option = getopt_long (argc, argv, "mn:qeE:i:sj:p:", option_array, nullptr)) != -1) {
 		switch (option) {
 		case ARG_MACHINE_OUTPUT:
 			parameters.output.machine.enabled = true;
@@ -92,6 +476,38 @@ int main (int argc, char** argv)
 			break;
 		}
 
+		case ARG_INPUT_FILE:
+			parameters.input.file = optarg;
+			break;
+
+		case ARG_STREAM:
+			parameters.input.stream = true;
+			break;
+
+		case ARG_JOBS: {
+			std::istringstream ss (optarg);
+			ss >> parameters.execution.jobs;
+
+			if (!consumed_entirely (ss)) {
+				ERROR (std::runtime_error, "Could not parse the jobs count: '" << optarg << "'");
+			}
+
+			break;
+		}
+
+		case ARG_QUANTILES:
+			parameters.analysis.quantiles = true;
+			break;
+
+		case ARG_PERCENTILES:
+			parameters.analysis.quantiles = true;
+			parameters.analysis.percentiles = parse_list (optarg, "percentiles");
+			break;
+
+		case ARG_SIGMAS:
+			parameters.analysis.sigmas = parse_list (optarg, "sigma bands");
+			break;
+
 		default:
 			usage (argv[0]);
 		}
@@ -106,12 +522,70 @@ int main (int argc, char** argv)
 		usage (argv[0]);
 	}
 
+	for (data_t percentile: parameters.analysis.percentiles) {
+		if (!(percentile >= 0 && percentile <= 100)) {
+			std::cerr << "Percentiles must be within [0; 100]." << std::endl;
+			usage (argv[0]);
+		}
+	}
+
+	for (data_t sigma: parameters.analysis.sigmas) {
+		if (!(sigma > 0)) {
+			std::cerr << "Sigma bands must be positive." << std::endl;
+			usage (argv[0]);
+		}
+	}
+
+	if (parameters.execution.jobs == 0) {
+		parameters.execution.jobs = ThreadPool::default_concurrency();
+	}
+
 	/*
 	 * Read the input data.
 	 */
 
 	configure_exceptions (std::cin);
 
+	std::ifstream input_file;
+	std::istream& input = parameters.input.file.empty() ? std::cin : input_file;
+
+	if (!parameters.input.file.empty()) {
+		open (input_file, parameters.input.file.c_str());
+	}
+
+	/*
+	 * A regular file is mapped and parsed twice, the second time for the range analysis. Other inputs are read once,
+	 * keeping the values for the range analysis. The exact quantiles need the values as well (and then the range
+	 * analysis uses them too); --stream keeps memory bounded with a histogram and a quantile sketch instead.
+	 * Either way, the input is parsed in chunks on a pool of threads.
+	 */
+
+	ThreadPool pool (parameters.execution.jobs);
+	std::unique_ptr<MappedFile> file;
+
+	if (parameters.input.file.empty() ? MappedFile::mappable (STDIN_FILENO) : MappedFile::mappable (parameters.input.file.c_str())) {
+		file.reset (parameters.input.file.empty() ? new MappedFile (STDIN_FILENO) : new MappedFile (parameters.input.file.c_str()));
+	}
+
+	Analysis analysis;
+	analysis.sigmas = parameters.analysis.sigmas;
+	analysis.percentiles = parameters.analysis.percentiles;
+
+	analysis.quantiles = !parameters.analysis.quantiles ? QuantileAnalysis::None :
+	                     parameters.input.stream        ? QuantileAnalysis::Sketch
+	                                                    : QuantileAnalysis::Exact;
+
+	analysis.ranges = parameters.output.common.terse                   ? RangeAnalysis::None :
+	                  analysis.quantiles == QuantileAnalysis::Exact    ? RangeAnalysis::KeepValues :
+	                  file                                             ? RangeAnalysis::SecondPass :
+	                  parameters.input.stream                          ? RangeAnalysis::Histogram
+	                                                                   : RangeAnalysis::KeepValues;
+
+	auto make_chunks = [&file, &input] (TextChunks::Boundary boundary) {
+		return std::unique_ptr<TextChunks> (file ? new TextChunks (*file, CHUNK_SIZE, boundary)
+		                                         : new TextChunks (input, CHUNK_SIZE, boundary));
+	};
+
 	if (parameters.input.has_errors) {
 		if (!parameters.output.common.name.empty()) {
 			std::cerr << "Warning: configured dataset name '" << parameters.output.common.name << "' will be ignored." << std::endl
@@ -128,9 +602,14 @@ int main (int argc, char** argv)
 			          << std::endl;
 		}
 
-		Dataset<data_t>::Map datasets = read_into_vector_errors (std::cin);
-		for (Dataset<data_t>::Map::iterator it = datasets.begin(); it != datasets.end(); ++it) {
-			process_dataset (it->first, it->first, it->second.data, it->second.error,
+		Groups<Series> series = summarize_series (*make_chunks (TextChunks::Boundary::Line), analysis, pool);
+
+		if (analysis.ranges == RangeAnalysis::SecondPass) {
+			count_series_in_ranges (series, *file, analysis, pool);
+		}
+
+		for (const auto& named: series) {
+			process_dataset (named.first, named.first, named.second.summary, analysis, named.second.error,
 			                 parameters.output.machine.enabled, parameters.output.common.terse);
 		}
 	} else {
@@ -146,22 +625,27 @@ int main (int argc, char** argv)
 			parameters.output.machine.name = parameters.output.common.name;
 		}
 
-		std::vector<data_t> data = read_into_vector (std::cin);
-		process_dataset (parameters.output.common.name, parameters.output.machine.name, data, parameters.input.additional_error,
+		Summary summary = summarize_values (*make_chunks (TextChunks::Boundary::Whitespace), analysis, pool);
+
+		if (analysis.ranges == RangeAnalysis::SecondPass) {
+			count_values_in_ranges (summary, *file, analysis, pool);
+		}
+
+		process_dataset (parameters.output.common.name, parameters.output.machine.name, summary, analysis, parameters.input.additional_error,
 		                 parameters.output.machine.enabled, parameters.output.common.terse);
 	}
 }
 
 
-void process_dataset (const std::string& name, const std::string& name_machine, const std::vector<data_t>& data, data_t systematic_error,
-                      bool output_machine, bool output_terse)
+void process_dataset (const std::string& name, const std::string& name_machine, const Summary& summary, const Analysis& analysis,
+                      data_t systematic_error, bool output_machine, bool output_terse)
 {
-	data_t average = avg (data);
-	data_t squared_difference_sum = std::accumulate (data.begin(), data.end(), (double) 0,
-	                                                 [average] (double acc, double value) { return acc + (value - average) * (value - average); });
+	size_t count = summary.moments.count;
+	data_t average = summary.moments.average();
+	data_t squared_difference_sum = summary.moments.squared_deviation_sum();
 
-	data_t stddev = sqrt (squared_difference_sum / (data.size() - 1));
-	data_t stderror = sqrt (squared_difference_sum) / data.size();
+	data_t stddev = sqrt (squared_difference_sum / (count - 1));
+	data_t stderror = sqrt (squared_difference_sum) / count;
 	data_t total_error;
 
 	if (fp_cmp (systematic_error, 0)) {
@@ -172,7 +656,7 @@ void process_dataset (const std::string& name, const std::string& name_machine,
 
 	if (!output_terse) {
 		std::cerr << "Dataset averaging:" << std::endl
-		          << name << " < N=" << data.size() << " entries > = " << average << std::endl
+		          << name << " < N=" << count << " entries > = " << average << std::endl
 		          << std::endl
 		          << "Standard deviation (of the sample) = " << stddev << std::endl
 		          << "Standard error (of the average) = " << stderror << std::endl
@@ -184,28 +668,52 @@ void process_dataset (const std::string& name, const std::string& name_machine,
 			          << std::endl;
 		}
 
-		std::cerr << "Deviation range analysis:" << std::endl;
-
-		size_t measurements_in_range[MAX_SIGMA] = { };
-
-		for (size_t sigma = 1; sigma <= MAX_SIGMA; ++sigma) {
-			measurements_in_range[sigma - 1] = std::count_if (data.begin(), data.end(), [average, stddev, sigma] (data_t value) { return fabsl (value - average) <= stddev * sigma; });
+		std::cerr << "Deviation range analysis";
+		if (!summary.ranges_exact) {
+			std::cerr << " (approximate, from a histogram of " << Histogram::bin_count << " bins)";
 		}
+		std::cerr << ":" << std::endl;
 
-		for (size_t sigma = 1; sigma <= MAX_SIGMA; ++sigma) {
-			size_t count = measurements_in_range[sigma - 1];
-			std::cerr << " " << sigma << " sigma (" << stddev * sigma << "): " << count << " measurements (" << (data_t) 100 * count / data.size() << "%)" << std::endl;
+		for (size_t i = 0; i < analysis.sigmas.size(); ++i) {
+			data_t sigma = analysis.sigmas[i], in_range = summary.in_range[i];
+			std::cerr << " " << sigma << " sigma (" << stddev * sigma << "): " << (summary.ranges_exact ? "" : "~") << llroundl (in_range)
+			          << " measurements (" << (data_t) 100 * in_range / count << "%)" << std::endl;
 		}
 
 		std::cerr << std::endl;
+
+		if (analysis.quantiles != QuantileAnalysis::None) {
+			std::cerr << "Distribution";
+			if (analysis.quantiles == QuantileAnalysis::Sketch) {
+				std::cerr << " (approximate, from a sketch of " << summary.sketch_size << " values)";
+			}
+			std::cerr << ":" << std::endl
+			          << " minimum = " << summary.moments.minimum() << ", maximum = " << summary.moments.maximum() << std::endl
+			          << " median = " << summary.median << std::endl
+			          << " median absolute deviation = " << summary.mad << " (times " << MAD_TO_SIGMA << " = " << summary.mad * MAD_TO_SIGMA << ")" << std::endl;
+
+			for (size_t i = 0; i < analysis.percentiles.size(); ++i) {
+				std::cerr << " P" << analysis.percentiles[i] << " = " << summary.percentiles[i] << std::endl;
+			}
+
+			std::cerr << std::endl;
+		}
 	} else {
-		std::cerr << name << " <N=" << data.size() << "> = " << average << " ± " << total_error;
+		std::cerr << name << " <N=" << count << "> = " << average << " ± " << total_error;
 
 		if (!fp_cmp (systematic_error, 0)) {
 			std::cerr << " (std. = " << stderror << "; syst. = " << systematic_error << ")";
 		}
 
 		std::cerr << std::endl;
+
+		if (analysis.quantiles != QuantileAnalysis::None) {
+			std::cerr << name << " median = " << summary.median << ", MAD = " << summary.mad;
+			for (size_t i = 0; i < analysis.percentiles.size(); ++i) {
+				std::cerr << ", P" << analysis.percentiles[i] << " = " << summary.percentiles[i];
+			}
+			std::cerr << std::endl;
+		}
 	}
 
 	if (output_machine) {
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "util.h"
+
+#include <exception>
+#include <functional>
+#include <memory>
+
+#include <pthread.h>
+#include <ucontext.h>
+
+/*
+ * Recursion of unbounded depth on heap-allocated stack segments.
+ *
+ * DeepStack::call (f) calls f() right away while the current stack has enough room left. Otherwise it
+ * allocates a new segment on the heap, switches to it for the duration of the call and frees it afterwards,
+ * so that the native stack of the thread is never exhausted, however deep the recursion goes.
+ * Exceptions thrown by f() are carried back to the caller's stack.
+ *
+ * Recursive functions should pass each recursive call through DeepStack::call(); the frames between two such
+ * calls must fit into the red zone.
+ */
+
+class DeepStack
+{
+public:
+	static const size_t segment_size = 8 << 20;
+	static const size_t red_zone = 256 << 10;
+
+	template <typename F>
+	static auto call (F&& f) -> decltype (f())
+	{
+		if (!near_limit()) {
+			return f();
+		}
+
+		Result<decltype (f())> result;
+		run_on_segment ([&result, &f] { result.compute (f); });
+		return result.take();
+	}
+
+	/* true if the current stack has less than the red zone left */
+	static bool near_limit()
+	{
+		const char* frame = static_cast<const char*> (__builtin_frame_address (0));
+		return frame < limit() + red_zone;
+	}
+
+private:
+	template <typename T>
+	struct Result
+	{
+		T value;
+
+		template <typename F> void compute (F& f) { value = f(); }
+		T take() { return std::move (value); }
+	};
+
+	/* the lowest usable address of the stack the thread currently runs on (stacks grow downwards) */
+	static const char*& limit()
+	{
+		thread_local const char* value = native_limit();
+		return value;
+	}
+
+	static const char* native_limit()
+	{
+		pthread_attr_t attr;
+		void* address = nullptr;
+		size_t size = 0;
+
+		VERIFY (!pthread_getattr_np (pthread_self(), &attr), std::runtime_error, "Cannot determine the stack of the thread");
+		pthread_attr_getstack (&attr, &address, &size);
+		pthread_attr_destroy (&attr);
+
+		return static_cast<const char*> (address);
+	}
+
+	struct Switch
+	{
+		const std::function<void()>* function;
+		std::exception_ptr error;
+		ucontext_t caller, callee;
+	};
+
+	static Switch*& current_switch()
+	{
+		thread_local Switch* value = nullptr;
+		return value;
+	}
+
+	/* a segment kept for reuse, so that a recursion going back and forth across the limit does not allocate each time */
+	static std::unique_ptr<char[]>& spare_segment()
+	{
+		thread_local std::unique_ptr<char[]> value;
+		return value;
+	}
+
+	static void trampoline()
+	{
+		Switch* s = current_switch();
+
+		try {
+			(*s->function)();
+		} catch (...) {
+			s->error = std::current_exception();
+		}
+
+		/* returning resumes the caller through uc_link */
+	}
+
+	static void run_on_segment (const std::function<void()>& function)
+	{
+		std::unique_ptr<char[]> segment (std::move (spare_segment()));
+		if (!segment) {
+			segment.reset (new char[segment_size]);
+		}
+
+		Switch s;
+		s.function = &function;
+
+		VERIFY (!getcontext (&s.callee), std::runtime_error, "Cannot switch to a new stack segment");
+		s.callee.uc_stack.ss_sp = segment.get();
+		s.callee.uc_stack.ss_size = segment_size;
+		s.callee.uc_link = &s.caller;
+		makecontext (&s.callee, &DeepStack::trampoline, 0);
+
+		const char* saved_limit = limit();
+		Switch* saved_switch = current_switch();
+
+		limit() = segment.get();
+		current_switch() = &s;
+
+		swapcontext (&s.caller, &s.callee);
+
+		limit() = saved_limit;
+		current_switch() = saved_switch;
+		spare_segment() = std::move (segment);
+
+		if (s.error) {
+			std::rethrow_exception (s.error);
+		}
+	}
+};
+
+template <>
+struct DeepStack::Result<void>
+{
+	template <typename F> void compute (F& f) { f(); }
+	void take() { }
+};
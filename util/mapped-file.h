@@ -0,0 +1,113 @@
+#pragma once
+
+#include "util.h"
+
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+ * A read-only memory mapping of a whole file, to be walked over sequentially (possibly several times)
+ * without reading it into memory.
+ */
+
+class MappedFile
+{
+	const char* data_;
+	size_t size_;
+
+	/* an open descriptor which closes itself once the mapping is made */
+	struct Descriptor
+	{
+		int fd;
+		~Descriptor() { close (fd); }
+		operator int() const { return fd; }
+	};
+
+	static int open_read (const char* path)
+	{
+		int fd = ::open (path, O_RDONLY);
+		VERIFY (fd >= 0, std::runtime_error, "Cannot open '" << path << "': " << strerror (errno));
+		return fd;
+	}
+
+public:
+	/* whether the descriptor refers to a regular file (which can be mapped, unlike a pipe or a terminal) */
+	static bool mappable (int fd)
+	{
+		struct stat st;
+		return !fstat (fd, &st) && S_ISREG (st.st_mode);
+	}
+
+	static bool mappable (const char* path)
+	{
+		struct stat st;
+		return !stat (path, &st) && S_ISREG (st.st_mode);
+	}
+
+	explicit MappedFile (const char* path)
+	: MappedFile (Descriptor { open_read (path) })
+	{
+	}
+
+	explicit MappedFile (int fd)
+	: data_ (nullptr)
+	, size_ (0)
+	{
+		struct stat st;
+		VERIFY (!fstat (fd, &st), std::runtime_error, "Cannot stat the input file: " << strerror (errno));
+
+		size_ = st.st_size;
+		if (!size_) {
+			return;
+		}
+
+		void* data = mmap (nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+		VERIFY (data != MAP_FAILED, std::runtime_error, "Cannot map the input file: " << strerror (errno));
+		madvise (data, size_, MADV_SEQUENTIAL);
+
+		data_ = static_cast<const char*> (data);
+	}
+
+	~MappedFile()
+	{
+		if (data_) {
+			munmap (const_cast<char*> (data_), size_);
+		}
+	}
+
+	MappedFile (const MappedFile&) = delete;
+	MappedFile& operator= (const MappedFile&) = delete;
+
+	const char* begin() const { return data_; }
+	const char* end() const { return data_ + size_; }
+	size_t size() const { return size_; }
+};
+
+/*
+ * An input stream reading from a range of memory (such as a MappedFile) without copying it.
+ */
+
+class MemoryStream : public std::istream
+{
+	struct Buffer : std::streambuf
+	{
+		Buffer (const char* begin, const char* end)
+		{
+			char* data = const_cast<char*> (begin);
+			setg (data, data, data + (end - begin));
+		}
+	} buffer_;
+
+public:
+	MemoryStream (const char* begin, const char* end)
+	: std::istream (nullptr)
+	, buffer_ (begin, end)
+	{
+		rdbuf (&buffer_);
+	}
+};
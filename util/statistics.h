@@ -0,0 +1,514 @@
+#pragma once
+
+#include "util.h"
+
+#include <cstdint>
+#include <limits>
+
+/*
+ * Streaming statistics: accumulators which see each value once, take constant memory
+ * and can be merged, so that parts of a dataset may be summarized separately.
+ */
+
+/*
+ * Count, mean, sum of squared deviations from the mean, minimum and maximum of a dataset
+ * (Welford's update, and the pairwise combination of Chan et al. for merging).
+ */
+
+struct Moments
+{
+	size_t count = 0;
+	data_t mean = 0, m2 = 0;
+	data_t min = std::numeric_limits<data_t>::infinity(),
+	       max = -std::numeric_limits<data_t>::infinity();
+
+	void add (data_t value)
+	{
+		++count;
+		data_t delta = value - mean;
+		mean += delta / count;
+		m2 += delta * (value - mean);
+		min = std::min (min, value);
+		max = std::max (max, value);
+	}
+
+	void merge (const Moments& other)
+	{
+		if (!other.count) {
+			return;
+		}
+
+		if (!count) {
+			*this = other;
+			return;
+		}
+
+		size_t total = count + other.count;
+		data_t delta = other.mean - mean;
+		mean += delta * other.count / total;
+		m2 += other.m2 + sq (delta) * count / total * other.count;
+		count = total;
+		min = std::min (min, other.min);
+		max = std::max (max, other.max);
+	}
+
+	/* the mean, minimum and maximum, which are NaN for no values */
+	data_t average() const { return count ? mean : std::numeric_limits<data_t>::quiet_NaN(); }
+	data_t minimum() const { return count ? min : std::numeric_limits<data_t>::quiet_NaN(); }
+	data_t maximum() const { return count ? max : std::numeric_limits<data_t>::quiet_NaN(); }
+
+	/* the sum of squared deviations from the mean */
+	data_t squared_deviation_sum() const { return m2; }
+
+	/* standard deviation of the sample (with Bessel's correction) */
+	data_t stddev() const { return sqrtl (m2 / (count - 1)); }
+};
+
+/*
+ * A histogram of fixed resolution over a range it does not need to know in advance.
+ *
+ * The first bin_count values are kept as they are, and are enough to choose a bin width.
+ * The bins lie on a global grid of power-of-two widths; whenever a value falls outside of the bins,
+ * the width is doubled (pairs of bins are merged) until the range covers it.
+ * Two histograms are merged by bringing them to the same width.
+ *
+ * Counts over a range are thus exact while less than bin_count values have been added,
+ * and otherwise differ from the exact ones by at most the contents of the two bins at the ends of the range
+ * (assuming the values to be spread uniformly inside a bin).
+ */
+
+class Histogram
+{
+public:
+	static const size_t bin_count = 4096;
+
+	void add (data_t value)
+	{
+		++total_;
+
+		if (bins_.empty()) {
+			pending_.push_back (value);
+			if (pending_.size() >= bin_count) {
+				settle();
+			}
+			return;
+		}
+
+		add_bin (index_fitting (value), exponent_, 1);
+	}
+
+	void merge (const Histogram& other)
+	{
+		for (data_t value: other.pending_) {
+			add (value);
+		}
+
+		if (other.bins_.empty()) {
+			return;
+		}
+
+		if (bins_.empty()) {
+			/* take the bins of the other histogram and add our values (by now including its pending ones) to them */
+			std::vector<data_t> pending = std::move (pending_);
+
+			*this = other;
+			pending_.clear();
+			total_ -= other.pending_.size();
+
+			for (data_t value: pending) {
+				add (value);
+			}
+			return;
+		}
+
+		total_ += other.total_ - other.pending_.size();
+		for (size_t i = 0; i < bin_count; ++i) {
+			if (other.bins_[i]) {
+				add_bin (other.first_ + i, other.exponent_, other.bins_[i]);
+			}
+		}
+	}
+
+	size_t total() const { return total_; }
+
+	/* whether count_within() is exact */
+	bool exact() const { return bins_.empty(); }
+
+	/* the count of the values within [low; high] */
+	data_t count_within (data_t low, data_t high) const
+	{
+		if (bins_.empty()) {
+			return std::count_if (pending_.begin(), pending_.end(), [low, high] (data_t value) { return (value >= low) && (value <= high); });
+		}
+
+		if (!(low < high)) {
+			if (low != high) {
+				return 0;
+			}
+
+			/* a single point: the bin it falls into */
+			int64_t index = bin_index (low);
+			return ((index >= first_) && (index < first_ + (int64_t) bin_count)) ? bins_[index - first_] : 0;
+		}
+
+		data_t width = ldexpl (1, exponent_), result = 0;
+
+		for (size_t i = 0; i < bin_count; ++i) {
+			if (!bins_[i]) {
+				continue;
+			}
+
+			data_t bin_low = ldexpl (first_ + i, exponent_),
+			       overlap = std::min (high, bin_low + width) - std::max (low, bin_low);
+
+			if (overlap > 0) {
+				result += bins_[i] * std::min (overlap / width, (data_t) 1);
+			}
+		}
+
+		return result;
+	}
+
+private:
+	/* the values seen before the bin width is chosen */
+	std::vector<data_t> pending_;
+
+	/* bins_[i] counts the values in [(first_ + i) * 2^exponent_; (first_ + i + 1) * 2^exponent_) */
+	std::vector<size_t> bins_;
+	int64_t first_ = 0, low_ = 0, high_ = 0;
+	int exponent_ = 0;
+	size_t total_ = 0;
+
+	/* bin indices are kept well within the range of int64_t */
+	static constexpr data_t max_index = 1LL << 60;
+
+	static int64_t floor_half (int64_t index) { return (index >= 0) ? index / 2 : -((1 - index) / 2); }
+
+	int64_t bin_index (data_t value) const { return (int64_t) floorl (ldexpl (value, -exponent_)); }
+
+	/* the bin index of a value, coarsening the bins first if it is out of the representable range */
+	int64_t index_fitting (data_t value)
+	{
+		VERIFY (std::isfinite (value), std::runtime_error, "Cannot put a non-finite value (" << value << ") into a histogram");
+
+		while (fabsl (ldexpl (value, -exponent_)) >= max_index) {
+			coarsen();
+		}
+
+		return bin_index (value);
+	}
+
+	/* chooses the bin width so that the pending values span about half of the bins, and moves them into the bins */
+	void settle()
+	{
+		auto range = std::minmax_element (pending_.begin(), pending_.end());
+		data_t span = *range.second - *range.first;
+
+		if (span > 0) {
+			exponent_ = ilogbl (span / (bin_count / 2)) + 1;
+		} else {
+			/* all values are the same: make a bin narrower than the value itself */
+			exponent_ = (*range.first != 0) ? ilogbl (*range.first) - std::numeric_limits<data_t>::digits / 2 : 0;
+		}
+
+		bins_.assign (bin_count, 0);
+		first_ = low_ = high_ = index_fitting (*range.first);
+
+		std::vector<data_t> pending = std::move (pending_);
+		pending_.clear();
+
+		for (data_t value: pending) {
+			add_bin (index_fitting (value), exponent_, 1);
+		}
+	}
+
+	/* doubles the bin width */
+	void coarsen()
+	{
+		std::vector<size_t> bins (bin_count, 0);
+		int64_t first = floor_half (first_);
+
+		for (size_t i = 0; i < bin_count; ++i) {
+			bins[floor_half (first_ + i) - first] += bins_[i];
+		}
+
+		bins_ = std::move (bins);
+		first_ = first;
+		low_ = floor_half (low_);
+		high_ = floor_half (high_);
+		++exponent_;
+	}
+
+	/* adds count values to the bin of the given index on the grid of 2^exponent */
+	void add_bin (int64_t index, int exponent, size_t count)
+	{
+		for (; exponent < exponent_; ++exponent) {
+			index = floor_half (index);
+		}
+
+		while (exponent_ < exponent) {
+			coarsen();
+		}
+
+		while (std::max (high_, index) - std::min (low_, index) >= (int64_t) bin_count) {
+			coarsen();
+			index = floor_half (index);
+		}
+
+		low_ = std::min (low_, index);
+		high_ = std::max (high_, index);
+
+		/* move the window of bins if the index is outside of it */
+		if ((index < first_) || (index >= first_ + (int64_t) bin_count)) {
+			int64_t first = (index < first_) ? low_ : high_ - (int64_t) bin_count + 1;
+			std::vector<size_t> bins (bin_count, 0);
+
+			for (int64_t i = std::max (first, first_); i < std::min (first, first_) + (int64_t) bin_count; ++i) {
+				bins[i - first] = bins_[i - first_];
+			}
+
+			bins_ = std::move (bins);
+			first_ = first;
+		}
+
+		bins_[index - first_] += count;
+	}
+};
+
+/*
+ * Quantiles of values held in memory, found by selection (no full sort): the p-quantile (0 <= p <= 1)
+ * interpolates linearly between the order statistics around (count - 1) p. The values are reordered.
+ */
+
+inline std::vector<data_t> select_quantiles (std::vector<data_t>& values, const std::vector<data_t>& probabilities)
+{
+	std::vector<data_t> result (probabilities.size(), std::numeric_limits<data_t>::quiet_NaN());
+	if (values.empty()) {
+		return result;
+	}
+
+	/* select in the increasing order of the probabilities, each time within the part above the previous order statistic */
+	std::vector<size_t> order (probabilities.size());
+	std::iota (order.begin(), order.end(), 0);
+	std::sort (order.begin(), order.end(), [&probabilities] (size_t a, size_t b) { return probabilities[a] < probabilities[b]; });
+
+	auto first = values.begin();
+
+	for (size_t index: order) {
+		data_t position = (values.size() - 1) * std::min (std::max (probabilities[index], (data_t) 0), (data_t) 1);
+		auto lower = values.begin() + (size_t) floorl (position);
+
+		std::nth_element (first, lower, values.end());
+		first = lower;
+
+		data_t fraction = position - floorl (position);
+		result[index] = (fraction > 0) ? *lower + fraction * (*std::min_element (lower + 1, values.end()) - *lower) : *lower;
+	}
+
+	return result;
+}
+
+/*
+ * A mergeable quantile sketch (KLL, Karnin, Lang and Liberty) of bounded size.
+ *
+ * Values are kept in levels of compactors, an item of level h standing for 2^h values. Whenever the sketch is full,
+ * the lowest level over its capacity is sorted and every other item of it (odd or even ones, alternately)
+ * is promoted to the next level.
+ * The capacities decrease geometrically downwards from k at the top, so that the sketch holds O(k) items,
+ * and the rank of a value is known within about 1.7 / k of the count. The compactions are deterministic,
+ * so that the same values merged in the same order give the same sketch.
+ */
+
+class QuantileSketch
+{
+public:
+	static const size_t k = 400;
+
+	void add (data_t value)
+	{
+		if (levels_.empty()) {
+			resize (1);
+		}
+
+		levels_[0].push_back (value);
+		++count_;
+		++size_;
+
+		if (size_ >= total_capacity_) {
+			compress();
+		}
+	}
+
+	void merge (const QuantileSketch& other)
+	{
+		if (!other.count_) {
+			return;
+		}
+
+		if (levels_.size() < other.levels_.size()) {
+			resize (other.levels_.size());
+		}
+
+		for (size_t h = 0; h < other.levels_.size(); ++h) {
+			levels_[h].insert (levels_[h].end(), other.levels_[h].begin(), other.levels_[h].end());
+		}
+
+		count_ += other.count_;
+		size_ += other.size_;
+		compress();
+	}
+
+	size_t count() const { return count_; }
+
+	/* the count of items kept */
+	size_t size() const { return size_; }
+
+	/* the items with their weights (the count of values each one stands for), ordered by value */
+	std::vector<std::pair<data_t, size_t>> items() const
+	{
+		std::vector<std::pair<data_t, size_t>> result;
+		for (size_t h = 0; h < levels_.size(); ++h) {
+			for (data_t value: levels_[h]) {
+				result.emplace_back (value, (size_t) 1 << h);
+			}
+		}
+
+		std::sort (result.begin(), result.end());
+		return result;
+	}
+
+	/* the approximate p-quantile (0 <= p <= 1) */
+	data_t quantile (data_t p) const
+	{
+		return weighted_quantile (items(), p);
+	}
+
+	/* the p-quantile of weighted items ordered by value: the first one whose cumulative weight reaches p of the total */
+	static data_t weighted_quantile (const std::vector<std::pair<data_t, size_t>>& items, data_t p)
+	{
+		if (items.empty()) {
+			return std::numeric_limits<data_t>::quiet_NaN();
+		}
+
+		size_t total = 0;
+		for (const auto& item: items) {
+			total += item.second;
+		}
+
+		data_t target = std::min (std::max (p, (data_t) 0), (data_t) 1) * total, cumulative = 0;
+		for (const auto& item: items) {
+			cumulative += item.second;
+			if (cumulative >= target) {
+				return item.first;
+			}
+		}
+
+		return items.back().first;
+	}
+
+private:
+	std::vector<std::vector<data_t>> levels_;
+	std::vector<size_t> capacities_;
+	std::vector<bool> odd_;
+	size_t count_ = 0, size_ = 0, total_capacity_ = 0;
+
+	/* sets the count of levels; the capacity of a level at depth d below the top one is k (2/3)^d, but at least 2 */
+	void resize (size_t count)
+	{
+		levels_.resize (count);
+		odd_.resize (count, false);
+		capacities_.resize (count);
+		total_capacity_ = 0;
+
+		for (size_t h = 0; h < count; ++h) {
+			capacities_[h] = std::max ((size_t) ceill (k * powl (2.0L / 3, count - 1 - h)), (size_t) 2);
+			total_capacity_ += capacities_[h];
+		}
+	}
+
+	/* while the sketch is full, compacts the lowest level over its capacity (so that the lower levels fill up lazily) */
+	void compress()
+	{
+		while (size_ >= total_capacity_) {
+			size_t h = 0;
+			while (levels_[h].size() < capacities_[h]) {
+				++h;
+			}
+
+			if (h + 1 == levels_.size()) {
+				resize (levels_.size() + 1);
+			}
+
+			std::vector<data_t>& level = levels_[h];
+			std::sort (level.begin(), level.end());
+
+			/* an odd item out stays at this level */
+			size_t compacted = level.size() & ~(size_t) 1;
+			for (size_t i = odd_[h]; i < compacted; i += 2) {
+				levels_[h + 1].push_back (level[i]);
+			}
+			odd_[h] = !odd_[h];
+
+			level.erase (level.begin(), level.begin() + compacted);
+			size_ -= compacted / 2;
+		}
+	}
+};
+
+/*
+ * Accumulators for named groups of values, kept in the order in which the names first appear.
+ * The names are interned: looking up an existing group does not allocate.
+ */
+
+template <typename T>
+class Groups
+{
+	typedef std::vector<std::pair<std::string, T>> Vector;
+
+	std::unordered_map<std::string, size_t> index_;
+	Vector groups_;
+	std::string key_;
+
+public:
+	typedef typename Vector::const_iterator const_iterator;
+
+	/* the group of a name, created if it does not exist yet */
+	T& get (const char* begin, const char* end)
+	{
+		key_.assign (begin, end);
+
+		auto it = index_.find (key_);
+		if (it != index_.end()) {
+			return groups_[it->second].second;
+		}
+
+		index_.emplace (key_, groups_.size());
+		groups_.emplace_back (key_, T());
+		return groups_.back().second;
+	}
+
+	/* the index of the group of a name, or size() if there is none (key is a buffer, so that concurrent lookups are possible) */
+	size_t find (const char* begin, const char* end, std::string& key) const
+	{
+		key.assign (begin, end);
+
+		auto it = index_.find (key);
+		return (it != index_.end()) ? it->second : groups_.size();
+	}
+
+	/* merges the groups of another set into these with merge_group (T& into, T& from), appending the new ones in their order */
+	template <typename Merge>
+	void merge (Groups& other, Merge&& merge_group)
+	{
+		for (auto& group: other.groups_) {
+			merge_group (get (group.first.data(), group.first.data() + group.first.size()), group.second);
+		}
+	}
+
+	size_t size() const { return groups_.size(); }
+	const std::pair<std::string, T>& operator[] (size_t index) const { return groups_[index]; }
+	T& operator[] (size_t index) { return groups_[index].second; }
+
+	const_iterator begin() const { return groups_.begin(); }
+	const_iterator end() const { return groups_.end(); }
+};
@@ -0,0 +1,506 @@
+#pragma once
+
+#include "util.h"
+#include "mapped-file.h"
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+
+/*
+ * Reads whitespace-separated tokens (numbers, names) from text, without going through iostream:
+ * a regular file is mapped, any other input is read in large blocks straight from its stream buffer.
+ *
+ * Floating-point numbers are parsed by hand. Decimal numbers whose significand and power of ten are
+ * exactly representable take a single (hence correctly rounded) multiplication or division;
+ * the rest (long significands, large exponents, "inf", "nan", hexadecimal) go through strtold() or strtod().
+ * Values of other types are extracted from their token by operator>>.
+ */
+
+namespace text_reader_detail {
+
+/* the largest k such that 5^k (and hence 10^k = 2^k 5^k) fits into a significand of the given count of bits */
+inline int exact_power_limit (int digits)
+{
+	uint64_t limit = std::numeric_limits<uint64_t>::max() >> (64 - std::min (digits, 64)), power = 1;
+	int k = 0;
+
+	while (power <= limit / 5) {
+		power *= 5;
+		++k;
+	}
+
+	return k;
+}
+
+template <typename T>
+inline T power_of_ten (int k)
+{
+	static const std::vector<T> powers = [] {
+		std::vector<T> result (1, 1);
+		for (int i = 1; i <= exact_power_limit (std::numeric_limits<T>::digits); ++i) {
+			result.push_back (result.back() * 10);
+		}
+		return result;
+	} ();
+
+	return powers[k];
+}
+
+inline void fallback_parse (const char* text, char** end, long double& value) { value = strtold (text, end); }
+inline void fallback_parse (const char* text, char** end, double& value) { value = strtod (text, end); }
+inline void fallback_parse (const char* text, char** end, float& value) { value = strtof (text, end); }
+
+inline bool is_space (char c)
+{
+	return (c == ' ') || (c == '\n') || (c == '\t') || (c == '\r') || (c == '\v') || (c == '\f');
+}
+
+inline bool is_digit (char c)
+{
+	return (c >= '0') && (c <= '9');
+}
+
+/*
+ * Parses [+-]digits[.digits][(e|E)[+-]digits] (with at least one digit in the significand) within [begin; end).
+ * Returns false if the text has some other form or is not exactly representable, leaving it to the fallback.
+ */
+
+template <typename T>
+inline bool fast_parse (const char* begin, const char* end, T& value)
+{
+	const int digits = std::min (std::numeric_limits<T>::digits, 64);
+	const uint64_t max_significand = std::numeric_limits<uint64_t>::max() >> (64 - digits);
+	static const int max_power = exact_power_limit (digits);
+
+	const char* p = begin;
+	bool negative = false;
+
+	if ((p < end) && ((*p == '+') || (*p == '-'))) {
+		negative = (*p == '-');
+		++p;
+	}
+
+	uint64_t significand = 0;
+	bool exact = true, seen_digits = false;
+	int exponent = 0;
+
+	for (; (p < end) && is_digit (*p); ++p) {
+		seen_digits = true;
+		if (significand > (max_significand - 9) / 10) {
+			exact = false;
+			break;
+		}
+		significand = significand * 10 + (*p - '0');
+	}
+
+	if ((p < end) && (*p == '.')) {
+		for (++p; (p < end) && is_digit (*p); ++p) {
+			seen_digits = true;
+			if (significand > (max_significand - 9) / 10) {
+				exact = false;
+				break;
+			}
+			significand = significand * 10 + (*p - '0');
+			--exponent;
+		}
+	}
+
+	if (!exact || !seen_digits) {
+		return false;
+	}
+
+	if ((p < end) && ((*p == 'e') || (*p == 'E'))) {
+		++p;
+		bool negative_exponent = false;
+
+		if ((p < end) && ((*p == '+') || (*p == '-'))) {
+			negative_exponent = (*p == '-');
+			++p;
+		}
+
+		if ((p == end) || !is_digit (*p)) {
+			return false;
+		}
+
+		int explicit_exponent = 0;
+		for (; (p < end) && is_digit (*p); ++p) {
+			if (explicit_exponent > 100000) {
+				return false;
+			}
+			explicit_exponent = explicit_exponent * 10 + (*p - '0');
+		}
+
+		exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+	}
+
+	if (p != end) {
+		return false;
+	}
+
+	if (significand == 0) {
+		value = negative ? -(T) 0 : (T) 0;
+		return true;
+	}
+
+	if ((exponent > max_power) || (exponent < -max_power)) {
+		return false;
+	}
+
+	T result = (T) significand;
+	if (exponent >= 0) {
+		result *= power_of_ten<T> (exponent);
+	} else {
+		result /= power_of_ten<T> (-exponent);
+	}
+
+	value = negative ? -result : result;
+	return true;
+}
+
+} // namespace text_reader_detail
+
+class TextReader
+{
+	std::unique_ptr<MappedFile> file_;
+	std::unique_ptr<std::ifstream> stream_;
+
+	/* the stream buffer to read blocks from, or nullptr if all the text is in memory */
+	std::streambuf* source_;
+	std::vector<char> buffer_;
+	const char* position_;
+	const char* end_;
+
+	/* a NUL-terminated copy of the current token, for the parsers which need one */
+	std::string token_;
+
+	static const size_t block_size = 1 << 20;
+
+	/* reads the next block, keeping the text from keep (if not nullptr) up to the end of the current one in front of it */
+	bool refill (const char* keep)
+	{
+		if (!source_) {
+			return false;
+		}
+
+		size_t kept = keep ? end_ - keep : 0;
+		if (kept) {
+			/* a token longer than half of the buffer: make room for twice as much */
+			if (kept * 2 > buffer_.size()) {
+				std::vector<char> buffer (buffer_.size() * 2);
+				std::copy (keep, end_, buffer.begin());
+				buffer_.swap (buffer);
+			} else {
+				std::copy (keep, end_, buffer_.begin());
+			}
+		}
+
+		std::streamsize count = source_->sgetn (buffer_.data() + kept, buffer_.size() - kept);
+		position_ = buffer_.data() + kept;
+		end_ = position_ + std::max (count, (std::streamsize) 0);
+		return count > 0;
+	}
+
+	void init_stream (std::istream& in)
+	{
+		source_ = in.rdbuf();
+		buffer_.resize (block_size);
+		position_ = end_ = buffer_.data();
+	}
+
+	template <typename T>
+	static void parse_fp (const char* begin, const char* end, std::string& token, T& value)
+	{
+		if (text_reader_detail::fast_parse (begin, end, value)) {
+			return;
+		}
+
+		token.assign (begin, end);
+		char* parsed_end;
+		text_reader_detail::fallback_parse (token.c_str(), &parsed_end, value);
+		VERIFY ((parsed_end == token.c_str() + token.size()) && !token.empty(), std::runtime_error, "Malformed number: '" << token << "'");
+	}
+
+public:
+	/* reads the text in memory */
+	TextReader (const char* begin, const char* end)
+	: source_ (nullptr)
+	, position_ (begin)
+	, end_ (end)
+	{
+	}
+
+	/* reads a stream in blocks; what it reads is not available through the stream afterwards */
+	explicit TextReader (std::istream& in)
+	{
+		init_stream (in);
+	}
+
+	/* maps a regular file, or reads any other file in blocks */
+	explicit TextReader (const char* path)
+	{
+		if (MappedFile::mappable (path)) {
+			file_.reset (new MappedFile (path));
+			source_ = nullptr;
+			position_ = file_->begin();
+			end_ = file_->end();
+		} else {
+			stream_.reset (new std::ifstream (path));
+			VERIFY (stream_->is_open(), std::runtime_error, "Cannot open '" << path << "': " << strerror (errno));
+			configure_exceptions (*stream_);
+			init_stream (*stream_);
+		}
+	}
+
+	TextReader (const TextReader&) = delete;
+	TextReader& operator= (const TextReader&) = delete;
+
+	/* finds the next token; returns false at the end of the text */
+	bool next (const char*& begin, const char*& end)
+	{
+		for (;;) {
+			while ((position_ < end_) && text_reader_detail::is_space (*position_)) {
+				++position_;
+			}
+
+			if (position_ < end_) {
+				break;
+			}
+
+			if (!refill (nullptr)) {
+				return false;
+			}
+		}
+
+		const char* start = position_;
+
+		for (;;) {
+			while ((position_ < end_) && !text_reader_detail::is_space (*position_)) {
+				++position_;
+			}
+
+			if ((position_ < end_) || !source_) {
+				break;
+			}
+
+			/* the token may continue in the next block */
+			bool more = refill (start);
+			start = buffer_.data();
+
+			if (!more) {
+				break;
+			}
+		}
+
+		begin = start;
+		end = position_;
+		return true;
+	}
+
+	/* whether only whitespace is left */
+	bool at_end()
+	{
+		const char* begin;
+		const char* end;
+
+		if (!next (begin, end)) {
+			return true;
+		}
+
+		/* step back to the token: it is in the buffer still */
+		position_ = begin;
+		return false;
+	}
+
+	/* reads the next token as a value; returns false at the end of the text, and throws if the token is not a valid value */
+	template <typename T>
+	bool read (T& value)
+	{
+		const char* begin;
+		const char* end;
+
+		if (!next (begin, end)) {
+			return false;
+		}
+
+		parse (begin, end, value);
+		return true;
+	}
+
+	void parse (const char* begin, const char* end, long double& value) { parse_fp (begin, end, token_, value); }
+	void parse (const char* begin, const char* end, double& value) { parse_fp (begin, end, token_, value); }
+	void parse (const char* begin, const char* end, float& value) { parse_fp (begin, end, token_, value); }
+	void parse (const char* begin, const char* end, std::string& value) { value.assign (begin, end); }
+
+	template <typename T>
+	void parse (const char* begin, const char* end, T& value)
+	{
+		MemoryStream stream (begin, end);
+		stream >> value;
+		VERIFY (consumed_entirely (stream), std::runtime_error, "Malformed value: '" << std::string (begin, end) << "'");
+	}
+};
+
+/*
+ * Reads a file into a vector.
+ */
+
+template <typename T = data_t>
+inline std::vector<T> read_into_vector (TextReader& reader)
+{
+	std::vector<T> ret;
+	T value;
+	while (reader.read (value)) {
+		ret.push_back (value);
+	}
+	return ret;
+}
+
+template <typename T = data_t>
+inline std::vector<T> read_into_vector (std::istream& in)
+{
+	TextReader reader (in);
+	return read_into_vector<T> (reader);
+}
+
+template <typename T = data_t>
+inline std::vector<T> read_into_vector (const char* path)
+{
+	TextReader reader (path);
+	return read_into_vector<T> (reader);
+}
+
+/*
+ * Calls a function for each value read, without keeping the values.
+ */
+
+template <typename T = data_t, typename F>
+inline void for_each_value (TextReader& reader, F&& function)
+{
+	T value;
+	while (reader.read (value)) {
+		function (value);
+	}
+}
+
+/*
+ * Cuts text into chunks of about chunk_size bytes which end at line breaks (or at any whitespace), so that they
+ * can be parsed independently: views into a mapped file, or blocks read from a stream (each chunk then owning its text).
+ * The chunks depend on the text and chunk_size only.
+ */
+
+class TextChunks
+{
+public:
+	enum class Boundary
+	{
+		Line,
+		Whitespace
+	};
+
+	struct Chunk
+	{
+		std::shared_ptr<std::string> text;
+		const char* begin;
+		const char* end;
+	};
+
+	TextChunks (const MappedFile& file, size_t chunk_size, Boundary boundary)
+	: source_ (nullptr)
+	, position_ (file.begin())
+	, end_ (file.end())
+	, chunk_size_ (chunk_size)
+	, boundary_ (boundary)
+	{
+	}
+
+	TextChunks (std::istream& in, size_t chunk_size, Boundary boundary)
+	: source_ (in.rdbuf())
+	, position_ (nullptr)
+	, end_ (nullptr)
+	, chunk_size_ (chunk_size)
+	, boundary_ (boundary)
+	{
+	}
+
+	/* gets the next chunk; returns false at the end of the text */
+	bool next (Chunk& chunk)
+	{
+		return source_ ? next_read (chunk) : next_mapped (chunk);
+	}
+
+private:
+	std::streambuf* source_;
+	const char* position_;
+	const char* end_;
+	size_t chunk_size_;
+	Boundary boundary_;
+
+	/* the text read from the stream past the end of the last chunk */
+	std::string remainder_;
+
+	bool is_boundary (char c) const
+	{
+		return (boundary_ == Boundary::Line) ? (c == '\n') : text_reader_detail::is_space (c);
+	}
+
+	/* the first boundary within [begin; end), or end */
+	const char* find_boundary (const char* begin, const char* end) const
+	{
+		return std::find_if (begin, end, [this] (char c) { return is_boundary (c); });
+	}
+
+	bool next_mapped (Chunk& chunk)
+	{
+		if (position_ == end_) {
+			return false;
+		}
+
+		/* the first boundary which makes the chunk at least chunk_size long */
+		const char* end = find_boundary (position_ + std::min (chunk_size_ - 1, (size_t) (end_ - position_)), end_);
+		end += (end != end_);
+
+		chunk.text.reset();
+		chunk.begin = position_;
+		chunk.end = position_ = end;
+		return true;
+	}
+
+	bool next_read (Chunk& chunk)
+	{
+		std::shared_ptr<std::string> text (new std::string);
+		text->swap (remainder_);
+
+		/* read until the first boundary which makes the chunk at least chunk_size long (or until the end of the stream) */
+		size_t searched = 0;
+		for (;;) {
+			size_t from = std::min (std::max (searched, chunk_size_ - 1), text->size());
+			size_t end = find_boundary (text->data() + from, text->data() + text->size()) - text->data();
+
+			if (end != text->size()) {
+				remainder_.assign (*text, end + 1, std::string::npos);
+				text->resize (end + 1);
+				break;
+			}
+
+			size_t size = text->size(), wanted = std::max (chunk_size_, size / 2);
+			text->resize (size + wanted);
+			std::streamsize count = source_->sgetn (&(*text)[size], wanted);
+			text->resize (size + std::max (count, (std::streamsize) 0));
+			searched = size;
+
+			if (count <= 0) {
+				break;
+			}
+		}
+
+		if (text->empty()) {
+			return false;
+		}
+
+		chunk.text = text;
+		chunk.begin = text->data();
+		chunk.end = text->data() + text->size();
+		return true;
+	}
+};
@@ -0,0 +1,137 @@
+#pragma once
+
+#include "util.h"
+
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <deque>
+#include <memory>
+
+/*
+ * A fixed-size pool of worker threads executing tasks in submission order.
+ * Results (and exceptions) of tasks are delivered through futures.
+ *
+ * A task may submit subtasks and wait for them with wait(), which runs the queued tasks meanwhile,
+ * so that the pool does not deadlock when all workers are waiting.
+ */
+
+class ThreadPool
+{
+	std::vector<std::thread> workers_;
+	std::deque<std::function<void()>> tasks_;
+	std::mutex mutex_;
+	std::condition_variable condition_;
+	bool stopping_;
+
+	void worker()
+	{
+		for (;;) {
+			std::function<void()> task;
+
+			{
+				std::unique_lock<std::mutex> lock (mutex_);
+				condition_.wait (lock, [this] { return stopping_ || !tasks_.empty(); });
+
+				if (tasks_.empty()) {
+					return;
+				}
+
+				task = std::move (tasks_.front());
+				tasks_.pop_front();
+			}
+
+			task();
+		}
+	}
+
+public:
+	explicit ThreadPool (size_t threads = default_concurrency())
+	: stopping_ (false)
+	{
+		VERIFY (threads > 0, std::logic_error, "Thread pool must have at least one thread");
+
+		workers_.reserve (threads);
+		for (size_t i = 0; i < threads; ++i) {
+			workers_.emplace_back (&ThreadPool::worker, this);
+		}
+	}
+
+	ThreadPool (const ThreadPool&) = delete;
+	ThreadPool& operator= (const ThreadPool&) = delete;
+
+	/* finishes all queued tasks before returning */
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock (mutex_);
+			stopping_ = true;
+		}
+
+		condition_.notify_all();
+
+		for (std::thread& worker: workers_) {
+			worker.join();
+		}
+	}
+
+	size_t size() const { return workers_.size(); }
+
+	template <typename Task>
+	std::future<typename std::result_of<Task()>::type> submit (Task task)
+	{
+		typedef typename std::result_of<Task()>::type Result;
+
+		/* std::function requires a copyable target, hence the shared_ptr */
+		std::shared_ptr<std::packaged_task<Result()>> packaged (new std::packaged_task<Result()> (std::move (task)));
+		std::future<Result> result = packaged->get_future();
+
+		{
+			std::lock_guard<std::mutex> lock (mutex_);
+			tasks_.emplace_back ([packaged] { (*packaged)(); });
+		}
+
+		condition_.notify_one();
+		return result;
+	}
+
+	/* runs one queued task in the calling thread, returns false if there was none */
+	bool run_pending()
+	{
+		std::function<void()> task;
+
+		{
+			std::lock_guard<std::mutex> lock (mutex_);
+
+			if (tasks_.empty()) {
+				return false;
+			}
+
+			task = std::move (tasks_.front());
+			tasks_.pop_front();
+		}
+
+		task();
+		return true;
+	}
+
+	template <typename Result>
+	Result wait (std::future<Result>& future)
+	{
+		while (future.wait_for (std::chrono::seconds (0)) != std::future_status::ready) {
+			/* nothing to help with: the task is running in another thread */
+			if (!run_pending()) {
+				future.wait_for (std::chrono::microseconds (100));
+			}
+		}
+
+		return future.get();
+	}
+
+	static size_t default_concurrency()
+	{
+		return std::max (std::thread::hardware_concurrency(), 1u);
+	}
+};
@@ -73,77 +73,33 @@ inline void configure_exceptions (std::ostream& stream)
 }
 
 /*
- * Opens a file for reading and configures ifstream's exceptions.
+ * Checks that a stream has been parsed successfully and that nothing but whitespace remains.
+ * (std::ws sets failbit if the stream is already at EOF, so it cannot be applied unconditionally.)
  */
 
-inline void open (std::ifstream& stream, const char* name)
+inline bool consumed_entirely (std::istream& stream)
 {
-	configure_exceptions (stream);
-	stream.open (name);
+	return !stream.fail() && (stream.eof() || (stream >> std::ws).eof());
 }
 
 /*
- * Opens a file for writing and configures ofstream's exceptions.
+ * Opens a file for reading and configures ifstream's exceptions.
  */
 
-inline void open (std::ofstream& stream, const char* name)
+inline void open (std::ifstream& stream, const char* name)
 {
 	configure_exceptions (stream);
 	stream.open (name);
 }
 
 /*
- * Reads a file into a vector.
+ * Opens a file for writing and configures ofstream's exceptions.
  */
 
-template <typename T = data_t>
-inline std::vector<T> read_into_vector (std::istream& in)
-{
-	std::vector<T> ret;
-	try {
-		std::copy (std::istream_iterator<T> (in),
-		           std::istream_iterator<T>(),
-		           std::back_inserter (ret));
-	} catch (std::ios_base::failure& e) {
-		if (!in.eof()) throw;
-	}
-	return std::move (ret);
-}
-
-template <typename T>
-struct Dataset;
-
-template <typename T>
-struct Dataset
-{
-	std::vector<T> data;
-	T error;
-
-	Dataset()
-	: data()
-	, error (0)
-	{
-	}
-
-	typedef std::unordered_map<std::string, Dataset<T>> Map;
-};
-
-template <typename T = data_t>
-inline typename Dataset<T>::Map read_into_vector_errors (std::istream& in)
+inline void open (std::ofstream& stream, const char* name)
 {
-	typename Dataset<T>::Map datasets_in_file;
-
-	while (!in.eof()) {
-		std::string line_name;
-		T value, error;
-		std::cin >> line_name >> value >> error >> std::ws;
-
-		Dataset<T>& dataset = datasets_in_file[line_name];
-		dataset.error = std::max (dataset.error, error);
-		dataset.data.push_back (value);
-	}
-
-	return datasets_in_file;
+	configure_exceptions (stream);
+	stream.open (name);
 }
 
 /*
@@ -233,16 +189,72 @@ inline T sq (T val)
 }
 
 /*
- * Numeric: an integer power operator.
+ * Numeric: an integer power operator (binary exponentiation).
+ * Non-positive exponents yield 1. Powers of small bases are taken from a table built once.
  */
 
+namespace pow_detail {
+
+const unsigned table_max_base = 16;
+const unsigned table_max_exponent = 64;
+
+/* table[(base - 2) * (table_max_exponent + 1) + exponent] = base^exponent */
+inline const std::vector<integer_t>& table()
+{
+	static const std::vector<integer_t> powers = [] {
+		std::vector<integer_t> result;
+		result.reserve ((table_max_base - 1) * (table_max_exponent + 1));
+
+		for (unsigned base = 2; base <= table_max_base; ++base) {
+			integer_t power = 1;
+			for (unsigned exponent = 0; exponent <= table_max_exponent; ++exponent) {
+				result.push_back (power);
+				power *= base;
+			}
+		}
+
+		return result;
+	} ();
+
+	return powers;
+}
+
+} // namespace pow_detail
+
 inline integer_t pow_int (integer_t base, integer_t exponent)
 {
+	if (exponent <= 0) {
+		return 1;
+	}
+
+	integer_t base_abs = boost::multiprecision::abs (base);
+	bool negate = (base < 0) && boost::multiprecision::bit_test (exponent, 0);
+
+	if (base_abs <= 1) {
+		return negate ? integer_t (-base_abs) : base_abs;
+	}
+
+	if ((base_abs <= pow_detail::table_max_base) && (exponent <= pow_detail::table_max_exponent)) {
+		const integer_t& power = pow_detail::table()[(base_abs.convert_to<unsigned>() - 2) * (pow_detail::table_max_exponent + 1) +
+		                                             exponent.convert_to<unsigned>()];
+		return negate ? integer_t (-power) : power;
+	}
+
 	integer_t result = 1;
-	for (integer_t i = 0; i < exponent; ++i) {
-		result *= base;
+	for (;;) {
+		if (boost::multiprecision::bit_test (exponent, 0)) {
+			result *= base_abs;
+		}
+
+		exponent >>= 1;
+		if (exponent == 0) {
+			break;
+		}
+
+		base_abs *= base_abs;
 	}
-	return result;
+
+	return negate ? integer_t (-result) : result;
 }
 
 inline rational_t pow_frac (rational_t base, integer_t exponent)
@@ -256,6 +268,82 @@ inline rational_t pow_frac (rational_t base, integer_t exponent)
 	}
 }
 
+/*
+ * Numeric: computes the exact integer k-th root of a value.
+ * Returns false (leaving the result unspecified) if the value is not a perfect k-th power.
+ */
+
+inline bool root_int (const integer_t& value, integer_t degree, integer_t& result)
+{
+	if (degree <= 0) {
+		return false;
+	}
+
+	if ((degree == 1) || (value == 0) || (value == 1)) {
+		result = value;
+		return true;
+	}
+
+	if (value < 0) {
+		/* only odd roots of negative values are real */
+		if (!boost::multiprecision::bit_test (degree, 0) || !root_int (-value, degree, result)) {
+			return false;
+		}
+		result = -result;
+		return true;
+	}
+
+	/* a root of a value having less than k bits (and greater than 1) is between 1 and 2 */
+	unsigned bits = boost::multiprecision::msb (value) + 1;
+	if (degree >= bits) {
+		return false;
+	}
+
+	unsigned k = degree.convert_to<unsigned>();
+
+	/* Newton's iteration from above: x <- ((k - 1) x + value / x^(k - 1)) / k decreases monotonically to the floor of the root */
+	integer_t x = integer_t (1) << ((bits + k - 1) / k);
+
+	for (;;) {
+		integer_t next = ((k - 1) * x + value / pow_int (x, k - 1)) / k;
+		if (next >= x) {
+			break;
+		}
+		x = std::move (next);
+	}
+
+	if (pow_int (x, k) != value) {
+		return false;
+	}
+
+	result = std::move (x);
+	return true;
+}
+
+/*
+ * Numeric: computes base^exponent for a rational exponent p/q exactly, i. e. when the base is
+ * a perfect q-th power of a rational. Returns false (leaving the result unspecified) otherwise.
+ * Like pow_frac(), throws for a zero base with a negative exponent.
+ */
+
+inline bool pow_frac_exact (const rational_t& base, const rational_t& exponent, rational_t& result)
+{
+	if (exponent.denominator() == 1) {
+		result = pow_frac (base, exponent.numerator());
+		return true;
+	}
+
+	integer_t numerator_root, denominator_root;
+
+	if (!root_int (base.numerator(), exponent.denominator(), numerator_root) ||
+	    !root_int (base.denominator(), exponent.denominator(), denominator_root)) {
+		return false;
+	}
+
+	result = pow_frac (rational_t (numerator_root, denominator_root), exponent.numerator());
+	return true;
+}
+
 template <typename T>
 inline bool any_isa (const boost::any& obj)
 {
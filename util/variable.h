@@ -1,6 +1,7 @@
 #pragma once
 
 #include "util.h"
+#include "text-reader.h"
 
 /*
  * Defines a single variable with a value and an error.
@@ -23,6 +24,9 @@ struct Variable
 
 	template <typename T>
 	static Map::value_type read (std::istream& in);
+
+	template <typename T>
+	static Map::value_type read (TextReader& in);
 };
 
 template <typename T>
@@ -30,7 +34,7 @@ inline Variable::Map::value_type Variable::read (std::istream& in)
 {
 	std::string name;
 	T value, error;
-	in >> name >> std::ws >> value >> std::ws >> error >> std::ws; // work around bugs in boost::multiprecision or boost::rational or clang
+	in >> name >> std::ws >> value >> std::ws >> error; // work around bugs in boost::multiprecision or boost::rational or clang
 	return Map::value_type { name, Variable { value, error, false } };
 }
 
@@ -42,6 +46,23 @@ inline Variable::Map::value_type Variable::read<void> (std::istream& in)
 	return Map::value_type { name, Variable { boost::any(), boost::any(), false } };
 }
 
+template <typename T>
+inline Variable::Map::value_type Variable::read (TextReader& in)
+{
+	std::string name;
+	T value, error;
+	VERIFY (in.read (name) && in.read (value) && in.read (error), std::runtime_error, "Incomplete definition of variable '" << name << "'");
+	return Map::value_type { name, Variable { value, error, false } };
+}
+
+template <>
+inline Variable::Map::value_type Variable::read<void> (TextReader& in)
+{
+	std::string name;
+	in.read (name);
+	return Map::value_type { name, Variable { boost::any(), boost::any(), false } };
+}
+
 /*
  * Adds a single variable definition.
  */
@@ -59,10 +80,9 @@ inline void parse_variable (Variable::Map& map, std::istream& stream)
 template <typename T>
 void parse_variables_from_file (Variable::Map& map, const char* path)
 {
-	std::ifstream variable_file;
-	open (variable_file, path);
+	TextReader variable_file (path);
 
-	while (!(variable_file >> std::ws, variable_file.eof())) {
-		parse_variable<T> (map, variable_file);
+	while (!variable_file.at_end()) {
+		map.insert (Variable::read<T> (variable_file));
 	}
 }